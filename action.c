@@ -0,0 +1,446 @@
+#include "action.h"
+#include "position.h"
+#include "schedule.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+void action_list_init(struct action_list *list)
+{
+    list->actions = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+void action_list_free(struct action_list *list)
+{
+    free(list->actions);
+    action_list_init(list);
+}
+
+int parse_duration(const char *text, useconds_t *duration)
+{
+    int ret = 0;
+    unsigned long duration_ms;
+    char *endptr;
+
+    duration_ms = strtoul(text, &endptr, 0);
+
+    // Check for a valid numeric argument
+    if (*text != '\0' && *endptr == '\0' &&
+            duration_ms < MAX_ACTION_DURATION_MS)
+    {
+        *duration = duration_ms * 1000;
+    }
+    else
+    {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int parse_durations(const char *text, useconds_t *tilt_duration,
+        useconds_t *pan_duration)
+{
+    int ret = 0;
+    const char *separator = strchr(text, ',');
+
+    if (separator == NULL)
+    {
+        ret = parse_duration(text, tilt_duration);
+        *pan_duration = *tilt_duration;
+    }
+    else
+    {
+        char tilt_text[16];
+
+        if (separator - text >= (ptrdiff_t)sizeof(tilt_text))
+        {
+            ret = -1;
+        }
+        else
+        {
+            memcpy(tilt_text, text, separator - text);
+            tilt_text[separator - text] = '\0';
+
+            if (parse_duration(tilt_text, tilt_duration) != 0 ||
+                    parse_duration(separator + 1, pan_duration) != 0)
+            {
+                ret = -1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+int parse_target(const char *text, int16_t *pan, int16_t *tilt)
+{
+    int ret = 0;
+    double pan_deg;
+    double tilt_deg;
+    char extra;
+
+    // Angles past a full turn can't be meaningful for either axis
+    if (sscanf(text, "%lf,%lf%c", &pan_deg, &tilt_deg, &extra) != 2 ||
+            pan_deg < -360.0 || pan_deg > 360.0 ||
+            tilt_deg < -360.0 || tilt_deg > 360.0)
+    {
+        ret = -1;
+    }
+    else
+    {
+        *pan = (int16_t)lround(pan_deg * 10.0);
+        *tilt = (int16_t)lround(tilt_deg * 10.0);
+    }
+
+    return ret;
+}
+
+/**
+ * Checks whether an action moves the turret for a fixed time
+ *
+ * @param[in] action The action to check
+ *
+ * @return Returns true for moves and diagonal moves
+ */
+static bool is_move(const struct action *action)
+{
+    return action->type == ACTION_MOVE || action->type == ACTION_DIAGONAL;
+}
+
+/**
+ * Checks whether a duration can be added to another without overflowing
+ *
+ * @param[in] a The first duration
+ * @param[in] b The second duration
+ *
+ * @return Returns true if the sum fits in an action
+ */
+static bool fits_sum(uint32_t a, uint32_t b)
+{
+    return a <= UINT32_MAX - b;
+}
+
+int parse_shots(const char *text, uint8_t *shots)
+{
+    int ret = 0;
+    char *endptr;
+    unsigned long value = strtoul(text, &endptr, 10);
+
+    if (*text == '\0' || *endptr != '\0' || value == 0 ||
+            value > MAX_VOLLEY_SHOTS)
+    {
+        ret = -1;
+    }
+    else
+    {
+        *shots = (uint8_t)value;
+    }
+
+    return ret;
+}
+
+int action_list_add(struct action_list *list, const struct action *action)
+{
+    int ret = 0;
+
+    // Grow geometrically so long scripts don't reallocate on every line
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 16;
+        struct action *actions = realloc(list->actions,
+                capacity * sizeof(*actions));
+
+        if (actions == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            ret = -1;
+        }
+        else
+        {
+            list->actions = actions;
+            list->capacity = capacity;
+        }
+    }
+
+    if (ret == 0)
+    {
+        list->actions[list->count++] = *action;
+    }
+
+    return ret;
+}
+
+int action_list_append(struct action_list *list, enum action_type type,
+        enum movement movement, useconds_t duration)
+{
+    struct action action;
+
+    memset(&action, 0, sizeof(action));
+    action.type = type;
+    action.movement = movement;
+    action.duration = duration;
+
+    return action_list_add(list, &action);
+}
+
+void action_list_plan(struct action_list *list)
+{
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < list->count; i++)
+    {
+        const struct action *action = &list->actions[i];
+        struct action *last = count ? &list->actions[count - 1] : NULL;
+
+        if (last != NULL && last->type == action->type &&
+                (action->type == ACTION_MOVE || action->type == ACTION_WAIT) &&
+                last->movement == action->movement &&
+                fits_sum(last->duration, action->duration))
+        {
+            last->duration += action->duration;
+        }
+        else if (last != NULL && last->type == ACTION_DIAGONAL &&
+                action->type == ACTION_DIAGONAL &&
+                last->movement == action->movement &&
+                last->pan_movement == action->pan_movement &&
+                fits_sum(last->duration, action->duration) &&
+                fits_sum(last->pan_duration, action->pan_duration))
+        {
+            last->duration += action->duration;
+            last->pan_duration += action->pan_duration;
+        }
+        else
+        {
+            list->actions[count++] = *action;
+        }
+    }
+
+    list->count = count;
+}
+
+/**
+ * Engages the run of consecutive targets at the start of a sequence of
+ * actions, reordered to cut the travel between them
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] actions The actions, starting with the first target
+ * @param[in] count The number of actions
+ * @param[out] engaged Gets populated with the number of targets in the run
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int engage_targets(struct launcher *launcher,
+        const struct action *actions, size_t count, size_t *engaged)
+{
+    int ret = 0;
+    struct action *targets;
+    size_t i;
+
+    *engaged = 0;
+
+    while (*engaged < count && actions[*engaged].type == ACTION_TARGET)
+    {
+        (*engaged)++;
+    }
+
+    targets = malloc(*engaged * sizeof(*targets));
+
+    if (targets == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory\n");
+        ret = -1;
+    }
+    else
+    {
+        memcpy(targets, actions, *engaged * sizeof(*targets));
+        schedule_targets(&launcher->position, targets, *engaged);
+    }
+
+    for (i = 0; i < *engaged && ret == 0; i++)
+    {
+        if (goto_position(launcher, targets[i].pan / 10.0,
+                    targets[i].tilt / 10.0) != 0)
+        {
+            fprintf(stderr, "Failed to move turret to target\n");
+            ret = -1;
+        }
+        else if (fire_volley(launcher,
+                    targets[i].shots ? targets[i].shots : 1) != 0)
+        {
+            fprintf(stderr, "Failed to fire missile\n");
+            ret = -1;
+        }
+    }
+
+    free(targets);
+
+    return ret;
+}
+
+int run_actions(struct launcher *launcher, const struct action *actions,
+        size_t count, status_handler handler, void *context)
+{
+    int ret = 0;
+    bool moving = false;
+    size_t i;
+
+    for (i = 0; i < count && ret == 0; i++)
+    {
+        const struct action *action = &actions[i];
+
+        // A move followed straight away by another leaves the turret
+        // running, and the next move's direction takes over from it
+        bool stop = i + 1 == count || !is_move(&actions[i + 1]);
+
+        if (launcher_aborted(launcher))
+        {
+            fprintf(stderr, "Actions aborted\n");
+            ret = -1;
+            continue;
+        }
+
+        switch (action->type)
+        {
+            case ACTION_MOVE:
+            {
+                bool tilt = action->movement == MOVEMENT_TILT_UP ||
+                    action->movement == MOVEMENT_TILT_DOWN;
+
+                if (move_turret_segment(launcher,
+                            tilt ? action->movement : MOVEMENT_NONE,
+                            tilt ? action->duration : 0,
+                            tilt ? MOVEMENT_NONE : action->movement,
+                            tilt ? 0 : action->duration, stop) != 0)
+                {
+                    fprintf(stderr, "Failed to move turret\n");
+                    ret = -1;
+                }
+                else
+                {
+                    moving = !stop;
+                }
+            }
+            break;
+
+            // To fire, we must initiate firing, read status information
+            // until the fire cycling indicator toggles once per shot, delay
+            // briefly to allow the last shot to complete, then stop firing
+            case ACTION_FIRE:
+                if (fire_volley(launcher, action->shots ? action->shots : 1)
+                        != 0)
+                {
+                    fprintf(stderr, "Failed to fire missile\n");
+                    ret = -1;
+                }
+                break;
+
+            case ACTION_STATUS:
+            {
+                uint8_t status;
+
+                if (get_status(launcher, &status) != 0)
+                {
+                    fprintf(stderr, "Failed to retrieve status information\n");
+                    ret = -1;
+                }
+                else if (handler != NULL)
+                {
+                    handler(status, context);
+                }
+            }
+            break;
+
+            case ACTION_WAIT:
+            {
+                uint64_t start = timing_now();
+                uint64_t deadline = start + action->duration;
+                uint64_t now = start;
+
+                // Only a launcher that can be aborted needs to wake up early
+                // to check on it
+                while (now < deadline && !launcher_aborted(launcher))
+                {
+                    uint64_t wake = launcher->abort != NULL ||
+                        launcher->cancel != NULL ||
+                        launcher->abort_ticket != NULL ?
+                        now + launcher->poll_interval : deadline;
+
+                    trace_sleep_until(&launcher->trace,
+                            wake < deadline ? wake : deadline);
+                    now = timing_now();
+                }
+
+                hold_log_record(&launcher->holds, 0, action->duration,
+                        timing_now() - start);
+            }
+            break;
+
+            case ACTION_STOP:
+                if (send_command(launcher, CMD_STOP) != 0)
+                {
+                    fprintf(stderr, "Failed to stop turret\n");
+                    ret = -1;
+                }
+                break;
+
+            case ACTION_DIAGONAL:
+                if (move_turret_segment(launcher, action->movement,
+                            action->duration, action->pan_movement,
+                            action->pan_duration, stop) != 0)
+                {
+                    fprintf(stderr, "Failed to move turret\n");
+                    ret = -1;
+                }
+                else
+                {
+                    moving = !stop;
+                }
+                break;
+
+            case ACTION_HOME:
+                if (home_turret(launcher) != 0)
+                {
+                    fprintf(stderr, "Failed to home turret\n");
+                    ret = -1;
+                }
+                break;
+
+            case ACTION_GOTO:
+                if (goto_position(launcher, action->pan / 10.0,
+                            action->tilt / 10.0) != 0)
+                {
+                    fprintf(stderr, "Failed to move turret to position\n");
+                    ret = -1;
+                }
+                break;
+
+            case ACTION_TARGET:
+            {
+                size_t engaged;
+
+                ret = engage_targets(launcher, action, count - i, &engaged);
+                i += engaged - 1;
+            }
+            break;
+
+            default:
+                fprintf(stderr, "Unrecognized action\n");
+                ret = -1;
+                break;
+        }
+    }
+
+    // Don't leave the turret running if the move that should have taken
+    // over from it failed
+    if (moving && ret != 0)
+    {
+        send_command(launcher, CMD_STOP);
+    }
+
+    return ret;
+}
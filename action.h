@@ -0,0 +1,178 @@
+#ifndef ACTION_H
+#define ACTION_H
+
+#include "launcher.h"
+#include <stddef.h>
+
+//
+// Longest duration accepted for a single move or wait, in milliseconds
+//
+#define MAX_ACTION_DURATION_MS  10000
+
+//
+// Most missiles accepted in a single volley
+//
+#define MAX_VOLLEY_SHOTS        UINT8_MAX
+
+/**
+ * The kinds of step that make up a sequence of actions
+ */
+enum action_type
+{
+    ACTION_MOVE,
+    ACTION_FIRE,
+    ACTION_STATUS,
+    ACTION_WAIT,
+    ACTION_HOME,
+    ACTION_GOTO,
+    ACTION_DIAGONAL,
+    ACTION_TARGET,
+    ACTION_STOP,
+};
+
+/**
+ * A single step in a sequence. Kept small and fixed-width so that sequences
+ * can be stored and sent to the daemon as a flat array.
+ */
+struct action
+{
+    uint8_t type;
+    uint8_t movement;       // For moves, or the tilt of a diagonal move
+    uint8_t pan_movement;   // The pan of a diagonal move
+    uint8_t shots;          // Missiles to fire, for fires and targets; zero
+                            // fires one
+    uint32_t duration;      // Microseconds, for moves, tilts and waits
+    uint32_t pan_duration;  // Microseconds, for the pan of a diagonal move
+    int16_t pan;            // Tenths of a degree, for gotos and targets
+    int16_t tilt;           // Tenths of a degree, for gotos and targets
+};
+
+/**
+ * A growable array of actions
+ */
+struct action_list
+{
+    struct action *actions;
+    size_t count;
+    size_t capacity;
+};
+
+/**
+ * Called with the result of each status read performed by run_actions
+ *
+ * @param[in] status The status byte read from the launcher
+ * @param[in] context The context pointer given to run_actions
+ */
+typedef void (*status_handler)(uint8_t status, void *context);
+
+/**
+ * Prepares an empty action list
+ *
+ * @param[out] list The list to initialize
+ */
+void action_list_init(struct action_list *list);
+
+/**
+ * Releases the storage held by an action list
+ *
+ * @param[in,out] list The list to clean up
+ */
+void action_list_free(struct action_list *list);
+
+/**
+ * Converts a duration in milliseconds, as given on the command line or in a
+ * script, into microseconds
+ *
+ * @param[in] text The duration in milliseconds
+ * @param[out] duration Gets populated with the duration in microseconds
+ *
+ * @return Returns zero on success or non-zero if the duration is invalid
+ */
+int parse_duration(const char *text, useconds_t *duration);
+
+/**
+ * Converts a pair of durations written as "TILT,PAN", in milliseconds, into
+ * microseconds. A single duration applies to both axes.
+ *
+ * @param[in] text The durations in milliseconds
+ * @param[out] tilt_duration Gets populated with the tilt duration
+ * @param[out] pan_duration Gets populated with the pan duration
+ *
+ * @return Returns zero on success or non-zero if either duration is invalid
+ */
+int parse_durations(const char *text, useconds_t *tilt_duration,
+        useconds_t *pan_duration);
+
+/**
+ * Converts a number of missiles to fire in a volley
+ *
+ * @param[in] text The number of missiles, from 1 to MAX_VOLLEY_SHOTS
+ * @param[out] shots Gets populated with the number of missiles
+ *
+ * @return Returns zero on success or non-zero if the number is invalid
+ */
+int parse_shots(const char *text, uint8_t *shots);
+
+/**
+ * Converts a target position written as "PAN,TILT", in degrees, into the
+ * fixed-point form stored in a goto action
+ *
+ * @param[in] text The target position
+ * @param[out] pan Gets populated with the pan angle, in tenths of a degree
+ * @param[out] tilt Gets populated with the tilt angle, in tenths of a degree
+ *
+ * @return Returns zero on success or non-zero if the position is invalid
+ */
+int parse_target(const char *text, int16_t *pan, int16_t *tilt);
+
+/**
+ * Appends a copy of an action to the end of a list
+ *
+ * @param[in,out] list The list to append to
+ * @param[in] action The action to append
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int action_list_add(struct action_list *list, const struct action *action);
+
+/**
+ * Appends an action to the end of a list
+ *
+ * @param[in,out] list The list to append to
+ * @param[in] type The kind of action to append
+ * @param[in] movement The direction to move, for move actions
+ * @param[in] duration The duration in microseconds, for moves and waits
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int action_list_append(struct action_list *list, enum action_type type,
+        enum movement movement, useconds_t duration);
+
+/**
+ * Simplifies a list of actions without changing where they leave the
+ * turret. Consecutive moves in the same direction, diagonal moves in the
+ * same pair of directions, and waits each merge into a single longer hold.
+ *
+ * @param[in,out] list The list to simplify
+ */
+void action_list_plan(struct action_list *list);
+
+/**
+ * Carries out a sequence of actions against the launcher, stopping at the
+ * first one that fails. Moves that follow straight on from one another run
+ * without a CMD_STOP in between. A target moves to its position and fires,
+ * and a run of consecutive targets is engaged in the order chosen by
+ * schedule_targets rather than the order given.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] actions The actions to carry out
+ * @param[in] count The number of actions
+ * @param[in] handler Called with the result of each status read
+ * @param[in] context Passed through to the handler
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int run_actions(struct launcher *launcher, const struct action *actions,
+        size_t count, status_handler handler, void *context);
+
+#endif
@@ -0,0 +1,780 @@
+#include "launcher.h"
+#include "position.h"
+#include "calibration.h"
+#include "fleet.h"
+#include "usb.h"
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <argp.h>
+
+//
+// Default number of times each measurement is taken
+//
+#define DEFAULT_HW_ITERATIONS   100
+#define DEFAULT_HW_FIRES        3
+#define DEFAULT_HW_SWEEPS       2
+#define DEFAULT_HW_STARTUPS     20
+
+//
+// The command-line program whose startup is timed, and the device cache and
+// daemon socket it is pointed at. The socket is never created, so that the
+// program always opens the launcher itself.
+//
+#define DEFAULT_HW_PROGRAM      "./" PROGRAM_NAME
+#define STARTUP_CACHE_PATH      "/tmp/" PROGRAM_NAME "-bench-hw.dev"
+#define STARTUP_SOCKET_PATH     "/tmp/" PROGRAM_NAME "-bench-hw.sock"
+
+//
+// Multiple of the predicted sweep time allowed for reaching the far limit
+//
+#define SWEEP_ALLOWANCE         1.5
+
+//
+// Shortest move issued when aiming one axis at a time, in microseconds
+//
+#define MIN_AIM_US              1000
+
+/**
+ * Version information string
+ */
+const char *argp_program_version = PROGRAM_NAME "-bench-hw " PROGRAM_VERSION;
+
+/**
+ * Bug report email address string
+ */
+const char *argp_program_bug_address = "<" BUG_EMAIL_ADDRESS ">";
+
+/**
+ * Documentation string displayed in help output
+ */
+static char doc[] =
+    "Runs a fixed suite of measurements against a real launcher: the status "
+    "round trip, the fire cycle, the time to sweep between the limit "
+    "switches against the time predicted from the turret's rates, and "
+    "aiming at a set of targets with diagonal moves against one axis at a "
+    "time. It also times how long the command-line program takes from "
+    "starting to printing the status, both with the device path it last "
+    "found the launcher at and with it forgotten. The turret moves across "
+    "its whole range and fires, so clear the area first. The results are "
+    "printed as a single line of JSON, naming the launcher and the USB stack "
+    "it was reached through, so that runs can be compared across units and "
+    "across HIDAPI_PROVIDER builds. ";
+
+/**
+ * Command-line options supported by the benchmark
+ */
+static struct argp_option options[] =
+{
+    { "device",     'd', "PATH",    0,  "Use the launcher with the given device path" },
+    { "serial",     'n', "SERIAL",  0,  "Use the launcher with the given serial number" },
+    { "iterations", 'i', "COUNT",   0,  "The number of status round trips to time (default 100)" },
+    { "fires",      'F', "COUNT",   0,  "The number of missiles to fire (default 3)" },
+    { "sweeps",     'w', "COUNT",   0,  "The number of sweeps between the limit switches to time in each direction (default 2)" },
+    { "calibration", 'c', "FILE",   0,  "Where the rates measured for each launcher are kept (default " DEFAULT_CALIBRATION_PATH ")" },
+    { "program",    'e', "FILE",    0,  "The command-line program whose startup is timed, such as a static build (default " DEFAULT_HW_PROGRAM ")" },
+    { "startups",   's', "COUNT",   0,  "The number of startups to time with the device path cached and without (default 20)" },
+    { 0 }
+};
+
+/**
+ * Benchmark settings gathered from the command line
+ */
+struct arguments
+{
+    const char *device_path;
+    const char *serial;
+    size_t iterations;
+    size_t fires;
+    size_t sweeps;
+    const char *calibration_path;
+    const char *program;
+    size_t startups;
+};
+
+/**
+ * Startups of the command-line program, each timed from starting it to the
+ * first byte of its status report (in microseconds)
+ */
+struct startups
+{
+    uint64_t *cold;                 // With the device path forgotten
+    uint64_t *warm;                 // With the device path cached
+};
+
+/**
+ * Targets aimed at, in order, by both the diagonal and the sequential tour,
+ * in degrees from the left and down limits
+ */
+static const double aim_targets[][2] =
+{
+    { 90.0, 10.0 },
+    { 180.0, 25.0 },
+    { 45.0, 5.0 },
+    { 225.0, 20.0 },
+    { 135.0, 15.0 },
+};
+
+#define AIM_TARGET_COUNT (sizeof(aim_targets) / sizeof(aim_targets[0]))
+
+/**
+ * One of the directions swept between the limit switches
+ */
+struct sweep
+{
+    const char *name;
+    enum movement movement;
+};
+
+/**
+ * The sweeps timed in each round, which leave the turret where it started
+ */
+static const struct sweep sweeps[] =
+{
+    { "right",  MOVEMENT_PAN_RIGHT },
+    { "left",   MOVEMENT_PAN_LEFT },
+    { "up",     MOVEMENT_TILT_UP },
+    { "down",   MOVEMENT_TILT_DOWN },
+};
+
+#define SWEEP_COUNT (sizeof(sweeps) / sizeof(sweeps[0]))
+
+/**
+ * Parses a count given on the command line
+ *
+ * @param[in] text The text to parse
+ * @param[out] count Gets populated with the count
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int parse_count(const char *text, size_t *count)
+{
+    int ret = 0;
+    char *endptr;
+    unsigned long value = strtoul(text, &endptr, 0);
+
+    if (*text == '\0' || *endptr != '\0' || value == 0)
+    {
+        ret = -1;
+    }
+    else
+    {
+        *count = value;
+    }
+
+    return ret;
+}
+
+/**
+ * Command line parser function. Interprets command line options and populates
+ * custom state information as appropriate.
+ *
+ * @param[in] key An identifier corresponding to the option being parsed
+ * @param[in] arg The argument (if any) provided with the option
+ * @param[in,out] state Custom state passed between parser and application
+ *
+ * @return Returns 0 on success or an appropriate error code on failure
+ */
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    error_t ret = 0;
+
+    struct arguments *arguments = state->input;
+
+    switch (key)
+    {
+        case 'd':
+            arguments->device_path = arg;
+            break;
+        case 'n':
+            arguments->serial = arg;
+            break;
+        case 'i':
+            if (parse_count(arg, &arguments->iterations) != 0)
+            {
+                fprintf(stderr, "Invalid iteration count specified\n");
+                argp_usage(state);
+            }
+            break;
+        case 'F':
+            if (parse_count(arg, &arguments->fires) != 0)
+            {
+                fprintf(stderr, "Invalid fire count specified\n");
+                argp_usage(state);
+            }
+            break;
+        case 'w':
+            if (parse_count(arg, &arguments->sweeps) != 0)
+            {
+                fprintf(stderr, "Invalid sweep count specified\n");
+                argp_usage(state);
+            }
+            break;
+        case 'c':
+            arguments->calibration_path = arg;
+            break;
+        case 'e':
+            arguments->program = arg;
+            break;
+        case 's':
+            if (parse_count(arg, &arguments->startups) != 0)
+            {
+                fprintf(stderr, "Invalid startup count specified\n");
+                argp_usage(state);
+            }
+            break;
+        case ARGP_KEY_ARG:
+            if (state->arg_num >= 0)
+            {
+                argp_usage(state);
+            }
+            break;
+        default:
+            ret = ARGP_ERR_UNKNOWN;
+            break;
+    }
+
+    return ret;
+}
+
+/**
+ * Defines parser settings for command-line argument processing
+ */
+static struct argp argp = { options, parse_opt, NULL, doc };
+
+/**
+ * Comparison function for sorting latencies
+ */
+static int compare_latency(const void *a, const void *b)
+{
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+
+    return left < right ? -1 : (left > right ? 1 : 0);
+}
+
+/**
+ * Prints a JSON member summarizing a set of timings, sorting them in place
+ *
+ * @param[in] name The name of the member
+ * @param[in,out] samples The timings (in microseconds)
+ * @param[in] count The number of timings, which must not be zero
+ */
+static void print_summary(const char *name, uint64_t *samples, size_t count)
+{
+    uint64_t total = 0;
+    size_t i;
+
+    qsort(samples, count, sizeof(*samples), compare_latency);
+
+    for (i = 0; i < count; i++)
+    {
+        total += samples[i];
+    }
+
+    printf("\"%s\":{\"count\":%zu,\"min_us\":%llu,\"mean_us\":%llu,"
+            "\"p50_us\":%llu,\"p99_us\":%llu,\"max_us\":%llu}", name, count,
+            (unsigned long long)samples[0],
+            (unsigned long long)(total / count),
+            (unsigned long long)samples[count / 2],
+            (unsigned long long)samples[(count * 99) / 100],
+            (unsigned long long)samples[count - 1]);
+}
+
+/**
+ * Times status round trips, from sending the request to reading the report
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[out] samples Gets populated with the timings (in microseconds)
+ * @param[in] count The number of round trips to time
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int time_status(struct launcher *launcher, uint64_t *samples,
+        size_t count)
+{
+    int ret = 0;
+    size_t i;
+
+    for (i = 0; i < count && ret == 0; i++)
+    {
+        uint64_t start = timing_now();
+        uint8_t status;
+
+        if (get_status(launcher, &status) != 0)
+        {
+            fprintf(stderr, "Failed to read status\n");
+            ret = -1;
+        }
+
+        samples[i] = timing_now() - start;
+    }
+
+    return ret;
+}
+
+/**
+ * Times single shots, from the fire command to the fired bit
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[out] samples Gets populated with the timings (in microseconds)
+ * @param[in] count The number of missiles to fire
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int time_fire(struct launcher *launcher, uint64_t *samples,
+        size_t count)
+{
+    int ret = 0;
+    size_t i;
+
+    for (i = 0; i < count && ret == 0; i++)
+    {
+        if (fire_missile(launcher) != 0)
+        {
+            fprintf(stderr, "Failed to fire missile %zu\n", i + 1);
+            ret = -1;
+        }
+        else
+        {
+            samples[i] = launcher->fire_seen - launcher->fire_sent;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Times sweeps from one limit switch to the other in each direction. The
+ * turret must start at its left and down limits, and is left there.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[out] samples Gets populated with the timings (in microseconds), a
+ *             row of SWEEP_COUNT for each round
+ * @param[out] predicted Gets populated with the time predicted for each
+ *             direction (in microseconds)
+ * @param[in] rounds The number of times to sweep in each direction
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int time_sweeps(struct launcher *launcher, uint64_t *samples,
+        uint64_t predicted[SWEEP_COUNT], size_t rounds)
+{
+    int ret = 0;
+    size_t round;
+    size_t i;
+
+    for (round = 0; round < rounds && ret == 0; round++)
+    {
+        for (i = 0; i < SWEEP_COUNT && ret == 0; i++)
+        {
+            useconds_t expected = limit_time(&launcher->position,
+                    sweeps[i].movement);
+            useconds_t allowed = (useconds_t)(expected * SWEEP_ALLOWANCE);
+            useconds_t moved;
+
+            predicted[i] = expected;
+
+            if (move_turret_exact(launcher, sweeps[i].movement, allowed,
+                        &moved) != 0)
+            {
+                fprintf(stderr, "Failed to sweep %s\n", sweeps[i].name);
+                ret = -1;
+            }
+            else if (moved >= allowed)
+            {
+                fprintf(stderr, "Turret never reached its %s limit\n",
+                        sweeps[i].name);
+                ret = -1;
+            }
+            else
+            {
+                samples[round * SWEEP_COUNT + i] = moved;
+            }
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Aims at a position one axis at a time, panning and then tilting
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] pan The target angle, in degrees right of the left limit
+ * @param[in] tilt The target angle, in degrees above the down limit
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int aim_sequential(struct launcher *launcher, double pan, double tilt)
+{
+    int ret = 0;
+    const struct position *position = &launcher->position;
+    useconds_t duration = travel_time(position, position->pan,
+            position->tilt, pan, position->tilt);
+
+    if (duration >= MIN_AIM_US)
+    {
+        ret = move_turret(launcher, pan < position->pan ?
+                MOVEMENT_PAN_LEFT : MOVEMENT_PAN_RIGHT, duration, NULL);
+    }
+
+    duration = travel_time(position, position->pan, position->tilt,
+            position->pan, tilt);
+
+    if (ret == 0 && duration >= MIN_AIM_US)
+    {
+        ret = move_turret(launcher, tilt < position->tilt ?
+                MOVEMENT_TILT_DOWN : MOVEMENT_TILT_UP, duration, NULL);
+    }
+
+    return ret;
+}
+
+/**
+ * Times a tour of the aim targets, from the left and down limits, aiming
+ * either diagonally or one axis at a time. The turret is returned to the
+ * limits afterwards, untimed.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] diagonal Whether to move both axes at once
+ * @param[out] elapsed Gets populated with the time the tour took (in
+ *             microseconds)
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int time_aim(struct launcher *launcher, bool diagonal,
+        uint64_t *elapsed)
+{
+    int ret = 0;
+    uint64_t start = timing_now();
+    size_t i;
+
+    for (i = 0; i < AIM_TARGET_COUNT && ret == 0; i++)
+    {
+        ret = diagonal ?
+            goto_position(launcher, aim_targets[i][0], aim_targets[i][1]) :
+            aim_sequential(launcher, aim_targets[i][0], aim_targets[i][1]);
+    }
+
+    *elapsed = timing_now() - start;
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "Failed to aim %s\n",
+                diagonal ? "diagonally" : "one axis at a time");
+    }
+    else if (goto_position(launcher, 0.0, 0.0) != 0)
+    {
+        fprintf(stderr, "Failed to return to the limits\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/**
+ * Times a single run of the command-line program reading the status, from
+ * starting it to the first byte of its report
+ *
+ * @param[in] arguments The benchmark settings, naming the program and the
+ *            launcher
+ * @param[out] elapsed Gets populated with the time taken (in microseconds)
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int time_startup(const struct arguments *arguments, uint64_t *elapsed)
+{
+    int ret = 0;
+    char *argv[] =
+    {
+        (char *)arguments->program, "--status",
+        "--device-cache", STARTUP_CACHE_PATH,
+        "--socket", STARTUP_SOCKET_PATH,
+        NULL, NULL, NULL,
+    };
+    posix_spawn_file_actions_t actions;
+    int fds[2] = { -1, -1 };
+    uint64_t start = 0;
+    pid_t pid = -1;
+    char byte;
+    int status;
+
+    if (arguments->device_path != NULL)
+    {
+        argv[6] = "--device";
+        argv[7] = (char *)arguments->device_path;
+    }
+    else if (arguments->serial != NULL)
+    {
+        argv[6] = "--serial";
+        argv[7] = (char *)arguments->serial;
+    }
+
+    if (pipe2(fds, O_CLOEXEC) != 0 ||
+            posix_spawn_file_actions_init(&actions) != 0)
+    {
+        fprintf(stderr, "Failed to set up %s\n", arguments->program);
+        ret = -1;
+    }
+    else
+    {
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        start = timing_now();
+
+        if (posix_spawn(&pid, arguments->program, &actions, NULL, argv,
+                    environ) != 0)
+        {
+            fprintf(stderr, "Failed to start %s\n", arguments->program);
+            ret = -1;
+        }
+
+        posix_spawn_file_actions_destroy(&actions);
+    }
+
+    // Only the program's copy of the write end is left, so the read ends
+    // when it exits even if it never printed anything
+    if (fds[1] >= 0)
+    {
+        close(fds[1]);
+    }
+
+    if (ret == 0 && read(fds[0], &byte, 1) != 1)
+    {
+        fprintf(stderr, "%s printed no status\n", arguments->program);
+        ret = -1;
+    }
+
+    *elapsed = timing_now() - start;
+
+    if (pid > 0 && (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+                WEXITSTATUS(status) != 0))
+    {
+        fprintf(stderr, "%s failed\n", arguments->program);
+        ret = -1;
+    }
+
+    if (fds[0] >= 0)
+    {
+        close(fds[0]);
+    }
+
+    return ret;
+}
+
+/**
+ * Times startups of the command-line program, alternating between starting
+ * with the launcher's device path forgotten, so that it enumerates the
+ * attached launchers, and starting with it cached by the run before
+ *
+ * @param[in] arguments The benchmark settings
+ * @param[out] startups Gets populated with the timings
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int time_startups(const struct arguments *arguments,
+        struct startups *startups)
+{
+    int ret = 0;
+    size_t i;
+
+    for (i = 0; i < arguments->startups && ret == 0; i++)
+    {
+        unlink(STARTUP_CACHE_PATH);
+        ret = time_startup(arguments, &startups->cold[i]);
+
+        if (ret == 0)
+        {
+            ret = time_startup(arguments, &startups->warm[i]);
+        }
+    }
+
+    unlink(STARTUP_CACHE_PATH);
+
+    return ret;
+}
+
+/**
+ * Runs the whole suite and prints the results
+ *
+ * @param[in] launcher The launcher to operate, with its rates applied
+ * @param[in] key The launcher's serial number, or path without one
+ * @param[in] arguments The benchmark settings
+ * @param[in,out] startups The startups already timed, which are sorted
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int run_suite(struct launcher *launcher, const char *key,
+        const struct arguments *arguments, struct startups *startups)
+{
+    int ret = 0;
+    uint64_t *status = calloc(arguments->iterations, sizeof(*status));
+    uint64_t *fire = calloc(arguments->fires, sizeof(*fire));
+    uint64_t *sweep = calloc(arguments->sweeps * SWEEP_COUNT,
+            sizeof(*sweep));
+    uint64_t *column = calloc(arguments->sweeps, sizeof(*column));
+    uint64_t predicted[SWEEP_COUNT];
+    uint64_t diagonal = 0;
+    uint64_t sequential = 0;
+    size_t i;
+
+    if (status == NULL || fire == NULL || sweep == NULL || column == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        ret = -1;
+    }
+
+    // Everything after the round trips needs a known position
+    if (ret == 0 && (time_status(launcher, status,
+                    arguments->iterations) != 0 ||
+                home_turret(launcher) != 0 ||
+                time_sweeps(launcher, sweep, predicted,
+                    arguments->sweeps) != 0 ||
+                time_aim(launcher, true, &diagonal) != 0 ||
+                time_aim(launcher, false, &sequential) != 0 ||
+                time_fire(launcher, fire, arguments->fires) != 0))
+    {
+        ret = -1;
+    }
+
+    if (ret == 0)
+    {
+        printf("{\"unit\":");
+        json_print_string(stdout, key);
+        printf(",\"provider\":\"" HIDAPI_PROVIDER "\",\"transport\":");
+        json_print_string(stdout, launcher->transport->name);
+        printf(",");
+        print_summary("status", status, arguments->iterations);
+        printf(",");
+        print_summary("fire", fire, arguments->fires);
+        printf(",\"sweeps\":{");
+
+        for (i = 0; i < SWEEP_COUNT; i++)
+        {
+            int64_t error = 0;
+            size_t round;
+
+            for (round = 0; round < arguments->sweeps; round++)
+            {
+                column[round] = sweep[round * SWEEP_COUNT + i];
+                error += (int64_t)column[round] - (int64_t)predicted[i];
+            }
+
+            printf("%s\"%s\":{\"predicted_us\":%llu,\"mean_error_us\":%lld,",
+                    i ? "," : "", sweeps[i].name,
+                    (unsigned long long)predicted[i],
+                    (long long)(error / (int64_t)arguments->sweeps));
+            print_summary("measured", column, arguments->sweeps);
+            printf("}");
+        }
+
+        printf("},\"aim\":{\"targets\":%zu,\"diagonal_us\":%llu,"
+                "\"sequential_us\":%llu,\"speedup\":%.3f},",
+                AIM_TARGET_COUNT, (unsigned long long)diagonal,
+                (unsigned long long)sequential,
+                diagonal ? (double)sequential / diagonal : 0.0);
+        printf("\"startup\":{\"program\":");
+        json_print_string(stdout, arguments->program);
+        printf(",");
+        print_summary("cold", startups->cold, arguments->startups);
+        printf(",");
+        print_summary("warm", startups->warm, arguments->startups);
+        printf("}}\n");
+    }
+
+    free(status);
+    free(fire);
+    free(sweep);
+    free(column);
+
+    return ret;
+}
+
+/**
+ * Benchmark entry point
+ *
+ * @param[in] argc The number of command-line arguments
+ * @param[in] argv Array of command-line argument strings
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int main(int argc, char **argv)
+{
+    int ret = EXIT_SUCCESS;
+    struct arguments arguments;
+    struct calibration_table calibrations = { NULL, false };
+    struct launcher launcher;
+    struct startups startups;
+    char *key = NULL;
+    void *device = NULL;
+
+    arguments.device_path = NULL;
+    arguments.serial = NULL;
+    arguments.iterations = DEFAULT_HW_ITERATIONS;
+    arguments.fires = DEFAULT_HW_FIRES;
+    arguments.sweeps = DEFAULT_HW_SWEEPS;
+    arguments.calibration_path = DEFAULT_CALIBRATION_PATH;
+    arguments.program = DEFAULT_HW_PROGRAM;
+    arguments.startups = DEFAULT_HW_STARTUPS;
+
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    startups.cold = calloc(arguments.startups, sizeof(*startups.cold));
+    startups.warm = calloc(arguments.startups, sizeof(*startups.warm));
+
+    // The program has to open the launcher itself, so time it before the
+    // benchmark has it open
+    if (startups.cold == NULL || startups.warm == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        ret = EXIT_FAILURE;
+    }
+    else if (time_startups(&arguments, &startups) != 0)
+    {
+        fprintf(stderr, "Failed to time startup\n");
+        ret = EXIT_FAILURE;
+    }
+    else
+    {
+        device = fleet_open(arguments.device_path, arguments.serial, &key);
+    }
+
+    if (ret == EXIT_SUCCESS && device == NULL)
+    {
+        fprintf(stderr, "Failed to open requested device\n");
+        ret = EXIT_FAILURE;
+    }
+    else if (ret == EXIT_SUCCESS)
+    {
+        launcher_init(&launcher, &usb_transport, device);
+
+        // Predictions are only as good as the rates, so use measured ones
+        // where there are any
+        if (calibration_open(&calibrations, arguments.calibration_path,
+                    false) != 0 ||
+                !calibration_apply(&calibrations, key, &launcher.position))
+        {
+            fprintf(stderr, "No calibration for %s, predicting sweeps from "
+                    "the default rates\n", key);
+        }
+
+        if (run_suite(&launcher, key, &arguments, &startups) != 0)
+        {
+            fprintf(stderr, "Hardware benchmark failed\n");
+            ret = EXIT_FAILURE;
+        }
+
+        calibration_close(&calibrations);
+        launcher_close(&launcher);
+    }
+
+    free(startups.cold);
+    free(startups.warm);
+    free(key);
+
+    return ret;
+}
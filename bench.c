@@ -0,0 +1,653 @@
+#include "launcher.h"
+#include "action.h"
+#include "mock.h"
+#include "sim.h"
+#include "position.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <argp.h>
+
+//
+// Default number of times each operation is timed
+//
+#define DEFAULT_ITERATIONS  200
+#define DEFAULT_FIRES       3
+
+//
+// Default number of engagements run against the physical simulator, the
+// targets in each, and the missiles fired by each volley
+//
+#define DEFAULT_ENGAGEMENTS 500
+#define DEFAULT_TARGETS     8
+#define MAX_SIM_TARGETS     64
+#define SIM_VOLLEY_SHOTS    3
+
+//
+// Length of each of the short moves given to the planner, in microseconds
+//
+#define SIM_STEP_US         50000
+
+/**
+ * Version information string
+ */
+const char *argp_program_version = PROGRAM_NAME "-bench " PROGRAM_VERSION;
+
+/**
+ * Bug report email address string
+ */
+const char *argp_program_bug_address = "<" BUG_EMAIL_ADDRESS ">";
+
+/**
+ * Documentation string displayed in help output
+ */
+static char doc[] =
+    "Measures the throughput and latency of launcher operations against a "
+    "simulated launcher, so that no hardware is needed. Then runs whole "
+    "engagements against a physical model of the turret on a virtual clock, "
+    "to compare the target scheduler, the planner and volleys with the "
+    "naive alternatives far faster than real time. ";
+
+/**
+ * Command-line options supported by the benchmark
+ */
+static struct argp_option options[] =
+{
+    { "iterations", 'n', "COUNT",   0,  "The number of status reads and moves to time (default 200)" },
+    { "fires",      'F', "COUNT",   0,  "The number of missiles to fire (default 3)" },
+    { "time",       't', "TIME",    0,  "The duration of each move, in milliseconds (default 10)" },
+    { "latency",    'L', "TIME",    0,  "The simulated latency of each USB transfer, in microseconds" },
+    { "fire-cycle", 'c', "TIME",    0,  "The simulated time to fire one missile, in milliseconds" },
+    { "engagements", 'e', "COUNT",  0,  "The number of engagements to simulate for each scenario (default 500)" },
+    { "targets",    'k', "COUNT",   0,  "The number of targets in each simulated engagement (default 8)" },
+    { 0 }
+};
+
+/**
+ * Benchmark settings gathered from the command line
+ */
+struct arguments
+{
+    size_t iterations;
+    size_t fires;
+    useconds_t move_duration;
+    struct mock_config mock;
+    size_t engagements;
+    size_t targets;
+    struct sim_config sim;
+};
+
+/**
+ * A timed operation
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] iteration The number of times the operation has already run
+ * @param[in] arguments The benchmark settings
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+typedef int (*bench_op)(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments);
+
+/**
+ * Parses a count given on the command line
+ *
+ * @param[in] text The text to parse
+ * @param[out] count Gets populated with the count
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int parse_count(const char *text, size_t *count)
+{
+    int ret = 0;
+    char *endptr;
+    unsigned long value = strtoul(text, &endptr, 0);
+
+    if (*text == '\0' || *endptr != '\0' || value == 0)
+    {
+        ret = -1;
+    }
+    else
+    {
+        *count = value;
+    }
+
+    return ret;
+}
+
+/**
+ * Command line parser function. Interprets command line options and populates
+ * custom state information as appropriate.
+ *
+ * @param[in] key An identifier corresponding to the option being parsed
+ * @param[in] arg The argument (if any) provided with the option
+ * @param[in,out] state Custom state passed between parser and application
+ *
+ * @return Returns 0 on success or an appropriate error code on failure
+ */
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    error_t ret = 0;
+
+    struct arguments *arguments = state->input;
+
+    switch (key)
+    {
+        case 'n':
+            if (parse_count(arg, &arguments->iterations) != 0)
+            {
+                fprintf(stderr, "Invalid iteration count specified\n");
+                argp_usage(state);
+            }
+            break;
+        case 'F':
+            if (parse_count(arg, &arguments->fires) != 0)
+            {
+                fprintf(stderr, "Invalid fire count specified\n");
+                argp_usage(state);
+            }
+            break;
+        case 't':
+            if (parse_duration(arg, &arguments->move_duration) != 0)
+            {
+                fprintf(stderr, "Invalid duration specified\n");
+                argp_usage(state);
+            }
+            break;
+        case 'L':
+        {
+            unsigned long latency;
+            char *endptr;
+
+            latency = strtoul(arg, &endptr, 0);
+
+            if (*arg != '\0' && *endptr == '\0' && latency < MOVE_HOLD_TIME_US)
+            {
+                arguments->mock.latency = latency;
+                arguments->sim.latency = latency;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid latency specified\n");
+                argp_usage(state);
+            }
+        }
+        break;
+        case 'c':
+            if (parse_duration(arg, &arguments->mock.fire_cycle) != 0 ||
+                    arguments->mock.fire_cycle <=
+                    arguments->mock.fire_switch + FIRE_HOLD_TIME_US)
+            {
+                fprintf(stderr, "Invalid fire cycle specified\n");
+                argp_usage(state);
+            }
+
+            arguments->sim.fire_cycle = arguments->mock.fire_cycle;
+            break;
+        case 'e':
+            if (parse_count(arg, &arguments->engagements) != 0)
+            {
+                fprintf(stderr, "Invalid engagement count specified\n");
+                argp_usage(state);
+            }
+            break;
+        case 'k':
+            if (parse_count(arg, &arguments->targets) != 0 ||
+                    arguments->targets > MAX_SIM_TARGETS)
+            {
+                fprintf(stderr, "Invalid target count specified\n");
+                argp_usage(state);
+            }
+            break;
+        case ARGP_KEY_ARG:
+            if (state->arg_num >= 0)
+            {
+                argp_usage(state);
+            }
+            break;
+        default:
+            ret = ARGP_ERR_UNKNOWN;
+            break;
+    }
+
+    return ret;
+}
+
+/**
+ * Defines parser settings for command-line argument processing
+ */
+static struct argp argp = { options, parse_opt, NULL, doc };
+
+/**
+ * Reads the status byte once
+ */
+static int bench_status(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments)
+{
+    uint8_t status;
+
+    return get_status(launcher, &status);
+}
+
+/**
+ * Moves the turret, alternating direction so it never reaches a limit
+ */
+static int bench_move(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments)
+{
+    return move_turret(launcher, iteration % 2 ? MOVEMENT_PAN_LEFT :
+            MOVEMENT_PAN_RIGHT, arguments->move_duration, NULL);
+}
+
+/**
+ * Fires one missile
+ */
+static int bench_fire(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments)
+{
+    return fire_missile(launcher);
+}
+
+/**
+ * Comparison function for sorting latencies
+ */
+static int compare_latency(const void *a, const void *b)
+{
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+
+    return left < right ? -1 : (left > right ? 1 : 0);
+}
+
+/**
+ * Times an operation repeatedly and prints its throughput and latency
+ * percentiles
+ *
+ * @param[in] name The name to report the operation under
+ * @param[in] op The operation to time
+ * @param[in] count The number of times to run it
+ * @param[in] launcher The launcher to operate
+ * @param[in] arguments The benchmark settings
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int run_bench(const char *name, bench_op op, size_t count,
+        struct launcher *launcher, const struct arguments *arguments)
+{
+    int ret = 0;
+    uint64_t *latencies = calloc(count, sizeof(*latencies));
+    uint64_t total = 0;
+    size_t i;
+
+    if (latencies == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        ret = -1;
+    }
+
+    for (i = 0; i < count && ret == 0; i++)
+    {
+        uint64_t start = timing_now();
+
+        if (op(launcher, i, arguments) != 0)
+        {
+            fprintf(stderr, "Benchmark of %s failed\n", name);
+            ret = -1;
+        }
+
+        latencies[i] = timing_now() - start;
+        total += latencies[i];
+    }
+
+    if (ret == 0)
+    {
+        qsort(latencies, count, sizeof(*latencies), compare_latency);
+
+        printf("%-8s %8zu %12.1f %10llu %10llu\n", name, count,
+                total ? count * 1000000.0 / total : 0.0,
+                (unsigned long long)latencies[count / 2],
+                (unsigned long long)latencies[(count * 99) / 100]);
+    }
+
+    free(latencies);
+
+    return ret;
+}
+
+/**
+ * Reads the monotonic clock, even while the virtual clock is in use
+ *
+ * @return Returns the current monotonic time, in microseconds
+ */
+static uint64_t wall_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Picks the targets for an engagement. Each engagement gets its own fixed
+ * set, so that every scenario faces the same ones.
+ *
+ * @param[in] engagement The number of the engagement
+ * @param[in] arguments The benchmark settings
+ * @param[out] targets Gets populated with the targets
+ */
+static void pick_targets(size_t engagement, const struct arguments *arguments,
+        struct action *targets)
+{
+    unsigned int seed = engagement + 1;
+    size_t i;
+
+    for (i = 0; i < arguments->targets; i++)
+    {
+        memset(&targets[i], 0, sizeof(targets[i]));
+        targets[i].type = ACTION_TARGET;
+        targets[i].shots = 1;
+        targets[i].pan = rand_r(&seed) % (int)(DEFAULT_PAN_RANGE * 10);
+        targets[i].tilt = rand_r(&seed) % (int)(DEFAULT_TILT_RANGE * 10);
+    }
+}
+
+/**
+ * Engages a batch of targets in whichever order the scheduler picks
+ */
+static int sim_scheduled(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments)
+{
+    struct action targets[MAX_SIM_TARGETS];
+
+    pick_targets(iteration, arguments, targets);
+
+    return run_actions(launcher, targets, arguments->targets, NULL, NULL);
+}
+
+/**
+ * Engages a batch of targets in the order they were given
+ */
+static int sim_in_order(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments)
+{
+    int ret = 0;
+    struct action targets[MAX_SIM_TARGETS];
+    size_t i;
+
+    pick_targets(iteration, arguments, targets);
+
+    for (i = 0; i < arguments->targets && ret == 0; i++)
+    {
+        if (goto_position(launcher, targets[i].pan / 10.0,
+                    targets[i].tilt / 10.0) != 0 ||
+                fire_missile(launcher) != 0)
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Builds a sweep out and back as a run of short moves, one per target
+ *
+ * @param[out] list Gets populated with the moves
+ * @param[in] arguments The benchmark settings
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int build_sweep(struct action_list *list,
+        const struct arguments *arguments)
+{
+    int ret = 0;
+    size_t i;
+
+    action_list_init(list);
+
+    for (i = 0; i < arguments->targets * 2 && ret == 0; i++)
+    {
+        ret = action_list_append(list, ACTION_MOVE, i < arguments->targets ?
+                MOVEMENT_PAN_RIGHT : MOVEMENT_PAN_LEFT, SIM_STEP_US);
+    }
+
+    return ret;
+}
+
+/**
+ * Sweeps out and back after the planner has merged the short moves
+ */
+static int sim_planned(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments)
+{
+    int ret;
+    struct action_list list;
+
+    ret = build_sweep(&list, arguments);
+
+    if (ret == 0)
+    {
+        action_list_plan(&list);
+        ret = run_actions(launcher, list.actions, list.count, NULL, NULL);
+    }
+
+    action_list_free(&list);
+
+    return ret;
+}
+
+/**
+ * Sweeps out and back as the short moves were given
+ */
+static int sim_unplanned(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments)
+{
+    int ret;
+    struct action_list list;
+
+    ret = build_sweep(&list, arguments);
+
+    if (ret == 0)
+    {
+        ret = run_actions(launcher, list.actions, list.count, NULL, NULL);
+    }
+
+    action_list_free(&list);
+
+    return ret;
+}
+
+/**
+ * Fires several missiles as a single volley
+ */
+static int sim_volley(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments)
+{
+    return fire_volley(launcher, SIM_VOLLEY_SHOTS);
+}
+
+/**
+ * Fires several missiles one at a time
+ */
+static int sim_singles(struct launcher *launcher, size_t iteration,
+        const struct arguments *arguments)
+{
+    int ret = 0;
+    unsigned int i;
+
+    for (i = 0; i < SIM_VOLLEY_SHOTS && ret == 0; i++)
+    {
+        ret = fire_missile(launcher);
+    }
+
+    return ret;
+}
+
+/**
+ * Runs a scenario repeatedly against the physical simulator on the virtual
+ * clock, homing before each run, and prints the simulated and real time it
+ * took along with how far the position estimate drifted from the turret
+ *
+ * @param[in] name The name to report the scenario under
+ * @param[in] op The scenario
+ * @param[in] count The number of times to run it
+ * @param[in] arguments The benchmark settings
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int run_sim(const char *name, bench_op op, size_t count,
+        const struct arguments *arguments)
+{
+    int ret = 0;
+    struct launcher launcher;
+    void *handle;
+    uint64_t simulated = 0;
+    uint64_t wall = 0;
+    double max_error = 0.0;
+    size_t i;
+
+    timing_use_virtual_clock(true);
+    handle = sim_open(&arguments->sim);
+
+    if (handle == NULL)
+    {
+        fprintf(stderr, "Failed to create simulated turret\n");
+        ret = -1;
+    }
+    else
+    {
+        launcher_init(&launcher, &sim_transport, handle);
+    }
+
+    for (i = 0; i < count && ret == 0; i++)
+    {
+        uint64_t start;
+        uint64_t wall_start;
+        struct sim_state state;
+
+        // Every run starts from the limits, and homing isn't timed
+        start = home_turret(&launcher) == 0 ? timing_now() : 0;
+        wall_start = wall_now();
+
+        if (start == 0 || op(&launcher, i, arguments) != 0)
+        {
+            ret = -1;
+        }
+
+        simulated += timing_now() - start;
+        wall += wall_now() - wall_start;
+        sim_get_state(handle, &state);
+
+        if (launcher.position.pan_known &&
+                fabs(state.pan - launcher.position.pan) > max_error)
+        {
+            max_error = fabs(state.pan - launcher.position.pan);
+        }
+
+        if (launcher.position.tilt_known &&
+                fabs(state.tilt - launcher.position.tilt) > max_error)
+        {
+            max_error = fabs(state.tilt - launcher.position.tilt);
+        }
+    }
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "Simulation of %s failed\n", name);
+    }
+    else
+    {
+        printf("%-10s %8zu %12.1f %12.1f %10.0f %10.2f\n", name, count,
+                simulated / 1000.0 / count, (double)wall / count,
+                wall ? (double)simulated / wall : 0.0, max_error);
+    }
+
+    if (handle != NULL)
+    {
+        launcher_close(&launcher);
+    }
+
+    timing_use_virtual_clock(false);
+
+    return ret;
+}
+
+/**
+ * Benchmark entry point
+ *
+ * @param[in] argc The number of command-line arguments
+ * @param[in] argv Array of command-line argument strings
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int main(int argc, char **argv)
+{
+    int ret = EXIT_SUCCESS;
+    struct arguments arguments;
+    struct launcher launcher;
+    void *handle;
+
+    arguments.iterations = DEFAULT_ITERATIONS;
+    arguments.fires = DEFAULT_FIRES;
+    arguments.move_duration = MOVE_HOLD_TIME_US / 10;
+    mock_config_init(&arguments.mock);
+    arguments.engagements = DEFAULT_ENGAGEMENTS;
+    arguments.targets = DEFAULT_TARGETS;
+    sim_config_init(&arguments.sim);
+
+    argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+    handle = mock_open(&arguments.mock);
+
+    if (handle == NULL)
+    {
+        fprintf(stderr, "Failed to create simulated launcher\n");
+        ret = EXIT_FAILURE;
+    }
+    else
+    {
+        launcher_init(&launcher, &mock_transport, handle);
+
+        printf("%-8s %8s %12s %10s %10s\n", "op", "count", "ops_per_sec",
+                "p50_us", "p99_us");
+
+        if (run_bench("status", bench_status, arguments.iterations,
+                    &launcher, &arguments) != 0 ||
+                run_bench("move", bench_move, arguments.iterations,
+                    &launcher, &arguments) != 0 ||
+                run_bench("fire", bench_fire, arguments.fires,
+                    &launcher, &arguments) != 0)
+        {
+            ret = EXIT_FAILURE;
+        }
+
+        launcher_close(&launcher);
+    }
+
+    if (ret == EXIT_SUCCESS)
+    {
+        printf("\n%-10s %8s %12s %12s %10s %10s\n", "scenario", "runs",
+                "sim_ms_mean", "wall_us_mean", "speedup", "drift_deg");
+
+        if (run_sim("scheduled", sim_scheduled, arguments.engagements,
+                    &arguments) != 0 ||
+                run_sim("in-order", sim_in_order, arguments.engagements,
+                    &arguments) != 0 ||
+                run_sim("planned", sim_planned, arguments.engagements,
+                    &arguments) != 0 ||
+                run_sim("unplanned", sim_unplanned, arguments.engagements,
+                    &arguments) != 0 ||
+                run_sim("volley", sim_volley, arguments.engagements,
+                    &arguments) != 0 ||
+                run_sim("singles", sim_singles, arguments.engagements,
+                    &arguments) != 0)
+        {
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    return ret;
+}
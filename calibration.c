@@ -0,0 +1,277 @@
+#include "calibration.h"
+#include "position.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Checks whether a mapped file holds a table this version understands
+ *
+ * @param[in] file The mapped file
+ *
+ * @return Returns true if the table is usable or false otherwise
+ */
+static bool table_valid(const struct calibration_file *file)
+{
+    return file->magic == CALIBRATION_MAGIC &&
+        file->version == CALIBRATION_VERSION &&
+        file->count <= MAX_CALIBRATIONS;
+}
+
+int calibration_open(struct calibration_table *table, const char *path,
+        bool writable)
+{
+    int ret = 0;
+    int fd = open(path, (writable ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC,
+            0644);
+    struct stat info;
+    void *map = MAP_FAILED;
+
+    table->file = NULL;
+    table->writable = writable;
+
+    if (fd < 0 && !writable && errno == ENOENT)
+    {
+        // Nothing has been calibrated yet
+    }
+    else if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        ret = -1;
+    }
+    else if (writable && info.st_size == 0 &&
+            ftruncate(fd, sizeof(struct calibration_file)) != 0)
+    {
+        fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+        ret = -1;
+    }
+    else if (info.st_size != 0 &&
+            info.st_size != sizeof(struct calibration_file))
+    {
+        fprintf(stderr, "%s: Not a calibration table\n", path);
+        ret = -1;
+    }
+    else
+    {
+        map = mmap(NULL, sizeof(struct calibration_file),
+                writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                fd, 0);
+
+        if (map == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed to map %s: %s\n", path, strerror(errno));
+            ret = -1;
+        }
+    }
+
+    if (map != MAP_FAILED)
+    {
+        table->file = map;
+
+        // A freshly created file is all zeroes, so stamp it as a table
+        if (writable && info.st_size == 0)
+        {
+            table->file->magic = CALIBRATION_MAGIC;
+            table->file->version = CALIBRATION_VERSION;
+        }
+
+        if (!table_valid(table->file))
+        {
+            fprintf(stderr, "%s: Not a calibration table\n", path);
+            calibration_close(table);
+            ret = -1;
+        }
+    }
+
+    // The mapping stays valid after the file is closed
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return ret;
+}
+
+void calibration_close(struct calibration_table *table)
+{
+    if (table->file != NULL)
+    {
+        munmap(table->file, sizeof(*table->file));
+        table->file = NULL;
+    }
+}
+
+/**
+ * Looks up the entry for a launcher
+ *
+ * @param[in] table The table to look in
+ * @param[in] key The launcher's serial number, or path without one
+ *
+ * @return Returns the entry, or NULL if there is none
+ */
+static struct calibration_entry *find_entry(
+        const struct calibration_table *table, const char *key)
+{
+    struct calibration_entry *entry = NULL;
+    uint32_t i;
+
+    for (i = 0; table->file != NULL && i < table->file->count; i++)
+    {
+        if (strncmp(table->file->entries[i].key, key,
+                    MAX_CALIBRATION_KEY - 1) == 0)
+        {
+            entry = &table->file->entries[i];
+            break;
+        }
+    }
+
+    return entry;
+}
+
+bool calibration_apply(const struct calibration_table *table,
+        const char *key, struct position *position)
+{
+    const struct calibration_entry *entry = find_entry(table, key);
+    bool found = entry != NULL && entry->left_rate > 0.0 &&
+        entry->right_rate > 0.0 && entry->up_rate > 0.0 &&
+        entry->down_rate > 0.0;
+
+    if (found)
+    {
+        position->left_rate = entry->left_rate;
+        position->right_rate = entry->right_rate;
+        position->up_rate = entry->up_rate;
+        position->down_rate = entry->down_rate;
+    }
+
+    return found;
+}
+
+int calibration_store(struct calibration_table *table, const char *key,
+        const struct position *position)
+{
+    int ret = 0;
+    struct calibration_entry *entry = find_entry(table, key);
+    uint32_t i;
+
+    if (table->file == NULL || !table->writable)
+    {
+        fprintf(stderr, "Calibration table is not open for writing\n");
+        ret = -1;
+    }
+    else if (entry == NULL && table->file->count < MAX_CALIBRATIONS)
+    {
+        entry = &table->file->entries[table->file->count++];
+    }
+    else if (entry == NULL)
+    {
+        // Make way by forgetting whichever launcher was calibrated longest
+        // ago
+        entry = &table->file->entries[0];
+
+        for (i = 1; i < table->file->count; i++)
+        {
+            if (table->file->entries[i].calibrated < entry->calibrated)
+            {
+                entry = &table->file->entries[i];
+            }
+        }
+    }
+
+    if (ret == 0)
+    {
+        memset(entry, 0, sizeof(*entry));
+        strncpy(entry->key, key, MAX_CALIBRATION_KEY - 1);
+        entry->left_rate = position->left_rate;
+        entry->right_rate = position->right_rate;
+        entry->up_rate = position->up_rate;
+        entry->down_rate = position->down_rate;
+        entry->calibrated = time(NULL);
+    }
+
+    if (ret == 0 && msync(table->file, sizeof(*table->file), MS_SYNC) != 0)
+    {
+        fprintf(stderr, "Failed to write calibration table: %s\n",
+                strerror(errno));
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/**
+ * Times a sweep from one limit switch to the opposite one and works out the
+ * rate of travel from it
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] movement The direction to sweep
+ * @param[in] range The range of travel of the axis, in degrees
+ * @param[out] rate Gets populated with the rate, in degrees per millisecond
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int time_sweep(struct launcher *launcher, enum movement movement,
+        double range, double *rate)
+{
+    int ret = 0;
+    useconds_t moved = 0;
+
+    if (move_turret_exact(launcher, movement, HOME_TIMEOUT_US, &moved) != 0)
+    {
+        fprintf(stderr, "Failed to move turret while calibrating\n");
+        ret = -1;
+    }
+    else if (moved == 0 || moved >= HOME_TIMEOUT_US)
+    {
+        // Running for the whole timeout means the switch was never reached
+        fprintf(stderr, "Turret never reached its limit switch\n");
+        ret = -1;
+    }
+    else
+    {
+        *rate = range / (moved / 1000.0);
+    }
+
+    return ret;
+}
+
+int calibrate_turret(struct launcher *launcher)
+{
+    int ret = 0;
+    struct position *position = &launcher->position;
+    double rates[4];
+
+    // Sweep each axis out and back from the down and left limits, keeping
+    // the old rates until every sweep has succeeded
+    if (home_turret(launcher) != 0 ||
+            time_sweep(launcher, MOVEMENT_PAN_RIGHT, position->pan_range,
+                &rates[0]) != 0 ||
+            time_sweep(launcher, MOVEMENT_PAN_LEFT, position->pan_range,
+                &rates[1]) != 0 ||
+            time_sweep(launcher, MOVEMENT_TILT_UP, position->tilt_range,
+                &rates[2]) != 0 ||
+            time_sweep(launcher, MOVEMENT_TILT_DOWN, position->tilt_range,
+                &rates[3]) != 0)
+    {
+        fprintf(stderr, "Calibration failed\n");
+        ret = -1;
+    }
+    else
+    {
+        position->right_rate = rates[0];
+        position->left_rate = rates[1];
+        position->up_rate = rates[2];
+        position->down_rate = rates[3];
+
+        printf("Rates (degrees/ms): left %.6f right %.6f up %.6f down %.6f\n",
+                position->left_rate, position->right_rate,
+                position->up_rate, position->down_rate);
+    }
+
+    return ret;
+}
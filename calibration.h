@@ -0,0 +1,122 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include "launcher.h"
+
+//
+// Default location of the calibration table
+//
+#define DEFAULT_CALIBRATION_PATH    "/tmp/" PROGRAM_NAME ".cal"
+
+//
+// Identifies a calibration table, and the version of its layout
+//
+#define CALIBRATION_MAGIC           0x4d4c4354
+#define CALIBRATION_VERSION         1
+
+//
+// Most launchers a table holds, and the longest key stored for each
+//
+#define MAX_CALIBRATIONS            32
+#define MAX_CALIBRATION_KEY         64
+
+/**
+ * The measured rates of travel of a single launcher, in degrees per
+ * millisecond of movement in each direction
+ */
+struct calibration_entry
+{
+    char key[MAX_CALIBRATION_KEY];  // Serial number, or path without one
+    double left_rate;
+    double right_rate;
+    double up_rate;
+    double down_rate;
+    int64_t calibrated;             // When measured, in seconds since the
+                                    // epoch
+};
+
+/**
+ * The layout of a calibration table file. The file is mapped straight into
+ * memory, so its layout is fixed and it is only usable on the kind of
+ * machine that wrote it.
+ */
+struct calibration_file
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;                 // Entries in use
+    uint32_t reserved;
+    struct calibration_entry entries[MAX_CALIBRATIONS];
+};
+
+/**
+ * An open calibration table
+ */
+struct calibration_table
+{
+    struct calibration_file *file;  // The mapped file, or NULL if there is
+                                    // none
+    bool writable;
+};
+
+/**
+ * Maps a calibration table into memory. A missing table is not an error
+ * when opening it read-only, and simply holds no entries. Opening it for
+ * writing creates it if need be.
+ *
+ * @param[out] table The table to open
+ * @param[in] path The path of the table file
+ * @param[in] writable Whether entries are going to be stored
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int calibration_open(struct calibration_table *table, const char *path,
+        bool writable);
+
+/**
+ * Unmaps a calibration table
+ *
+ * @param[in,out] table The table to close
+ */
+void calibration_close(struct calibration_table *table);
+
+/**
+ * Replaces the rates in a position estimate with those stored for a
+ * launcher, if the table has any
+ *
+ * @param[in] table The table to look in
+ * @param[in] key The launcher's serial number, or path without one
+ * @param[in,out] position The position estimate to update
+ *
+ * @return Returns true if rates were found or false otherwise
+ */
+bool calibration_apply(const struct calibration_table *table,
+        const char *key, struct position *position);
+
+/**
+ * Stores the rates from a position estimate as the calibration for a
+ * launcher, replacing any earlier entry for it. When the table is full the
+ * oldest entry makes way.
+ *
+ * @param[in,out] table The table, which must be writable
+ * @param[in] key The launcher's serial number, or path without one
+ * @param[in] position The position estimate holding the measured rates
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int calibration_store(struct calibration_table *table, const char *key,
+        const struct position *position);
+
+/**
+ * Measures the turret's rate of travel in each direction by timing full
+ * sweeps between opposite limit switches, after homing. The rates are left
+ * in the launcher's position estimate, which is at the down and left limits
+ * afterwards, and printed to standard output.
+ *
+ * @param[in] launcher The launcher to operate
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int calibrate_turret(struct launcher *launcher);
+
+#endif
@@ -0,0 +1,1012 @@
+#include "daemon.h"
+#include "monitor.h"
+#include "udp.h"
+#include "hotplug.h"
+#include "metrics.h"
+#include "executor.h"
+#include "status-page.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <stddef.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+//
+// Most events handled for each wait in the event loop
+//
+#define MAX_DAEMON_EVENTS   16
+
+//
+// Time between attempts to reopen a launcher that has gone away
+//
+#define RECONNECT_INTERVAL_US   250000
+
+//
+// Request flag saying that more of the same script follows in the next
+// message
+//
+#define REQUEST_CONTINUES       0x1
+
+/**
+ * Request message sent from a client to the daemon. A script too long for a
+ * single message is sent as a series of them, and only answered once the
+ * last has arrived, so that the whole script is carried out as one job.
+ */
+struct wire_request
+{
+    uint32_t flags;
+    uint32_t reserved;
+    struct action actions[MAX_REQUEST_ACTIONS];
+};
+
+/**
+ * Response message sent from the daemon back to the client
+ */
+struct wire_response
+{
+    int32_t result;
+    uint16_t status_count;
+    uint16_t reserved;
+    uint8_t statuses[MAX_REQUEST_ACTIONS];
+};
+
+/**
+ * Set by the signal handler when the daemon has been asked to stop
+ */
+static volatile sig_atomic_t daemon_stopping;
+
+/**
+ * Signal handler for SIGINT and SIGTERM
+ *
+ * @param[in] sig The signal number being handled
+ */
+static void handle_stop_signal(int sig)
+{
+    daemon_stopping = 1;
+}
+
+/**
+ * Blocks or unblocks SIGINT and SIGTERM in the calling thread. Threads
+ * started while they are blocked inherit that, which leaves the signals to
+ * interrupt the event loop rather than one of the threads helping it.
+ *
+ * @param[in] how SIG_BLOCK or SIG_UNBLOCK
+ */
+static void mask_stop_signals(int how)
+{
+    sigset_t signals;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(how, &signals, NULL);
+}
+
+/**
+ * Fills in a Unix domain socket address for the given path
+ *
+ * @param[out] addr The address structure to populate
+ * @param[in] socket_path The filesystem path of the socket
+ *
+ * @return Returns zero on success or non-zero if the path is too long
+ */
+static int make_address(struct sockaddr_un *addr, const char *socket_path)
+{
+    int ret = 0;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof(addr->sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        ret = -1;
+    }
+    else
+    {
+        strcpy(addr->sun_path, socket_path);
+    }
+
+    return ret;
+}
+
+/**
+ * Creates the listening socket for the daemon, replacing any stale socket
+ * file left behind by a previous instance
+ *
+ * @param[in] socket_path The filesystem path to listen on
+ *
+ * @return Returns the listening socket on success or -1 otherwise
+ */
+static int open_listen_socket(const char *socket_path)
+{
+    int fd = -1;
+    struct sockaddr_un addr;
+
+    if (make_address(&addr, socket_path) == 0)
+    {
+        fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+        if (fd < 0)
+        {
+            fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        }
+        else if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+        {
+            // Somebody is already answering on this path
+            fprintf(stderr, "A daemon is already listening on %s\n",
+                    socket_path);
+            close(fd);
+            fd = -1;
+        }
+        else
+        {
+            // A socket that can only be connected to once is of no use, so
+            // start over with a fresh one for listening
+            close(fd);
+            fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+            unlink(socket_path);
+
+            if (fd < 0 ||
+                    bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+                    chmod(socket_path, 0660) != 0 ||
+                    listen(fd, SOMAXCONN) != 0)
+            {
+                fprintf(stderr, "Failed to listen on %s: %s\n", socket_path,
+                        strerror(errno));
+
+                if (fd >= 0)
+                {
+                    close(fd);
+                    fd = -1;
+                }
+            }
+        }
+    }
+
+    return fd;
+}
+
+/**
+ * Adds a file descriptor to an epoll set
+ *
+ * @param[in] epoll_fd The epoll set
+ * @param[in] fd The file descriptor to watch
+ * @param[in] events The events to watch for
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int watch_fd(int epoll_fd, int fd, uint32_t events)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/**
+ * Changes the events watched for on a file descriptor in an epoll set
+ *
+ * @param[in] epoll_fd The epoll set
+ * @param[in] fd The file descriptor being watched
+ * @param[in] events The events to watch for, or zero to ignore it for now
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int rewatch_fd(int epoll_fd, int fd, uint32_t events)
+{
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.fd = fd;
+
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+}
+
+/**
+ * What the daemon knows about a connected client, kept by its socket
+ */
+struct client_request
+{
+    struct job *job;        // The request being received or carried out,
+                            // or NULL
+    size_t statuses;        // Status reads in the request so far
+    bool failed;            // Whether the rest of the script being received
+                            // is to be thrown away
+    bool submitted;         // Whether the job is with the executor
+    bool hung_up;           // Whether the client went away in the meantime
+};
+
+/**
+ * The daemon's hold on its launcher, which may come and go
+ */
+struct daemon_link
+{
+    struct launcher *launcher;
+    const struct daemon_config *config;
+    struct monitor monitor;
+    struct executor executor;
+    int epoll_fd;
+    int device_fd;          // Watched for the launcher going away, or -1
+    bool connected;
+    bool suspended;         // Whether the executor is holding its jobs
+    uint64_t lost;          // When the launcher went away, as timing_now
+    uint64_t next_attempt;  // When to next try to reopen it, as timing_now
+    struct client_request *clients; // Indexed by socket
+    size_t client_slots;
+};
+
+/**
+ * Finds the entry for a connected client, making room for it if need be
+ *
+ * @param[in,out] link The link to the launcher
+ * @param[in] fd The connected client socket
+ *
+ * @return Returns the entry, or NULL if out of memory
+ */
+static struct client_request *link_client(struct daemon_link *link, int fd)
+{
+    struct client_request *client = NULL;
+
+    if ((size_t)fd >= link->client_slots)
+    {
+        size_t slots = (size_t)fd * 2 + 1;
+        struct client_request *clients = realloc(link->clients,
+                slots * sizeof(*clients));
+
+        if (clients != NULL)
+        {
+            memset(&clients[link->client_slots], 0,
+                    (slots - link->client_slots) * sizeof(*clients));
+            link->clients = clients;
+            link->client_slots = slots;
+        }
+    }
+
+    if ((size_t)fd < link->client_slots)
+    {
+        client = &link->clients[fd];
+    }
+
+    return client;
+}
+
+/**
+ * Stops listening to a client that has gone away. A client whose request is
+ * still with the executor keeps its socket open until the request comes
+ * back, so that the descriptor can't be handed out again and answered in
+ * its place, and the request is cancelled.
+ *
+ * @param[in,out] link The link to the launcher
+ * @param[in] fd The connected client socket
+ */
+static void drop_client(struct daemon_link *link, int fd)
+{
+    struct client_request *client = (size_t)fd < link->client_slots ?
+        &link->clients[fd] : NULL;
+
+    if (client != NULL && client->submitted)
+    {
+        epoll_ctl(link->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        executor_cancel(client->job);
+        client->hung_up = true;
+    }
+    else
+    {
+        // A script that never arrived in full is simply forgotten
+        if (client != NULL)
+        {
+            job_free(client->job);
+            memset(client, 0, sizeof(*client));
+        }
+
+        // Closing the socket also removes it from the epoll set
+        close(fd);
+    }
+}
+
+/**
+ * Adds the actions from one message to the script a client is sending
+ *
+ * @param[in,out] client The client
+ * @param[in] actions The actions
+ * @param[in] count The number of actions, which must not be zero
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int add_request_actions(struct client_request *client,
+        const struct action *actions, size_t count)
+{
+    int ret = 0;
+    size_t i;
+
+    if (client->job == NULL && (client->job = job_create()) != NULL)
+    {
+        // Stopping the turret first means whatever it is doing now is
+        // unwanted. Only the start of a script can say so, however it is
+        // split between messages.
+        client->job->priority = actions[0].type == ACTION_STOP ?
+            JOB_ABORT : JOB_NORMAL;
+    }
+
+    if (client->job == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory\n");
+        ret = -1;
+    }
+    else if (client->job->actions.count + count > MAX_SCRIPT_ACTIONS)
+    {
+        fprintf(stderr, "Ignoring oversized request\n");
+        ret = -1;
+    }
+
+    for (i = 0; i < count && ret == 0; i++)
+    {
+        if (actions[i].type == ACTION_STATUS &&
+                ++client->statuses > MAX_JOB_STATUSES)
+        {
+            fprintf(stderr, "Ignoring request with too many status "
+                    "reads\n");
+            ret = -1;
+        }
+        else if (action_list_add(&client->job->actions, &actions[i]) != 0)
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Receives a request message from a client connection, and queues the
+ * client's script to be carried out once all of it has arrived. The
+ * connection is ignored until the script is answered, so each client has at
+ * most one script queued and its scripts stay in order.
+ *
+ * @param[in,out] link The link to the launcher
+ * @param[in] fd The connected client socket
+ *
+ * @return Returns zero on success or non-zero if the client has gone away
+ */
+static int receive_request(struct daemon_link *link, int fd)
+{
+    int ret = 0;
+    struct wire_request request;
+    struct wire_response response;
+    struct client_request *client = link_client(link, fd);
+    size_t header = offsetof(struct wire_request, actions);
+    ssize_t len = recv(fd, &request, sizeof(request), MSG_DONTWAIT);
+    size_t count = len > (ssize_t)header ?
+        (len - header) / sizeof(request.actions[0]) : 0;
+    bool failed = false;
+    bool last = true;
+
+    memset(&response, 0, offsetof(struct wire_response, statuses));
+    response.result = -1;
+
+    if (len < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        // Nothing to do yet after all
+    }
+    else if (len <= 0)
+    {
+        ret = -1;
+    }
+    else if (count == 0 ||
+            (len - header) % sizeof(request.actions[0]) != 0)
+    {
+        fprintf(stderr, "Ignoring malformed request\n");
+        failed = true;
+    }
+    else if (client == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory\n");
+        failed = true;
+    }
+    else
+    {
+        last = !(request.flags & REQUEST_CONTINUES);
+        failed = client->failed ||
+            add_request_actions(client, request.actions, count) != 0;
+    }
+
+    if (ret == 0 && len > 0 && !failed && last &&
+            rewatch_fd(link->epoll_fd, fd, 0) == 0)
+    {
+        client->job->fd = fd;
+        client->submitted = true;
+        executor_submit(&link->executor, client->job);
+    }
+    else if (ret == 0 && len > 0 && (failed || last))
+    {
+        // The rest of a script that failed is read and thrown away, and the
+        // client answered once it has all arrived
+        if (client != NULL)
+        {
+            job_free(client->job);
+            client->job = NULL;
+            client->statuses = 0;
+            client->failed = !last;
+        }
+
+        if (last && send(fd, &response,
+                    offsetof(struct wire_response, statuses),
+                    MSG_NOSIGNAL) < 0)
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Answers every request the executor has finished with, and starts
+ * listening to their clients again
+ *
+ * @param[in,out] link The link to the launcher
+ * @param[in] udp_fd The datagram socket, or -1 if there is none
+ * @param[in,out] udp_state The state kept between datagrams
+ */
+static void answer_requests(struct daemon_link *link, int udp_fd,
+        struct udp_state *udp_state)
+{
+    struct job *job;
+    eventfd_t value;
+
+    eventfd_read(link->executor.done_fd, &value);
+
+    while ((job = executor_collect(&link->executor)) != NULL)
+    {
+        struct wire_response response;
+
+        memset(&response, 0, offsetof(struct wire_response, statuses));
+        response.result = job->result;
+        response.status_count = job->status_count;
+        memcpy(response.statuses, job->statuses, job->status_count);
+
+        if (job->fd == udp_fd)
+        {
+            udp_answer(udp_fd, udp_state, job);
+        }
+        else
+        {
+            struct client_request *client = &link->clients[job->fd];
+
+            // Only now is the socket of a client that hung up free to go
+            if (client->hung_up || send(job->fd, &response,
+                        offsetof(struct wire_response, statuses) +
+                        response.status_count, MSG_NOSIGNAL) < 0 ||
+                    rewatch_fd(link->epoll_fd, job->fd, EPOLLIN) != 0)
+            {
+                // Closing the socket also removes it from the epoll set
+                close(job->fd);
+            }
+
+            memset(client, 0, sizeof(*client));
+        }
+
+        job_free(job);
+    }
+}
+
+/**
+ * Starts serving the launcher the link holds, polling its status in the
+ * background and watching its file descriptor for it going away
+ *
+ * @param[in,out] link The link to the launcher
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int link_start(struct daemon_link *link)
+{
+    int ret = monitor_start(&link->monitor, link->launcher,
+            link->launcher->poll_interval,
+            link->launcher->poll_max_interval);
+
+    if (ret == 0)
+    {
+        // The status reader does all the reading from the launcher, so only
+        // hangups and errors on it are of interest here
+        link->device_fd = launcher_get_fd(link->launcher);
+        link->connected = true;
+
+        if (link->launcher->status_page != NULL)
+        {
+            status_page_set_connected(link->launcher->status_page, true);
+        }
+
+        if (link->device_fd >= 0 &&
+                watch_fd(link->epoll_fd, link->device_fd, 0) != 0)
+        {
+            link->device_fd = -1;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * Stops serving a launcher that has gone away and closes it, so that any
+ * command sent without it fails cleanly. The request in progress is cut
+ * short, and the rest are held back until the launcher returns or the grace
+ * period runs out.
+ *
+ * @param[in,out] link The link to the launcher
+ */
+static void link_lose(struct daemon_link *link)
+{
+    fprintf(stderr, "Launcher has gone away, holding requests for up to "
+            "%u ms\n", (unsigned int)(link->config->grace_period / 1000));
+
+    executor_suspend(&link->executor, true);
+    link->suspended = true;
+
+    if (link->device_fd >= 0)
+    {
+        epoll_ctl(link->epoll_fd, EPOLL_CTL_DEL, link->device_fd, NULL);
+        link->device_fd = -1;
+    }
+
+    monitor_stop(&link->monitor, link->launcher);
+    launcher_close(link->launcher);
+    link->connected = false;
+
+    // It may have been moving when it went, and may not even be the same
+    // launcher that comes back
+    link->launcher->position.pan_known = false;
+    link->launcher->position.tilt_known = false;
+    link->lost = timing_now();
+
+    if (link->launcher->status_page != NULL)
+    {
+        status_page_set_connected(link->launcher->status_page, false);
+        status_page_set_position(link->launcher->status_page,
+                &link->launcher->position, link->lost);
+    }
+    link->next_attempt = link->lost;
+}
+
+/**
+ * Tries to reopen a launcher that has gone away, and to serve it again
+ *
+ * @param[in,out] link The link to the launcher
+ */
+static void link_retry(struct daemon_link *link)
+{
+    void *handle = link->config->reopen(link->config->reopen_context);
+
+    link->next_attempt = timing_now() + RECONNECT_INTERVAL_US;
+
+    // Requests may be failing without the launcher by now, and have to be
+    // out of the way before it can be touched
+    if (handle != NULL && !link->suspended)
+    {
+        executor_suspend(&link->executor, false);
+        link->suspended = true;
+    }
+
+    if (handle != NULL)
+    {
+        int result;
+
+        link->launcher->handle = handle;
+        mask_stop_signals(SIG_BLOCK);
+        result = link_start(link);
+        mask_stop_signals(SIG_UNBLOCK);
+
+        if (result != 0)
+        {
+            launcher_close(link->launcher);
+        }
+        else
+        {
+            fprintf(stderr, "Launcher reconnected after %llu ms\n",
+                    (unsigned long long)(timing_now() - link->lost) / 1000);
+            executor_resume(&link->executor);
+            link->suspended = false;
+        }
+    }
+}
+
+/**
+ * Works out how long the event loop may wait before it next needs to act
+ * on a missing launcher
+ *
+ * @param[in] link The link to the launcher
+ *
+ * @return Returns the longest wait in milliseconds, or -1 for no limit
+ */
+static int link_timeout(const struct daemon_link *link)
+{
+    int timeout_ms = -1;
+    uint64_t now = timing_now();
+    uint64_t wake = link->next_attempt;
+
+    if (!link->connected && link->config->reopen != NULL)
+    {
+        // Wake when the grace period runs out to let held requests fail
+        if (link->suspended &&
+                link->lost + link->config->grace_period < wake)
+        {
+            wake = link->lost + link->config->grace_period;
+        }
+
+        timeout_ms = wake > now ? (int)((wake - now + 999) / 1000) : 0;
+    }
+
+    return timeout_ms;
+}
+
+/**
+ * Waits on the listening socket, every connected client, the datagram
+ * socket, hotplug events, the executor and the launcher itself in a single
+ * epoll loop, queueing requests as they arrive and answering them as they
+ * finish, until the daemon is asked to stop. When the launcher goes away it
+ * is reopened as soon as it comes back, with requests held back in the
+ * meantime for up to the grace period.
+ *
+ * @param[in,out] link The link to the launcher, which is being served
+ * @param[in] listen_fd The listening socket
+ * @param[in] udp_fd The datagram socket, or -1 if there is none
+ * @param[in] hotplug_fd The hotplug event socket, or -1 if there is none
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int serve_clients(struct daemon_link *link, int listen_fd, int udp_fd,
+        int hotplug_fd)
+{
+    int ret = 0;
+    struct udp_state udp_state;
+
+    udp_state_init(&udp_state);
+
+    if (watch_fd(link->epoll_fd, listen_fd, EPOLLIN) != 0 ||
+            watch_fd(link->epoll_fd, link->executor.done_fd, EPOLLIN) != 0 ||
+            (udp_fd >= 0 && watch_fd(link->epoll_fd, udp_fd, EPOLLIN) != 0) ||
+            (hotplug_fd >= 0 &&
+                watch_fd(link->epoll_fd, hotplug_fd, EPOLLIN) != 0))
+    {
+        fprintf(stderr, "Failed to set up event loop: %s\n", strerror(errno));
+        ret = -1;
+    }
+
+    while (ret == 0 && !daemon_stopping)
+    {
+        struct epoll_event events[MAX_DAEMON_EVENTS];
+        int count = epoll_wait(link->epoll_fd, events, MAX_DAEMON_EVENTS,
+                link_timeout(link));
+        int i;
+
+        if (count < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "Failed to wait for events: %s\n",
+                    strerror(errno));
+            ret = -1;
+        }
+
+        for (i = 0; i < count && ret == 0; i++)
+        {
+            int fd = events[i].data.fd;
+
+            if (fd == link->device_fd && link->config->reopen == NULL)
+            {
+                fprintf(stderr, "Launcher has gone away\n");
+                ret = -1;
+            }
+            else if (fd == link->device_fd)
+            {
+                link_lose(link);
+            }
+            else if (fd == link->executor.done_fd)
+            {
+                answer_requests(link, udp_fd, &udp_state);
+            }
+            else if (fd == hotplug_fd)
+            {
+                int event = hotplug_receive(hotplug_fd);
+
+                if (event == HOTPLUG_REMOVED && link->connected &&
+                        link->config->reopen != NULL)
+                {
+                    link_lose(link);
+                }
+                else if (event == HOTPLUG_ADDED && !link->connected)
+                {
+                    link->next_attempt = timing_now();
+                }
+            }
+            else if (fd == listen_fd)
+            {
+                int client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+                if (client_fd >= 0 &&
+                        watch_fd(link->epoll_fd, client_fd, EPOLLIN) != 0)
+                {
+                    close(client_fd);
+                }
+                else if (client_fd < 0 && errno != EINTR &&
+                        errno != ECONNABORTED)
+                {
+                    fprintf(stderr, "Failed to accept connection: %s\n",
+                            strerror(errno));
+                    ret = -1;
+                }
+            }
+            else if (fd == udp_fd)
+            {
+                struct job *job = udp_receive(udp_fd, &udp_state);
+
+                if (job != NULL)
+                {
+                    job->fd = udp_fd;
+                    executor_submit(&link->executor, job);
+                }
+            }
+            else if (!(events[i].events & EPOLLIN) ||
+                    receive_request(link, fd) != 0)
+            {
+                drop_client(link, fd);
+            }
+        }
+
+        if (ret == 0 && !link->connected && link->config->reopen != NULL &&
+                timing_now() >= link->next_attempt)
+        {
+            link_retry(link);
+        }
+
+        // Requests can't wait forever, so once the grace period is over they
+        // are carried out, and fail, without the launcher
+        if (ret == 0 && link->suspended &&
+                timing_now() >= link->lost + link->config->grace_period)
+        {
+            fprintf(stderr, "Launcher still missing, failing held "
+                    "requests\n");
+            executor_resume(&link->executor);
+            link->suspended = false;
+        }
+
+        metrics_set(METRIC_QUEUE_DEPTH, executor_depth(&link->executor));
+    }
+
+    return ret;
+}
+
+int daemon_serve(struct launcher *launcher,
+        const struct daemon_config *config)
+{
+    int ret = 0;
+    int listen_fd;
+    int udp_fd = -1;
+    int hotplug_fd = -1;
+    struct sigaction action;
+    struct daemon_link link;
+    struct metrics_server metrics;
+
+    // Install the stop handler without SA_RESTART so that a blocking wait
+    // gets interrupted and the loop below can exit cleanly
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // Every thread started from here on leaves the stop signals to this one
+    mask_stop_signals(SIG_BLOCK);
+
+    memset(&link, 0, sizeof(link));
+    link.launcher = launcher;
+    link.config = config;
+    link.device_fd = -1;
+    link.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    listen_fd = open_listen_socket(config->socket_path);
+
+    if (listen_fd >= 0 && config->udp_address != NULL)
+    {
+        udp_fd = udp_open(config->udp_address);
+    }
+
+    // Scrapes are answered from a thread of their own
+    metrics.running = false;
+
+    if (listen_fd >= 0 && config->metrics_address != NULL &&
+            metrics_serve_start(&metrics, config->metrics_address) != 0)
+    {
+        close(listen_fd);
+        unlink(config->socket_path);
+        listen_fd = -1;
+    }
+
+    // The status reader publishes to the page through its copy of the
+    // launcher, so it has to be in place before that starts
+    if (listen_fd >= 0 && config->status_page != NULL)
+    {
+        launcher->status_page = status_page_create(config->status_page);
+
+        if (launcher->status_page == NULL)
+        {
+            close(listen_fd);
+            unlink(config->socket_path);
+            listen_fd = -1;
+        }
+        else
+        {
+            status_page_set_position(launcher->status_page,
+                    &launcher->position, timing_now());
+        }
+    }
+
+    // Without hotplug events the launcher is still looked for periodically
+    if (listen_fd >= 0 && config->reopen != NULL)
+    {
+        hotplug_fd = hotplug_open();
+    }
+
+    if (link.epoll_fd < 0)
+    {
+        fprintf(stderr, "Failed to set up event loop: %s\n", strerror(errno));
+        ret = -1;
+    }
+    else if (listen_fd < 0 || (config->udp_address != NULL && udp_fd < 0) ||
+            link_start(&link) != 0)
+    {
+        ret = -1;
+    }
+    else if (executor_start(&link.executor, launcher) != 0)
+    {
+        monitor_stop(&link.monitor, launcher);
+        ret = -1;
+    }
+    else
+    {
+        mask_stop_signals(SIG_UNBLOCK);
+        ret = serve_clients(&link, listen_fd, udp_fd, hotplug_fd);
+
+        // The executor has to let go of the launcher before the status
+        // reader stops
+        executor_stop(&link.executor);
+
+        if (link.connected)
+        {
+            monitor_stop(&link.monitor, launcher);
+        }
+    }
+
+    mask_stop_signals(SIG_UNBLOCK);
+
+    if (launcher->status_page != NULL)
+    {
+        status_page_destroy(launcher->status_page, config->status_page);
+        launcher->status_page = NULL;
+    }
+
+    if (metrics.running)
+    {
+        metrics_serve_stop(&metrics);
+    }
+
+    if (hotplug_fd >= 0)
+    {
+        close(hotplug_fd);
+    }
+
+    if (udp_fd >= 0)
+    {
+        close(udp_fd);
+    }
+
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        unlink(config->socket_path);
+    }
+
+    // Any clients still connected are cut off when the daemon exits
+    if (link.epoll_fd >= 0)
+    {
+        close(link.epoll_fd);
+    }
+
+    free(link.clients);
+
+    return ret;
+}
+
+int daemon_request(const char *socket_path, const struct action *actions,
+        size_t count, status_handler handler, void *context)
+{
+    int ret = 0;
+    int fd = -1;
+    struct sockaddr_un addr;
+    struct wire_request request;
+    struct wire_response response;
+    ssize_t len;
+
+    if (make_address(&addr, socket_path) != 0)
+    {
+        ret = -1;
+    }
+    else if ((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0)
+    {
+        fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        ret = -1;
+    }
+    else if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        // A missing or abandoned socket just means nobody is serving
+        if (errno == ENOENT || errno == ECONNREFUSED)
+        {
+            ret = DAEMON_NOT_RUNNING;
+        }
+        else
+        {
+            fprintf(stderr, "Failed to connect to daemon: %s\n",
+                    strerror(errno));
+            ret = -1;
+        }
+    }
+
+    // Scripts too long for one message go as a series of them, which the
+    // daemon carries out as one
+    memset(&request, 0, offsetof(struct wire_request, actions));
+
+    while (ret == 0 && count > 0)
+    {
+        size_t chunk = count < MAX_REQUEST_ACTIONS ?
+            count : MAX_REQUEST_ACTIONS;
+
+        request.flags = chunk < count ? REQUEST_CONTINUES : 0;
+        memcpy(request.actions, actions, chunk * sizeof(*actions));
+
+        if (send(fd, &request, offsetof(struct wire_request, actions) +
+                    chunk * sizeof(*actions), MSG_NOSIGNAL) < 0)
+        {
+            fprintf(stderr, "Lost connection to daemon\n");
+            ret = -1;
+        }
+        else if (chunk == count)
+        {
+            if ((len = recv(fd, &response, sizeof(response), 0)) <
+                    (ssize_t)offsetof(struct wire_response, statuses))
+            {
+                fprintf(stderr, "Lost connection to daemon\n");
+                ret = -1;
+            }
+            else
+            {
+                uint16_t i;
+
+                for (i = 0; i < response.status_count && handler != NULL;
+                        i++)
+                {
+                    handler(response.statuses[i], context);
+                }
+
+                ret = response.result;
+            }
+        }
+
+        actions += chunk;
+        count -= chunk;
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return ret;
+}
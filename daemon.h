@@ -0,0 +1,92 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "action.h"
+
+//
+// Default location of the daemon's command socket
+//
+#define DEFAULT_SOCKET_PATH "/tmp/" PROGRAM_NAME ".sock"
+
+//
+// Most actions carried in a single request message, and in a whole script
+// sent as a series of them
+//
+#define MAX_REQUEST_ACTIONS 256
+#define MAX_SCRIPT_ACTIONS  65536
+
+//
+// Return value from daemon_request when no daemon is listening
+//
+#define DAEMON_NOT_RUNNING  1
+
+//
+// Default time requests are held for a launcher that has gone away to come
+// back, in milliseconds
+//
+#define DEFAULT_GRACE_PERIOD_MS 5000
+
+/**
+ * How the daemon is reached, and what it does when its launcher goes away
+ */
+struct daemon_config
+{
+    const char *socket_path;        // The filesystem path to listen on
+    const char *udp_address;        // The address to receive datagrams on, as
+                                    // accepted by udp_open, or NULL for none
+    const char *metrics_address;    // The address to serve metrics over HTTP
+                                    // on, or NULL for none
+    const char *status_page;        // The shared memory object to publish
+                                    // the status in, or NULL for none
+    useconds_t grace_period;        // How long requests wait for a launcher
+                                    // that has gone away (in microseconds)
+    void *(*reopen)(void *context); // Reopens the launcher, returning its
+                                    // transport handle or NULL if it is still
+                                    // missing, or NULL to stop the daemon
+                                    // when the launcher goes away
+    void *reopen_context;           // Passed through to reopen
+};
+
+/**
+ * Keeps the launcher open and carries out commands received over a Unix
+ * domain socket, and optionally datagrams in the protocol described in
+ * udp.h, until interrupted by SIGINT or SIGTERM. A background thread polls
+ * the launcher's status at its poll interval throughout, so commands read the
+ * latest status from memory rather than from the device. Metrics can also be
+ * scraped over HTTP, as described in metrics.h, and the status, position and
+ * latest command published in shared memory, as described in status-page.h.
+ *
+ * Given a way to reopen it, the daemon outlives its launcher being
+ * unplugged. It watches for the launcher coming back through hotplug events,
+ * and tries to reopen it periodically as well, holding back requests for up
+ * to the grace period in the meantime. Requests still waiting after that
+ * fail, as do any in progress when the launcher went away.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] config How to reach the daemon and handle the launcher going
+ *            away
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int daemon_serve(struct launcher *launcher,
+        const struct daemon_config *config);
+
+/**
+ * Hands a sequence of actions off to a running daemon and waits for them to
+ * complete. Long sequences are split across several request messages on the
+ * same connection.
+ *
+ * @param[in] socket_path The filesystem path the daemon is listening on
+ * @param[in] actions The actions to carry out
+ * @param[in] count The number of actions
+ * @param[in] handler Called with the result of each status read
+ * @param[in] context Passed through to the handler
+ *
+ * @return Returns zero on success, DAEMON_NOT_RUNNING if there is no daemon
+ *         listening on the socket, or another non-zero value if the actions
+ *         could not be delivered or failed
+ */
+int daemon_request(const char *socket_path, const struct action *actions,
+        size_t count, status_handler handler, void *context);
+
+#endif
@@ -0,0 +1,353 @@
+#include "executor.h"
+#include "position.h"
+#include <sys/eventfd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+//
+// Time between checks on whether a suspended job has finished, in
+// microseconds
+//
+#define SUSPEND_POLL_US     1000
+
+struct job *job_create(void)
+{
+    struct job *job = calloc(1, sizeof(*job));
+
+    if (job != NULL)
+    {
+        job->priority = JOB_NORMAL;
+        job->fd = -1;
+        atomic_init(&job->cancelled, false);
+        action_list_init(&job->actions);
+    }
+
+    return job;
+}
+
+void job_free(struct job *job)
+{
+    if (job != NULL)
+    {
+        action_list_free(&job->actions);
+        free(job->context);
+        free(job);
+    }
+}
+
+/**
+ * Status handler that keeps every status read in the job
+ *
+ * @param[in] status The status byte read from the launcher
+ * @param[in] context The job being carried out
+ */
+static void collect_status(uint8_t status, void *context)
+{
+    struct job *job = context;
+
+    if (job->status_count < MAX_JOB_STATUSES)
+    {
+        job->statuses[job->status_count++] = status;
+    }
+}
+
+/**
+ * Wakes whoever is waiting on an eventfd
+ *
+ * @param[in] fd The eventfd
+ */
+static void signal_fd(int fd)
+{
+    eventfd_write(fd, 1);
+}
+
+/**
+ * Takes the next job to start: any abort first, then normal jobs in the
+ * order they were submitted
+ *
+ * @param[in,out] executor The executor
+ *
+ * @return Returns the job, or NULL if there is none
+ */
+static struct job *take_job(struct executor *executor)
+{
+    // The node is the first member of a job
+    struct job *job = (struct job *)queue_pop(&executor->queues[JOB_ABORT]);
+
+    if (job == NULL)
+    {
+        job = (struct job *)queue_pop(&executor->queues[JOB_NORMAL]);
+    }
+
+    if (job != NULL)
+    {
+        atomic_fetch_sub(&executor->depth, 1);
+    }
+
+    return job;
+}
+
+/**
+ * Checks whether an abort was submitted after a job. Aborts only ever
+ * concern the jobs submitted before them, so this holds however the
+ * submitting threads and the executor interleave.
+ *
+ * @param[in] executor The executor
+ * @param[in] job The job to check
+ *
+ * @return Returns true if the job has been overtaken by an abort
+ */
+static bool overtaken(struct executor *executor, const struct job *job)
+{
+    return atomic_load(&executor->abort_ticket) > job->ticket + 1;
+}
+
+/**
+ * Carries out a job's actions, or cancels it if an abort overtook it
+ *
+ * @param[in,out] executor The executor
+ * @param[in,out] job The job, updated with its outcome
+ */
+static void run_job(struct executor *executor, struct job *job)
+{
+    struct launcher *launcher = executor->launcher;
+
+    if (job->priority == JOB_NORMAL && overtaken(executor, job))
+    {
+        fprintf(stderr, "Request cancelled by an abort\n");
+        job->result = -1;
+    }
+    else if (atomic_load(&job->cancelled))
+    {
+        fprintf(stderr, "Request cancelled\n");
+        job->result = -1;
+    }
+    else
+    {
+        // The job's own flag is only watched while it runs, so cancelling
+        // it can't touch any other, and only aborts submitted after it cut
+        // it short
+        launcher->cancel = &job->cancelled;
+        launcher->ticket = job->ticket + 1;
+        job->result = run_actions(launcher, job->actions.actions,
+                job->actions.count, collect_status, job);
+        launcher->cancel = NULL;
+
+        if (job->report_status && job->status_count == 0)
+        {
+            uint8_t status;
+
+            if (get_status(launcher, &status) == 0)
+            {
+                collect_status(status, job);
+            }
+        }
+
+        // Keep the saved position current in case the daemon dies
+        if (launcher->state_path != NULL)
+        {
+            position_save(&launcher->position, launcher->state_path);
+        }
+    }
+}
+
+/**
+ * Body of the executor thread
+ *
+ * @param[in] context The executor
+ *
+ * @return Returns NULL
+ */
+static void *executor_main(void *context)
+{
+    struct executor *executor = context;
+
+    while (!atomic_load(&executor->stopping))
+    {
+        struct job *job = NULL;
+        eventfd_t value;
+
+        // Announce that a job may be starting before checking whether that's
+        // allowed, so that executor_suspend sees one or the other
+        atomic_store(&executor->busy, true);
+
+        if (!atomic_load(&executor->suspended))
+        {
+            job = take_job(executor);
+        }
+
+        if (job != NULL)
+        {
+            run_job(executor, job);
+            queue_push(&executor->done, &job->node);
+            signal_fd(executor->done_fd);
+            atomic_store(&executor->busy, false);
+        }
+        else
+        {
+            atomic_store(&executor->busy, false);
+
+            // Every submission signals after queueing, so nothing is missed
+            // by sleeping until the next one
+            while (eventfd_read(executor->wake_fd, &value) != 0 &&
+                    errno == EINTR)
+            {
+            }
+        }
+    }
+
+    return NULL;
+}
+
+int executor_start(struct executor *executor, struct launcher *launcher)
+{
+    int ret = 0;
+    int i;
+
+    memset(executor, 0, sizeof(*executor));
+    executor->launcher = launcher;
+
+    for (i = 0; i < JOB_PRIORITY_COUNT; i++)
+    {
+        queue_init(&executor->queues[i]);
+    }
+
+    queue_init(&executor->done);
+    atomic_init(&executor->tickets, 0);
+    atomic_init(&executor->depth, 0);
+    atomic_init(&executor->abort, false);
+    atomic_init(&executor->abort_ticket, 0);
+    atomic_init(&executor->suspended, false);
+    atomic_init(&executor->busy, false);
+    atomic_init(&executor->stopping, false);
+    executor->wake_fd = eventfd(0, EFD_CLOEXEC);
+    executor->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (executor->wake_fd < 0 || executor->done_fd < 0)
+    {
+        fprintf(stderr, "Failed to create executor: %s\n", strerror(errno));
+        ret = -1;
+    }
+    else
+    {
+        launcher->abort = &executor->abort;
+        launcher->abort_ticket = &executor->abort_ticket;
+
+        if (pthread_create(&executor->thread, NULL, executor_main,
+                    executor) != 0)
+        {
+            fprintf(stderr, "Failed to start executor\n");
+            launcher->abort = NULL;
+            launcher->abort_ticket = NULL;
+            ret = -1;
+        }
+    }
+
+    if (ret != 0)
+    {
+        if (executor->wake_fd >= 0)
+        {
+            close(executor->wake_fd);
+        }
+
+        if (executor->done_fd >= 0)
+        {
+            close(executor->done_fd);
+        }
+    }
+
+    return ret;
+}
+
+void executor_stop(struct executor *executor)
+{
+    struct job *job;
+    int i;
+
+    atomic_store(&executor->stopping, true);
+    atomic_store(&executor->abort, true);
+    signal_fd(executor->wake_fd);
+    pthread_join(executor->thread, NULL);
+
+    executor->launcher->abort = NULL;
+    executor->launcher->abort_ticket = NULL;
+
+    for (i = 0; i < JOB_PRIORITY_COUNT; i++)
+    {
+        while ((job = (struct job *)queue_pop(&executor->queues[i])) != NULL)
+        {
+            job_free(job);
+        }
+    }
+
+    while ((job = executor_collect(executor)) != NULL)
+    {
+        job_free(job);
+    }
+
+    close(executor->wake_fd);
+    close(executor->done_fd);
+}
+
+void executor_submit(struct executor *executor, struct job *job)
+{
+    uint64_t latest;
+
+    job->ticket = atomic_fetch_add(&executor->tickets, 1);
+    atomic_fetch_add(&executor->depth, 1);
+
+    // Cut short whatever was submitted before the abort, and so is in
+    // progress or waiting, before the abort can be taken. Concurrent aborts
+    // may get here in either order, so the latest ticket wins rather than
+    // the latest store.
+    latest = atomic_load(&executor->abort_ticket);
+
+    while (job->priority == JOB_ABORT && latest < job->ticket + 1 &&
+            !atomic_compare_exchange_weak(&executor->abort_ticket, &latest,
+                job->ticket + 1))
+    {
+    }
+
+    queue_push(&executor->queues[job->priority], &job->node);
+    signal_fd(executor->wake_fd);
+}
+
+void executor_cancel(struct job *job)
+{
+    atomic_store(&job->cancelled, true);
+}
+
+struct job *executor_collect(struct executor *executor)
+{
+    return (struct job *)queue_pop(&executor->done);
+}
+
+void executor_suspend(struct executor *executor, bool abort)
+{
+    atomic_store(&executor->suspended, true);
+
+    if (abort)
+    {
+        atomic_store(&executor->abort, true);
+    }
+
+    while (atomic_load(&executor->busy))
+    {
+        timing_sleep(SUSPEND_POLL_US);
+    }
+}
+
+void executor_resume(struct executor *executor)
+{
+    atomic_store(&executor->abort, false);
+    atomic_store(&executor->suspended, false);
+    signal_fd(executor->wake_fd);
+}
+
+size_t executor_depth(struct executor *executor)
+{
+    return atomic_load_explicit(&executor->depth, memory_order_relaxed);
+}
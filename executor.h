@@ -0,0 +1,161 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include "action.h"
+#include "queue.h"
+#include <pthread.h>
+
+//
+// Most status reads whose results a single job keeps
+//
+#define MAX_JOB_STATUSES    256
+
+/**
+ * How urgently a job is carried out
+ */
+enum job_priority
+{
+    JOB_NORMAL,             // Carried out in the order submitted
+    JOB_ABORT,              // Cuts short the job in progress, cancels every
+                            // normal job submitted before it, and goes next
+    JOB_PRIORITY_COUNT,
+};
+
+/**
+ * A sequence of actions submitted to an executor, which are carried out
+ * together without any other job's commands in between
+ */
+struct job
+{
+    struct queue_node node;
+    enum job_priority priority;
+    uint64_t ticket;                // Order of submission
+    atomic_bool cancelled;          // Skip the job, or cut it short
+    struct action_list actions;     // Owned by the job
+    bool report_status;             // Read the status once done if the
+                                    // actions read none
+    int result;                     // Zero if every action succeeded
+    size_t status_count;
+    uint8_t statuses[MAX_JOB_STATUSES];
+    int fd;                         // Where the submitter sends the result
+    void *context;                  // Anything else the submitter needs,
+                                    // from malloc and freed with the job
+};
+
+/**
+ * A thread that owns a launcher and carries out the jobs submitted to it one
+ * at a time. Any thread may submit jobs without locking, and finished jobs
+ * are handed back through a second queue.
+ */
+struct executor
+{
+    pthread_t thread;
+    struct launcher *launcher;
+    struct queue queues[JOB_PRIORITY_COUNT];
+    struct queue done;              // Finished jobs, for the submitter
+    int wake_fd;                    // Signalled when there is work to do
+    int done_fd;                    // Signalled when a job has finished
+    atomic_uint_fast64_t tickets;
+    atomic_size_t depth;            // Jobs submitted but not yet started
+    atomic_bool abort;              // Cut short the job in progress while
+                                    // suspending or stopping
+    atomic_uint_fast64_t abort_ticket;  // One past the ticket of the latest
+                                        // abort submitted, or zero
+    atomic_bool suspended;          // Start no more jobs for now
+    atomic_bool busy;               // A job may be in progress
+    atomic_bool stopping;
+};
+
+/**
+ * Creates an empty job of normal priority
+ *
+ * @return Returns the job on success or NULL otherwise
+ */
+struct job *job_create(void);
+
+/**
+ * Releases a job, its actions and its context
+ *
+ * @param[in] job The job to release
+ */
+void job_free(struct job *job);
+
+/**
+ * Starts a thread carrying out jobs against a launcher. The launcher
+ * belongs to the executor until it is stopped, except while it is
+ * suspended.
+ *
+ * @param[out] executor The executor to start
+ * @param[in,out] launcher The launcher to operate
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int executor_start(struct executor *executor, struct launcher *launcher);
+
+/**
+ * Cuts short the job in progress and stops an executor started by
+ * executor_start. Jobs that never finished are released.
+ *
+ * @param[in,out] executor The executor to stop
+ */
+void executor_stop(struct executor *executor);
+
+/**
+ * Queues a job to be carried out. Never blocks, so may be called from any
+ * thread at any time.
+ *
+ * @param[in,out] executor The executor to carry out the job
+ * @param[in] job The job, which belongs to the executor until collected
+ */
+void executor_submit(struct executor *executor, struct job *job);
+
+/**
+ * Cancels a job, which finishes straight away if it has not started yet and
+ * is cut short at its next status poll if it has. Either way it still comes
+ * back through executor_collect, having failed. The job must not have been
+ * collected yet.
+ *
+ * @param[in,out] job The job to cancel
+ */
+void executor_cancel(struct job *job);
+
+/**
+ * Takes back a finished job. Must only be called from one thread. Its
+ * done_fd becomes readable whenever there are jobs to collect, and should be
+ * drained with read before collecting.
+ *
+ * @param[in,out] executor The executor that carried out the job
+ *
+ * @return Returns the job, or NULL if none have finished
+ */
+struct job *executor_collect(struct executor *executor);
+
+/**
+ * Waits for the job in progress to finish, after which no more jobs are
+ * started until executor_resume is called. The launcher may be
+ * used by the caller in the meantime. Jobs submitted while suspended stay
+ * queued.
+ *
+ * @param[in,out] executor The executor to suspend
+ * @param[in] abort Whether to cut short the job in progress rather than let
+ *            it finish
+ */
+void executor_suspend(struct executor *executor, bool abort);
+
+/**
+ * Lets a suspended executor carry on with its queued jobs
+ *
+ * @param[in,out] executor The executor to resume
+ */
+void executor_resume(struct executor *executor);
+
+/**
+ * Counts the jobs waiting to be started
+ *
+ * @param[in] executor The executor to check
+ *
+ * @return Returns the number of jobs
+ */
+size_t executor_depth(struct executor *executor);
+
+#endif
@@ -0,0 +1,792 @@
+#include "fleet.h"
+#include "usb.h"
+#include "pathcache.h"
+#include "position.h"
+#include "realtime.h"
+#include <pthread.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/**
+ * Where the workers firing a salvo meet. The last worker to arrive picks a
+ * release deadline, and every worker sends its fire command then.
+ */
+struct salvo
+{
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+    size_t members;             // Workers taking part
+    size_t waiting;             // Workers ready for the next salvo
+    unsigned int round;         // Salvos released so far
+    uint64_t release;           // When the latest salvo fires
+    useconds_t lead;            // Time from the last worker arriving until
+                                // the release
+};
+
+/**
+ * The outcome of a single salvo on one device
+ */
+struct salvo_shot
+{
+    int result;
+    uint64_t release;           // When the salvo was meant to fire
+    uint64_t sent;              // When the fire command was written
+    uint64_t seen;              // When the first missile was reported fired,
+                                // or zero if none were
+};
+
+/**
+ * State belonging to the worker thread driving a single device
+ */
+struct fleet_worker
+{
+    pthread_t thread;
+    char *path;
+    struct launcher launcher;
+    const struct action *actions;
+    size_t count;
+    struct salvo *salvo;        // Where the fire actions synchronize, or
+                                // NULL to fire independently
+    struct salvo_shot *shots;   // One for each fire action in a salvo
+    struct retry_counts retry_counts;
+    char *state_path;           // Where this device's position is kept, or
+                                // NULL
+    int realtime_priority;      // SCHED_FIFO priority, or zero to run as an
+                                // ordinary thread
+    int realtime_cpu;           // The CPU to pin to in real-time mode
+    int result;
+};
+
+/**
+ * Status handler that prints a status read along with the device it came
+ * from, keeping the output of concurrent workers from interleaving
+ *
+ * @param[in] status The status byte read from the launcher
+ * @param[in] context The worker that performed the read
+ */
+static void show_device_status(uint8_t status, void *context)
+{
+    struct fleet_worker *worker = context;
+
+    flockfile(stdout);
+    printf("Device %s:\n", worker->path);
+    print_status_flags(status);
+    funlockfile(stdout);
+}
+
+/**
+ * Releases the salvo every member is waiting for. Must be called with the
+ * salvo locked.
+ *
+ * @param[in,out] salvo The salvo to release
+ */
+static void release_salvo(struct salvo *salvo)
+{
+    salvo->release = timing_now() + salvo->lead;
+    salvo->waiting = 0;
+    salvo->round++;
+    pthread_cond_broadcast(&salvo->released);
+}
+
+/**
+ * Waits for every member of a salvo to be ready to fire
+ *
+ * @param[in,out] salvo The salvo to wait for
+ *
+ * @return Returns when to fire (as timing_now)
+ */
+static uint64_t salvo_wait(struct salvo *salvo)
+{
+    uint64_t release;
+    unsigned int round;
+
+    pthread_mutex_lock(&salvo->lock);
+    round = salvo->round;
+
+    if (++salvo->waiting == salvo->members)
+    {
+        release_salvo(salvo);
+    }
+
+    while (salvo->round == round)
+    {
+        pthread_cond_wait(&salvo->released, &salvo->lock);
+    }
+
+    release = salvo->release;
+    pthread_mutex_unlock(&salvo->lock);
+
+    return release;
+}
+
+/**
+ * Drops a worker that never started from a salvo, so that the rest aren't
+ * left waiting for it
+ *
+ * @param[in,out] salvo The salvo to leave
+ */
+static void salvo_leave(struct salvo *salvo)
+{
+    pthread_mutex_lock(&salvo->lock);
+    salvo->members--;
+
+    if (salvo->waiting != 0 && salvo->waiting == salvo->members)
+    {
+        release_salvo(salvo);
+    }
+
+    pthread_mutex_unlock(&salvo->lock);
+}
+
+/**
+ * Stages a launcher for a salvo, waits for the others, and fires with them
+ *
+ * @param[in,out] worker The worker driving the launcher
+ * @param[in] action The fire action
+ * @param[out] shot Gets populated with the outcome
+ * @param[in] ready Whether the launcher is fit to fire, since it still has to
+ *            turn up for the salvo even if not
+ */
+static void fire_salvo(struct fleet_worker *worker,
+        const struct action *action, struct salvo_shot *shot, bool ready)
+{
+    uint8_t status;
+
+    // A status read shows the launcher is answering, and gets its transport
+    // going, so that the fire command is all that's left at the release
+    if (ready && get_status(&worker->launcher, &status) != 0)
+    {
+        fprintf(stderr, "Failed to stage salvo on device %s\n",
+                worker->path);
+        ready = false;
+    }
+
+    shot->result = -1;
+    shot->release = salvo_wait(worker->salvo);
+
+    if (ready)
+    {
+        shot->result = fire_volley_at(&worker->launcher,
+                action->shots ? action->shots : 1, shot->release);
+        shot->sent = worker->launcher.fire_sent;
+        shot->seen = worker->launcher.fire_seen;
+
+        if (shot->result != 0)
+        {
+            fprintf(stderr, "Failed to fire salvo on device %s\n",
+                    worker->path);
+        }
+    }
+}
+
+/**
+ * Carries out the actions on a single device, firing every fire action in a
+ * salvo with the other devices
+ *
+ * @param[in,out] worker The worker driving the device
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int run_salvos(struct fleet_worker *worker)
+{
+    int ret = 0;
+    size_t start = 0;
+    size_t salvos = 0;
+    size_t i;
+
+    for (i = 0; i <= worker->count; i++)
+    {
+        if (i < worker->count && worker->actions[i].type != ACTION_FIRE)
+        {
+            continue;
+        }
+
+        // The actions between salvos go ahead independently
+        if (ret == 0 && run_actions(&worker->launcher, &worker->actions[start],
+                    i - start, show_device_status, worker) != 0)
+        {
+            ret = -1;
+        }
+
+        if (i < worker->count)
+        {
+            fire_salvo(worker, &worker->actions[i], &worker->shots[salvos],
+                    ret == 0);
+
+            if (worker->shots[salvos++].result != 0)
+            {
+                ret = -1;
+            }
+        }
+
+        start = i + 1;
+    }
+
+    return ret;
+}
+
+/**
+ * Worker thread entry point. Carries out the actions on a single device.
+ *
+ * @param[in] arg The worker state
+ *
+ * @return Returns NULL always; the outcome is stored in the worker
+ */
+static void *fleet_worker_main(void *arg)
+{
+    struct fleet_worker *worker = arg;
+
+    // Each worker holds its own device's timing, so each gets a CPU of its
+    // own rather than sharing the command thread's
+    if (worker->realtime_priority != 0 &&
+            realtime_enter(worker->realtime_priority,
+                worker->realtime_cpu) != 0)
+    {
+        fprintf(stderr, "Failed to enter real-time mode on device %s\n",
+                worker->path);
+        worker->result = -1;
+
+        if (worker->salvo != NULL)
+        {
+            salvo_leave(worker->salvo);
+        }
+    }
+    else if (worker->salvo != NULL)
+    {
+        worker->result = run_salvos(worker);
+    }
+    else
+    {
+        worker->result = run_actions(&worker->launcher, worker->actions,
+                worker->count, show_device_status, worker);
+    }
+
+    return NULL;
+}
+
+/**
+ * Prints when each device fired in every salvo, relative to the release, and
+ * the spread between the devices
+ *
+ * @param[in] workers The workers that took part
+ * @param[in] worker_count The number of workers
+ * @param[in] salvos The number of salvos fired
+ */
+static void print_salvos(const struct fleet_worker *workers,
+        size_t worker_count, size_t salvos)
+{
+    size_t salvo;
+    size_t i;
+
+    for (salvo = 0; salvo < salvos; salvo++)
+    {
+        uint64_t first_sent = UINT64_MAX;
+        uint64_t last_sent = 0;
+        uint64_t first_seen = UINT64_MAX;
+        uint64_t last_seen = 0;
+
+        printf("Salvo %zu:\n", salvo + 1);
+
+        for (i = 0; i < worker_count; i++)
+        {
+            const struct salvo_shot *shot;
+
+            if (workers[i].shots == NULL)
+            {
+                continue;
+            }
+
+            shot = &workers[i].shots[salvo];
+
+            if (shot->sent == 0)
+            {
+                printf("  %-24s did not fire\n", workers[i].path);
+                continue;
+            }
+
+            first_sent = shot->sent < first_sent ? shot->sent : first_sent;
+            last_sent = shot->sent > last_sent ? shot->sent : last_sent;
+
+            if (shot->seen == 0)
+            {
+                printf("  %-24s sent %llu us after release, never fired\n",
+                        workers[i].path,
+                        (unsigned long long)(shot->sent - shot->release));
+                continue;
+            }
+
+            first_seen = shot->seen < first_seen ? shot->seen : first_seen;
+            last_seen = shot->seen > last_seen ? shot->seen : last_seen;
+            printf("  %-24s sent %llu us after release, fired after %.1f "
+                    "ms\n", workers[i].path,
+                    (unsigned long long)(shot->sent - shot->release),
+                    (shot->seen - shot->sent) / 1000.0);
+        }
+
+        if (last_sent != 0)
+        {
+            printf("  Skew between fire commands: %llu us\n",
+                    (unsigned long long)(last_sent - first_sent));
+        }
+
+        if (last_seen != 0)
+        {
+            printf("  Skew between first shots:   %llu us\n",
+                    (unsigned long long)(last_seen - first_seen));
+        }
+    }
+}
+
+int fleet_list(void)
+{
+    int ret = 0;
+    struct usb_device_info *devices;
+    struct usb_device_info *info;
+
+    devices = usb_enumerate();
+
+    if (devices == NULL)
+    {
+        fprintf(stderr, "No launchers found\n");
+        ret = -1;
+    }
+
+    for (info = devices; info != NULL; info = info->next)
+    {
+        printf("%-24s serial=%s product=%s\n", info->path, info->serial,
+                info->product);
+    }
+
+    usb_free_enumeration(devices);
+
+    return ret;
+}
+
+/**
+ * Works out the key a launcher's calibration is stored under
+ *
+ * @param[in] path The device path of the launcher
+ * @param[in] serial The serial number of the launcher, or NULL if unknown
+ *
+ * @return Returns the key, which the caller must free, or NULL on failure
+ */
+static char *calibration_key(const char *path, const char *serial)
+{
+    return strdup(serial != NULL && serial[0] != '\0' ? serial : path);
+}
+
+/**
+ * Works out where a launcher's position is kept between runs. Each launcher
+ * gets a file of its own next to the single-launcher state file, named
+ * after its calibration key with anything unsafe in a file name replaced.
+ *
+ * @param[in] state_path The single-launcher state file
+ * @param[in] key The launcher's calibration key
+ *
+ * @return Returns the path, which the caller must free, or NULL on failure
+ */
+static char *device_state_path(const char *state_path, const char *key)
+{
+    size_t length = strlen(state_path) + strlen(key) + 2;
+    char *path = malloc(length);
+    char *c;
+
+    if (path != NULL)
+    {
+        snprintf(path, length, "%s.%s", state_path, key);
+
+        for (c = path + strlen(state_path) + 1; *c != '\0'; c++)
+        {
+            if (!isalnum((unsigned char)*c) && *c != '-' && *c != '_')
+            {
+                *c = '_';
+            }
+        }
+    }
+
+    return path;
+}
+
+/**
+ * Opens the first attached launcher with a matching serial number, or just
+ * the first, by enumerating them
+ *
+ * @param[in] serial The serial number of the launcher, or NULL
+ * @param[out] key Gets populated with the launcher's calibration key, which
+ *             the caller must free
+ * @param[out] found Gets populated with the launcher's device path, which the
+ *             caller must free, or NULL if not wanted
+ *
+ * @return Returns a handle for use with usb_transport on success or NULL
+ *         otherwise
+ */
+static void *open_enumerated(const char *serial, char **key, char **found)
+{
+    void *device = NULL;
+    struct usb_device_info *devices = usb_enumerate();
+    struct usb_device_info *info;
+
+    for (info = devices; info != NULL; info = info->next)
+    {
+        if (serial == NULL || strcmp(info->serial, serial) == 0)
+        {
+            break;
+        }
+    }
+
+    if (info != NULL)
+    {
+        device = usb_open_path(info->path);
+        *key = calibration_key(info->path, info->serial);
+
+        if (found != NULL)
+        {
+            *found = strdup(info->path);
+        }
+    }
+
+    usb_free_enumeration(devices);
+
+    return device;
+}
+
+/**
+ * Opens a launcher at the path it was last found at, provided it is still
+ * the launcher that was asked for
+ *
+ * @param[in] path The cached device path
+ * @param[in] serial The serial number of the launcher, or NULL for any
+ * @param[out] key Gets populated with the launcher's calibration key, which
+ *             the caller must free
+ *
+ * @return Returns a handle for use with usb_transport on success or NULL
+ *         otherwise
+ */
+static void *open_cached(const char *path, const char *serial, char **key)
+{
+    void *device = usb_open_path(path);
+    char *found = device != NULL ? usb_get_serial(device) : NULL;
+
+    if (found != NULL && (serial == NULL || strcmp(found, serial) == 0))
+    {
+        *key = calibration_key(path, found);
+    }
+    else if (device != NULL)
+    {
+        usb_transport.close(device);
+        device = NULL;
+    }
+
+    free(found);
+
+    return device;
+}
+
+/**
+ * Makes sure an open launcher and its calibration key come as a pair,
+ * closing the launcher or releasing the key if the other is missing
+ *
+ * @param[in] device The open launcher, or NULL
+ * @param[in,out] key The launcher's calibration key, or NULL
+ *
+ * @return Returns the device, or NULL if either was missing
+ */
+static void *check_opened(void *device, char **key)
+{
+    if (device != NULL && *key == NULL)
+    {
+        usb_transport.close(device);
+        device = NULL;
+    }
+    else if (device == NULL)
+    {
+        free(*key);
+        *key = NULL;
+    }
+
+    return device;
+}
+
+void *fleet_open(const char *path, const char *serial, char **key)
+{
+    void *device = NULL;
+
+    *key = NULL;
+
+    if (path != NULL)
+    {
+        // A path is enough to open the launcher and to ask for its serial
+        // number, so there is nothing to enumerate. Paths that aren't
+        // launchers are still worth a try.
+        char *found;
+
+        device = usb_open_path(path);
+        found = device != NULL ? usb_get_serial(device) : NULL;
+        *key = device != NULL ? calibration_key(path, found) : NULL;
+        free(found);
+    }
+    else
+    {
+        device = open_enumerated(serial, key, NULL);
+    }
+
+    return check_opened(device, key);
+}
+
+void *fleet_open_cached(const char *cache_path, const char *path,
+        const char *serial, char **key)
+{
+    void *device = NULL;
+    char *cached = NULL;
+    char *found = NULL;
+
+    *key = NULL;
+
+    if (path != NULL)
+    {
+        device = fleet_open(path, serial, key);
+    }
+    else
+    {
+        // Enumerating is only worth it once the cached path has gone stale
+        cached = path_cache_lookup(cache_path, serial);
+
+        if (cached != NULL)
+        {
+            device = check_opened(open_cached(cached, serial, key), key);
+        }
+
+        if (device == NULL)
+        {
+            device = check_opened(open_enumerated(serial, key, &found), key);
+        }
+
+        if (device != NULL && found != NULL)
+        {
+            path_cache_store(cache_path, serial, found);
+        }
+    }
+
+    free(cached);
+    free(found);
+
+    return device;
+}
+
+int fleet_run(const struct launcher *settings,
+        const struct calibration_table *calibrations,
+        const struct action *actions, size_t count, useconds_t salvo_lead,
+        unsigned int retries, const char *state_path, int realtime_priority,
+        int realtime_cpu, bool print_stats, enum trace_format stats_format)
+{
+    int ret = 0;
+    struct usb_device_info *devices;
+    struct usb_device_info *info;
+    struct fleet_worker *workers;
+    struct salvo salvo;
+    size_t worker_count = 0;
+    size_t started = 0;
+    size_t salvos = 0;
+    size_t i;
+
+    for (i = 0; i < count && salvo_lead != 0; i++)
+    {
+        if (actions[i].type == ACTION_FIRE)
+        {
+            salvos++;
+        }
+    }
+
+    devices = usb_enumerate();
+
+    for (info = devices; info != NULL; info = info->next)
+    {
+        worker_count++;
+    }
+
+    workers = calloc(worker_count, sizeof(*workers));
+
+    if (worker_count == 0)
+    {
+        fprintf(stderr, "No launchers found\n");
+        ret = -1;
+    }
+    else if (workers == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        ret = -1;
+    }
+    else
+    {
+        // Open every device before starting any of them, so that all the
+        // workers begin as close together as possible
+        for (i = 0, info = devices; info != NULL; i++, info = info->next)
+        {
+            struct fleet_worker *worker = &workers[i];
+            void *device = usb_open_path(info->path);
+            char *key;
+
+            worker->path = strdup(info->path);
+            worker->actions = actions;
+            worker->count = count;
+            worker->result = -1;
+            worker->salvo = salvos != 0 ? &salvo : NULL;
+            worker->shots = salvos != 0 ?
+                calloc(salvos, sizeof(*worker->shots)) : NULL;
+            worker->launcher = *settings;
+            worker->launcher.transport = &usb_transport;
+            worker->realtime_priority = realtime_priority;
+            worker->realtime_cpu = realtime_priority != 0 ?
+                realtime_spread_cpu(realtime_cpu, i) : -1;
+
+            if (device != NULL && retries != 0)
+            {
+                device = retry_open(&usb_transport, device, retries,
+                        &worker->retry_counts);
+                worker->launcher.transport = &retry_transport;
+                worker->launcher.trace.retries = &worker->retry_counts;
+            }
+
+            worker->launcher.handle = device;
+
+            key = calibration_key(info->path, info->serial);
+
+            // Carry on from wherever the last run left this launcher, with
+            // measured rates taking precedence as they do for one launcher
+            if (key != NULL && state_path != NULL)
+            {
+                worker->state_path = device_state_path(state_path, key);
+            }
+
+            if (worker->state_path != NULL &&
+                    position_load(&worker->launcher.position,
+                        worker->state_path) != 0)
+            {
+                fprintf(stderr, "Ignoring saved position for device %s\n",
+                        info->path);
+                position_init(&worker->launcher.position);
+            }
+
+            if (key != NULL)
+            {
+                calibration_apply(calibrations, key,
+                        &worker->launcher.position);
+                free(key);
+            }
+
+            worker->launcher.state_path = worker->state_path;
+
+            if (device == NULL)
+            {
+                fprintf(stderr, "Failed to open device %s\n", info->path);
+                ret = -1;
+            }
+            else if (salvos != 0 && worker->shots == NULL)
+            {
+                fprintf(stderr, "Out of memory\n");
+                launcher_close(&worker->launcher);
+                ret = -1;
+            }
+            else
+            {
+                started++;
+            }
+        }
+
+        // Every open device takes part in the salvos, until it fails to start
+        pthread_mutex_init(&salvo.lock, NULL);
+        pthread_cond_init(&salvo.released, NULL);
+        salvo.members = started;
+        salvo.waiting = 0;
+        salvo.round = 0;
+        salvo.release = 0;
+        salvo.lead = salvo_lead;
+        started = 0;
+
+        for (i = 0; i < worker_count; i++)
+        {
+            if (workers[i].launcher.handle != NULL &&
+                    pthread_create(&workers[i].thread, NULL,
+                        fleet_worker_main, &workers[i]) != 0)
+            {
+                fprintf(stderr, "Failed to start worker for %s\n",
+                        workers[i].path);
+                launcher_close(&workers[i].launcher);
+                salvo_leave(&salvo);
+                ret = -1;
+            }
+            else if (workers[i].launcher.handle != NULL)
+            {
+                started++;
+            }
+        }
+
+        for (i = 0; i < worker_count; i++)
+        {
+            if (workers[i].launcher.handle != NULL)
+            {
+                pthread_join(workers[i].thread, NULL);
+
+                if (workers[i].state_path != NULL &&
+                        position_save(&workers[i].launcher.position,
+                            workers[i].state_path) != 0)
+                {
+                    ret = -1;
+                }
+
+                launcher_close(&workers[i].launcher);
+
+                if (workers[i].result != 0)
+                {
+                    fprintf(stderr, "Actions failed on device %s\n",
+                            workers[i].path);
+                    ret = -1;
+                }
+
+                if (workers[i].launcher.holds.enabled)
+                {
+                    printf("Device %s:\n", workers[i].path);
+                    hold_log_print(&workers[i].launcher.holds, stdout);
+                }
+
+                if (print_stats)
+                {
+                    trace_print(&workers[i].launcher.trace, stdout,
+                            stats_format, workers[i].path);
+                }
+                else if (realtime_priority != 0)
+                {
+                    fprintf(stderr, "Device %s: ", workers[i].path);
+                    trace_print_deadlines(&workers[i].launcher.trace, stderr);
+                }
+            }
+        }
+
+        if (salvos != 0 && started != 0)
+        {
+            print_salvos(workers, worker_count, salvos);
+        }
+
+        for (i = 0; i < worker_count; i++)
+        {
+            free(workers[i].shots);
+            free(workers[i].path);
+            free(workers[i].state_path);
+        }
+
+        pthread_mutex_destroy(&salvo.lock);
+        pthread_cond_destroy(&salvo.released);
+
+        if (started == 0)
+        {
+            ret = -1;
+        }
+    }
+
+    free(workers);
+    usb_free_enumeration(devices);
+
+    return ret;
+}
@@ -0,0 +1,95 @@
+#ifndef FLEET_H
+#define FLEET_H
+
+#include "action.h"
+#include "calibration.h"
+#include "retry.h"
+
+//
+// Default time from the last launcher being ready for a salvo until every
+// launcher fires, in milliseconds
+//
+#define DEFAULT_SALVO_LEAD_MS   50
+
+/**
+ * Prints the path, serial number and product name of every attached
+ * launcher
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int fleet_list(void);
+
+/**
+ * Opens a specific launcher, or the first one found if neither a path nor a
+ * serial number is given
+ *
+ * @param[in] path The device path of the launcher, or NULL
+ * @param[in] serial The serial number of the launcher, or NULL
+ * @param[out] key Gets populated with the launcher's calibration key, its
+ *             serial number or its path if it has none, which the caller
+ *             must free
+ *
+ * @return Returns a handle for use with usb_transport on success or NULL
+ *         otherwise
+ */
+void *fleet_open(const char *path, const char *serial, char **key);
+
+/**
+ * Opens a launcher as fleet_open does, but first tries the device path the
+ * launcher was last found at, only enumerating the attached launchers if
+ * that path no longer leads to it. Wherever an enumerated launcher is found
+ * is recorded for next time.
+ *
+ * @param[in] cache_path The path of the cache file described in pathcache.h
+ * @param[in] path The device path of the launcher, or NULL
+ * @param[in] serial The serial number of the launcher, or NULL
+ * @param[out] key Gets populated with the launcher's calibration key, which
+ *             the caller must free
+ *
+ * @return Returns a handle for use with usb_transport on success or NULL
+ *         otherwise
+ */
+void *fleet_open_cached(const char *cache_path, const char *path,
+        const char *serial, char **key);
+
+/**
+ * Carries out the same sequence of actions on every attached launcher at
+ * once, using one worker thread per device. Status reads are printed under
+ * a heading naming the device they came from.
+ *
+ * In a salvo every fire action is synchronized across the launchers. Each
+ * worker stages its launcher with a status read and waits for the rest, and
+ * once the last is ready they all send the fire command at the same
+ * absolute deadline, salvo_lead after that. The skew between the launchers'
+ * fire commands and first shots is printed for each salvo.
+ *
+ * @param[in] settings A launcher whose settings are copied to every device
+ * @param[in] calibrations The rates measured for each device
+ * @param[in] actions The actions to carry out
+ * @param[in] count The number of actions
+ * @param[in] salvo_lead Time from every launcher being ready to fire until
+ *            they all fire (in microseconds), or zero to let each launcher
+ *            fire as soon as it reaches its fire actions
+ * @param[in] retries The number of times each device's failed transfers are
+ *            tried again, or zero to give up straight away
+ * @param[in] state_path The single-launcher state file, next to which each
+ *            device's position is kept between runs, or NULL to keep none
+ * @param[in] realtime_priority The SCHED_FIFO priority each worker runs at
+ *            as realtime_enter describes, or zero to run them as ordinary
+ *            threads. The missed deadlines of each device are printed when
+ *            its trace summary isn't.
+ * @param[in] realtime_cpu The CPU the first worker is pinned to, or -1 for
+ *            the one running the caller, with the rest spread over the
+ *            others as realtime_spread_cpu describes
+ * @param[in] print_stats Whether to print each device's trace summary
+ * @param[in] stats_format The format of the trace summaries
+ *
+ * @return Returns zero if every device succeeded or non-zero otherwise
+ */
+int fleet_run(const struct launcher *settings,
+        const struct calibration_table *calibrations,
+        const struct action *actions, size_t count, useconds_t salvo_lead,
+        unsigned int retries, const char *state_path, int realtime_priority,
+        int realtime_cpu, bool print_stats, enum trace_format stats_format);
+
+#endif
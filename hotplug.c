@@ -0,0 +1,95 @@
+#include "hotplug.h"
+#include "launcher.h"
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+//
+// Largest event accepted from the kernel
+//
+#define HOTPLUG_BUFFER_SIZE 8192
+
+//
+// Multicast group the kernel sends its events to
+//
+#define KERNEL_EVENT_GROUP  1
+
+int hotplug_open(void)
+{
+    struct sockaddr_nl addr;
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+            NETLINK_KOBJECT_UEVENT);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = KERNEL_EVENT_GROUP;
+
+    if (fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to watch for hotplug events: %s\n",
+                strerror(errno));
+    }
+
+    return fd;
+}
+
+int hotplug_receive(int fd)
+{
+    int ret = HOTPLUG_NONE;
+    char buffer[HOTPLUG_BUFFER_SIZE];
+    const char *action = "";
+    const char *subsystem = "";
+    bool launcher = false;
+    ssize_t len = recv(fd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+    ssize_t i;
+
+    if (len > 0)
+    {
+        buffer[len] = '\0';
+    }
+
+    // The event is a header followed by KEY=VALUE strings, each terminated
+    for (i = 0; len > 0 && i < len; i += strlen(&buffer[i]) + 1)
+    {
+        const char *field = &buffer[i];
+        unsigned int bus;
+        unsigned int vendor;
+        unsigned int product;
+
+        if (strncmp(field, "ACTION=", 7) == 0)
+        {
+            action = field + 7;
+        }
+        else if (strncmp(field, "SUBSYSTEM=", 10) == 0)
+        {
+            subsystem = field + 10;
+        }
+        else if (sscanf(field, "PRODUCT=%x/%x/", &vendor, &product) == 2 ||
+                sscanf(field, "HID_ID=%x:%x:%x", &bus, &vendor,
+                    &product) == 3)
+        {
+            launcher = vendor == LAUNCHER_VID && product == LAUNCHER_PID;
+        }
+    }
+
+    if (strcmp(action, "add") == 0 &&
+            (launcher || strcmp(subsystem, "hidraw") == 0))
+    {
+        ret = HOTPLUG_ADDED;
+    }
+    else if (strcmp(action, "remove") == 0 && launcher)
+    {
+        ret = HOTPLUG_REMOVED;
+    }
+
+    return ret;
+}
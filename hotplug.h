@@ -0,0 +1,33 @@
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+//
+// What a hotplug event means for the launcher
+//
+#define HOTPLUG_NONE        0
+#define HOTPLUG_ADDED       1
+#define HOTPLUG_REMOVED     2
+
+/**
+ * Opens a socket that receives the kernel's device add and remove events
+ * (uevents), the same events udev acts on
+ *
+ * @return Returns the socket on success or -1 otherwise
+ */
+int hotplug_open(void);
+
+/**
+ * Receives one event from a hotplug socket and works out whether it
+ * concerns a launcher. USB and HID devices are matched against
+ * LAUNCHER_VID and LAUNCHER_PID, as 90-missile-launcher.rules does. A new
+ * hidraw node counts as an addition too, since it carries no IDs of its own
+ * and is what a launcher gets opened through.
+ *
+ * @param[in] fd The hotplug socket
+ *
+ * @return Returns HOTPLUG_ADDED if a launcher may have appeared,
+ *         HOTPLUG_REMOVED if one has gone away, or HOTPLUG_NONE otherwise
+ */
+int hotplug_receive(int fd);
+
+#endif
@@ -0,0 +1,837 @@
+#include "launcher.h"
+#include "position.h"
+#include "monitor.h"
+#include "recording.h"
+#include "status-page.h"
+#include "metrics.h"
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+
+//
+// Share of the predicted time to reach a limit switch spent polling at the
+// slowest rate, leaving the rest to absorb errors in the estimate
+//
+#define LIMIT_QUIET_SHARE   0.75
+
+/**
+ * Reads the current status byte, as get_status_timeout, along with when it
+ * was read
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[out] status Gets populated with the status byte from the launcher
+ * @param[in] timeout_ms The longest time to wait for the report, in
+ *            milliseconds, or -1 to wait indefinitely
+ * @param[out] timestamp Gets populated with when the status was read (as
+ *             timing_now)
+ *
+ * @return Returns zero on success, WAIT_TIMED_OUT if no report arrived in
+ *         time, or another non-zero value otherwise
+ */
+static int read_status(struct launcher *launcher, uint8_t *status,
+        int timeout_ms, uint64_t *timestamp)
+{
+    int ret = 0;
+
+    if (launcher->snapshot != NULL)
+    {
+        // Somebody else is polling the device, so the answer is already in
+        // memory, but it's no use if they've stopped keeping it current
+        if (snapshot_read(launcher->snapshot, status, timestamp) == 0 ||
+                timing_now() - *timestamp >
+                launcher->poll_max_interval + SNAPSHOT_MAX_AGE_US)
+        {
+            fprintf(stderr, "Status snapshot is out of date\n");
+            ret = -1;
+        }
+    }
+    else if (send_command(launcher, CMD_GET_STATUS) != 0)
+    {
+        // Send a request for a status report
+        fprintf(stderr, "Failed to send command to fetch status\n");
+        ret = -1;
+    }
+    else
+    {
+        // Read the input report
+        uint64_t start = timing_now();
+        int len = launcher->transport->read(launcher->handle, status,
+                sizeof(*status), timeout_ms);
+
+        *timestamp = timing_now();
+        trace_record(&launcher->trace, TRACE_READ, start, *timestamp);
+
+        if (len < 0)
+        {
+            fprintf(stderr, "Failed to read input report\n");
+            metrics_count(METRIC_READ_FAILURES);
+            ret = -1;
+        }
+        else if (len == 0)
+        {
+            ret = WAIT_TIMED_OUT;
+        }
+        else
+        {
+            if (launcher->recording != NULL)
+            {
+                recording_add(launcher->recording, RECORD_STATUS, *status,
+                        *timestamp);
+            }
+
+            if (launcher->status_page != NULL)
+            {
+                status_page_set_status(launcher->status_page, *status,
+                        *timestamp);
+            }
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * The progress of one axis of a movement
+ */
+struct axis_move
+{
+    enum movement movement;
+    uint8_t cmd;            // Direction bit for this axis
+    uint8_t limit;          // Limit switch that ends this axis early
+    useconds_t duration;    // Requested time to move
+    useconds_t elapsed;     // Time actually moved
+    bool active;
+    bool at_limit;
+};
+
+/**
+ * Prepares one axis of a movement, determining which command to send and
+ * which limit switch ends the movement early
+ *
+ * @param[out] axis The axis to prepare
+ * @param[in] movement The direction to move, or MOVEMENT_NONE to hold still
+ * @param[in] duration The time to move (in microseconds)
+ *
+ * @return Returns zero on success or non-zero if the movement is unknown
+ */
+static int axis_init(struct axis_move *axis, enum movement movement,
+        useconds_t duration)
+{
+    int ret = 0;
+
+    memset(axis, 0, sizeof(*axis));
+    axis->movement = movement;
+    axis->duration = duration;
+    axis->active = (movement != MOVEMENT_NONE);
+
+    switch (movement)
+    {
+        case MOVEMENT_NONE:                                                     break;
+        case MOVEMENT_TILT_UP:    axis->cmd = CMD_MOVE_UP;    axis->limit = STATUS_UP_LIMIT;    break;
+        case MOVEMENT_TILT_DOWN:  axis->cmd = CMD_MOVE_DOWN;  axis->limit = STATUS_DOWN_LIMIT;  break;
+        case MOVEMENT_PAN_LEFT:   axis->cmd = CMD_MOVE_LEFT;  axis->limit = STATUS_LEFT_LIMIT;  break;
+        case MOVEMENT_PAN_RIGHT:  axis->cmd = CMD_MOVE_RIGHT; axis->limit = STATUS_RIGHT_LIMIT; break;
+        default:
+              fprintf(stderr, "Unrecognized movement\n");
+              ret = -1;
+              break;
+    }
+
+    return ret;
+}
+
+/**
+ * Moves the turret along one or both axes at once. Both direction bits are
+ * sent in a single output report. When one axis finishes, either because
+ * its time is up or because it reached a limit switch, the report is
+ * updated to leave only the other running, and the turret stops when both
+ * are done.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in,out] axes The two axes to move, updated with their outcome
+ * @param[in] stop Whether to stop the turret once both axes are done, rather
+ *            than leaving it for the next move to take over
+ * @param[in] backoff Whether to poll less often while the estimate says no
+ *            limit switch can close yet, rather than at the poll interval
+ *            throughout
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int move_axes(struct launcher *launcher, struct axis_move axes[2],
+        bool stop, bool backoff)
+{
+    int ret = 0;
+    uint8_t cmd = axes[0].cmd | axes[1].cmd;
+    uint64_t start;
+    uint64_t quiet_until = backoff ? UINT64_MAX : 0;
+    int i;
+
+    // Send the movement command
+    if (send_command(launcher, cmd) != 0)
+    {
+        fprintf(stderr, "Failed to perform requested movement\n");
+        ret = -1;
+    }
+    else
+    {
+        start = timing_now();
+
+        // No limit switch is expected until the estimate says the turret is
+        // getting close to one, and wherever it is unknown one could close
+        // at any moment. A move that is being timed can't afford to see it
+        // late, so gets no quiet period at all.
+        for (i = 0; i < 2 && backoff; i++)
+        {
+            if (axes[i].active)
+            {
+                uint64_t quiet = start + (uint64_t)(LIMIT_QUIET_SHARE *
+                        limit_time(&launcher->position, axes[i].movement));
+
+                quiet_until = quiet < quiet_until ? quiet : quiet_until;
+            }
+        }
+
+        while (ret == 0 && cmd != 0)
+        {
+            uint64_t deadline = UINT64_MAX;
+            uint64_t now = timing_now();
+            uint8_t mask = 0;
+            uint8_t status = 0;
+            unsigned int polls;
+            int result = WAIT_TIMED_OUT;
+
+            for (i = 0; i < 2; i++)
+            {
+                if (axes[i].active)
+                {
+                    mask |= axes[i].limit;
+
+                    if (start + axes[i].duration < deadline)
+                    {
+                        deadline = start + axes[i].duration;
+                    }
+                }
+            }
+
+            // Move until the next axis is due to finish, or until the turret
+            // reaches the end of its travel along a moving axis
+            if (deadline > now)
+            {
+                result = wait_for_status(launcher, mask, deadline - now,
+                        quiet_until, &status, &polls);
+            }
+
+            if (result == WAIT_ABORTED)
+            {
+                fprintf(stderr, "Movement aborted\n");
+                ret = -1;
+            }
+            else if (result != 0 && result != WAIT_TIMED_OUT)
+            {
+                fprintf(stderr, "Failed to watch limit switches\n");
+                ret = -1;
+            }
+            else
+            {
+                uint8_t remaining = 0;
+                bool finished[2] = { false, false };
+
+                now = timing_now();
+
+                for (i = 0; i < 2; i++)
+                {
+                    if (axes[i].active && result == 0 &&
+                            (status & axes[i].limit))
+                    {
+                        axes[i].at_limit = true;
+                        finished[i] = true;
+                    }
+                    else if (axes[i].active && now >= start + axes[i].duration)
+                    {
+                        finished[i] = true;
+                    }
+                    else if (axes[i].active)
+                    {
+                        remaining |= axes[i].cmd;
+                    }
+                }
+
+                // Drop the finished axes, leaving any others running, or stop
+                // once none are left
+                if (remaining == 0 && stop)
+                {
+                    if (send_command(launcher, CMD_STOP) != 0)
+                    {
+                        fprintf(stderr, "Failed to stop movement\n");
+                        ret = -1;
+                    }
+                }
+                else if (remaining != cmd && remaining != 0)
+                {
+                    if (send_command(launcher, remaining) != 0)
+                    {
+                        fprintf(stderr, "Failed to update movement\n");
+                        ret = -1;
+                    }
+                }
+
+                cmd = remaining;
+                now = timing_now();
+
+                for (i = 0; i < 2; i++)
+                {
+                    if (finished[i])
+                    {
+                        axes[i].active = false;
+                        axes[i].elapsed = now - start;
+                    }
+                }
+            }
+        }
+
+        // Stop moving, even if watching the limits failed
+        if (cmd != 0 && send_command(launcher, CMD_STOP) != 0)
+        {
+            fprintf(stderr, "Failed to stop movement\n");
+        }
+
+        for (i = 0; i < 2; i++)
+        {
+            if (axes[i].movement == MOVEMENT_NONE)
+            {
+                continue;
+            }
+
+            // Anything still marked active ran right up to the stop
+            if (axes[i].active)
+            {
+                axes[i].elapsed = timing_now() - start;
+            }
+
+            position_update(&launcher->position, axes[i].movement,
+                    axes[i].elapsed, axes[i].at_limit);
+
+            // A move cut short by a limit switch isn't a timing error
+            if (!axes[i].at_limit)
+            {
+                hold_log_record(&launcher->holds, axes[i].cmd,
+                        axes[i].duration, axes[i].elapsed);
+            }
+        }
+
+        if (launcher->status_page != NULL)
+        {
+            status_page_set_position(launcher->status_page,
+                    &launcher->position, timing_now());
+        }
+    }
+
+    return ret;
+}
+
+void launcher_init(struct launcher *launcher,
+        const struct transport_ops *transport, void *handle)
+{
+    launcher->transport = transport;
+    launcher->handle = handle;
+    launcher->poll_interval = POLL_INTERVAL_US;
+    launcher->poll_max_interval = POLL_MAX_INTERVAL_US;
+    launcher->fire_timeout = FIRE_TIMEOUT_US;
+    launcher->fire_polls = 0;
+    launcher->fire_sent = 0;
+    launcher->fire_seen = 0;
+    launcher->state_path = NULL;
+    position_init(&launcher->position);
+    hold_log_init(&launcher->holds, false);
+    trace_init(&launcher->trace, false, NULL);
+    launcher->snapshot = NULL;
+    launcher->recording = NULL;
+    launcher->status_page = NULL;
+    launcher->abort = NULL;
+    launcher->cancel = NULL;
+    launcher->abort_ticket = NULL;
+    launcher->ticket = 0;
+}
+
+void launcher_close(struct launcher *launcher)
+{
+    if (launcher->handle != NULL)
+    {
+        launcher->transport->close(launcher->handle);
+        launcher->handle = NULL;
+    }
+}
+
+bool launcher_aborted(const struct launcher *launcher)
+{
+    return (launcher->abort != NULL &&
+            atomic_load_explicit(launcher->abort, memory_order_relaxed)) ||
+        (launcher->cancel != NULL &&
+         atomic_load_explicit(launcher->cancel, memory_order_relaxed)) ||
+        (launcher->abort_ticket != NULL &&
+         atomic_load_explicit(launcher->abort_ticket, memory_order_relaxed) >
+         launcher->ticket);
+}
+
+int launcher_get_fd(struct launcher *launcher)
+{
+    return launcher->transport->get_fd != NULL ?
+        launcher->transport->get_fd(launcher->handle) : -1;
+}
+
+int parse_movement(const char *name, enum movement *movement)
+{
+    int ret = 0;
+
+    if (strcmp(name, "up") == 0)
+        *movement = MOVEMENT_TILT_UP;
+    else if (strcmp(name, "down") == 0)
+        *movement = MOVEMENT_TILT_DOWN;
+    else if (strcmp(name, "left") == 0)
+        *movement = MOVEMENT_PAN_LEFT;
+    else if (strcmp(name, "right") == 0)
+        *movement = MOVEMENT_PAN_RIGHT;
+    else
+        ret = -1;
+
+    return ret;
+}
+
+int parse_diagonal(const char *name, enum movement *tilt, enum movement *pan)
+{
+    int ret = 0;
+    const char *separator = strchr(name, '-');
+    char tilt_name[8];
+
+    if (separator == NULL || separator - name >= (ptrdiff_t)sizeof(tilt_name))
+    {
+        ret = -1;
+    }
+    else
+    {
+        memcpy(tilt_name, name, separator - name);
+        tilt_name[separator - name] = '\0';
+
+        if (parse_movement(tilt_name, tilt) != 0 ||
+                parse_movement(separator + 1, pan) != 0 ||
+                (*tilt != MOVEMENT_TILT_UP && *tilt != MOVEMENT_TILT_DOWN) ||
+                (*pan != MOVEMENT_PAN_LEFT && *pan != MOVEMENT_PAN_RIGHT))
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int send_command(struct launcher *launcher, uint8_t cmd)
+{
+    int ret = 0;
+    uint8_t buf[2];
+    uint64_t start = timing_now();
+
+    buf[0] = 0;     // First byte is report number (always 0 for this device)
+    buf[1] = cmd;   // Second byte is report value (command)
+
+    // Write an output report to the device, unless it has gone away
+    if (launcher->handle == NULL)
+    {
+        fprintf(stderr, "Launcher is not connected\n");
+        ret = -1;
+    }
+    else if (launcher->transport->write(launcher->handle, buf,
+                sizeof(buf)) < 0)
+    {
+        fprintf(stderr, "Output report write failed\n");
+        metrics_count(METRIC_WRITE_FAILURES);
+        ret = -1;
+    }
+    else
+    {
+        metrics_count_command(cmd);
+
+        if (launcher->recording != NULL)
+        {
+            recording_add(launcher->recording, RECORD_COMMAND, cmd, start);
+        }
+
+        // Status polls would drown out the commands worth knowing about
+        if (launcher->status_page != NULL && cmd != CMD_GET_STATUS)
+        {
+            status_page_set_command(launcher->status_page, cmd, start);
+        }
+    }
+
+    trace_record(&launcher->trace, TRACE_WRITE, start, timing_now());
+
+    return ret;
+}
+
+int get_status(struct launcher *launcher, uint8_t *status)
+{
+    return get_status_timeout(launcher, status, -1);
+}
+
+int get_status_timeout(struct launcher *launcher, uint8_t *status,
+        int timeout_ms)
+{
+    uint64_t timestamp;
+
+    return read_status(launcher, status, timeout_ms, &timestamp);
+}
+
+/**
+ * Repeatedly reads the status byte from the launcher, no more often than the
+ * launcher's poll interval, until the requested bits are set or clear, or
+ * the timeout expires. Reads are spaced out to the longest poll interval
+ * while no change is expected, and when the status comes from a snapshot
+ * each read asks for the next one to be fresh in time.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] mask The status bits to wait on
+ * @param[in] set Whether to wait for any of the bits to be set, rather than
+ *            for all of them to be clear
+ * @param[in] timeout The longest time to wait (in microseconds)
+ * @param[in] quiet_until Until when the bits are not expected to change (as
+ *            timing_now), or zero if they could at any moment
+ * @param[out] status Gets populated with the last status byte read
+ * @param[out] polls Gets populated with the number of status reads made
+ *
+ * @return Returns zero once the bits reach the requested state,
+ *         WAIT_TIMED_OUT if the timeout expires first, WAIT_ABORTED if the
+ *         launcher is told to abort first, or another non-zero value on
+ *         failure
+ */
+static int wait_for_bits(struct launcher *launcher, uint8_t mask, bool set,
+        useconds_t timeout, uint64_t quiet_until, uint8_t *status,
+        unsigned int *polls)
+{
+    int ret = 0;
+    uint64_t now = timing_now();
+    uint64_t deadline = now + timeout;
+    uint64_t next_poll = now;
+    uint64_t start = now;
+    uint64_t last_read = now;
+    uint64_t timestamp;
+    bool done = false;
+
+    *polls = 0;
+    *status = 0;
+
+    while (ret == 0 && !done)
+    {
+        // Until a change is expected, read only often enough to catch the
+        // prediction being wrong
+        if (*polls == 0 || now >= quiet_until ||
+                now - last_read >= launcher->poll_max_interval)
+        {
+            // Don't let a missing report hold us past the deadline
+            int timeout_ms = (int)((deadline - now + 999) / 1000);
+            uint64_t next_read;
+
+            last_read = now;
+            ret = read_status(launcher, status, timeout_ms, &timestamp);
+            (*polls)++;
+
+            // A snapshot taken before the wait began can't reflect anything
+            // the caller just asked the launcher to do
+            done = ((*status & mask) != 0) == set && timestamp >= start;
+
+            next_read = last_read + launcher->poll_interval;
+
+            if (next_read < quiet_until)
+            {
+                next_read = last_read + launcher->poll_max_interval;
+                next_read = next_read < quiet_until ? next_read : quiet_until;
+            }
+
+            if (launcher->snapshot != NULL && ret == 0 && !done)
+            {
+                snapshot_request(launcher->snapshot, next_read);
+            }
+        }
+
+        if (ret == 0 && !done)
+        {
+            // Pace the polls rather than flooding the bus with requests
+            next_poll += launcher->poll_interval;
+            now = timing_now();
+
+            if (now < next_poll)
+            {
+                trace_sleep_until(&launcher->trace,
+                        next_poll < deadline ? next_poll : deadline);
+                now = timing_now();
+            }
+
+            // Once the deadline is reached there's no point in polling again
+            if (launcher_aborted(launcher))
+            {
+                ret = WAIT_ABORTED;
+            }
+            else if (now >= deadline)
+            {
+                ret = WAIT_TIMED_OUT;
+            }
+        }
+    }
+
+    return ret;
+}
+
+int wait_for_status(struct launcher *launcher, uint8_t mask,
+        useconds_t timeout, uint64_t quiet_until, uint8_t *status,
+        unsigned int *polls)
+{
+    return wait_for_bits(launcher, mask, true, timeout, quiet_until, status,
+            polls);
+}
+
+void print_status_flags(uint8_t status)
+{
+    printf("Tilt up limit:      %s\n"
+            "Tilt down limit:    %s\n"
+            "Pan left limit:     %s\n"
+            "Pan right limit:    %s\n"
+            "Fire complete:      %s\n",
+            (status & STATUS_UP_LIMIT)       ? "true" : "false",
+            (status & STATUS_DOWN_LIMIT)     ? "true" : "false",
+            (status & STATUS_LEFT_LIMIT)     ? "true" : "false",
+            (status & STATUS_RIGHT_LIMIT)    ? "true" : "false",
+            (status & STATUS_DEVICE_FIRED)   ? "true" : "false");
+}
+
+int print_status(struct launcher *launcher)
+{
+    int ret = 0;
+    uint8_t status;
+
+    if (get_status(launcher, &status) != 0)
+    {
+        fprintf(stderr, "Failed to retrieve status information\n");
+        ret = -1;
+    }
+    else
+    {
+        print_status_flags(status);
+    }
+
+    return ret;
+}
+
+int fire_missile(struct launcher *launcher)
+{
+    return fire_volley(launcher, 1);
+}
+
+int fire_volley(struct launcher *launcher, unsigned int shots)
+{
+    return fire_volley_at(launcher, shots, 0);
+}
+
+int fire_volley_at(struct launcher *launcher, unsigned int shots,
+        uint64_t release)
+{
+    int ret = 0;
+    unsigned int shot;
+    uint64_t cycle_start;
+
+    launcher->fire_polls = 0;
+    launcher->fire_seen = 0;
+
+    // Sleep most of the way, then spin so that waking late can't add skew
+    if (release != 0)
+    {
+        if (release > timing_now() + RELEASE_SPIN_US)
+        {
+            timing_sleep_until(release - RELEASE_SPIN_US);
+        }
+
+        timing_spin_until(release);
+    }
+
+    cycle_start = timing_now();
+    launcher->fire_sent = cycle_start;
+
+    if (send_command(launcher, CMD_FIRE) != 0)
+    {
+        fprintf(stderr, "Failed to perform requested movement\n");
+        ret = -1;
+    }
+
+    // Keep the fire command asserted throughout, counting each rising edge
+    // of the fired bit as a shot
+    for (shot = 0; shot < shots && ret == 0; shot++)
+    {
+        uint8_t status;
+        unsigned int polls = 0;
+        uint64_t wait_start = timing_now();
+        uint64_t deadline = wait_start + launcher->fire_timeout;
+
+        // After the first shot the bit is still set from the last one, so
+        // wait for it to clear before looking for the next edge
+        if (shot > 0)
+        {
+            ret = wait_for_bits(launcher, STATUS_DEVICE_FIRED, false,
+                    launcher->fire_timeout, 0, &status, &polls);
+            launcher->fire_polls += polls;
+        }
+
+        // Keep reading status until failure, timeout or we've completed firing
+        if (ret == 0)
+        {
+            uint64_t now = timing_now();
+
+            ret = now < deadline ?
+                wait_for_bits(launcher, STATUS_DEVICE_FIRED, true,
+                        deadline - now, 0, &status, &polls) : WAIT_TIMED_OUT;
+            launcher->fire_polls += polls;
+        }
+
+        trace_record(&launcher->trace, TRACE_FIRE_WAIT, wait_start,
+                timing_now());
+
+        // Each shot's cycle runs on from the end of the one before
+        if (ret == 0)
+        {
+            uint64_t fired = timing_now();
+
+            metrics_observe(METRIC_FIRE_CYCLE, fired - cycle_start);
+            cycle_start = fired;
+
+            if (shot == 0)
+            {
+                launcher->fire_seen = fired;
+            }
+        }
+
+        if (ret == WAIT_TIMED_OUT || ret == WAIT_ABORTED)
+        {
+            if (ret == WAIT_ABORTED)
+            {
+                fprintf(stderr, "Firing aborted after %u missiles\n", shot);
+            }
+            else
+            {
+                fprintf(stderr, "Timed out waiting for missile %u to fire "
+                        "after %u status polls\n", shot + 1,
+                        launcher->fire_polls);
+            }
+
+            // Don't leave the launcher cycling after giving up on it
+            send_command(launcher, CMD_STOP);
+            ret = -1;
+        }
+        else if (ret != 0)
+        {
+            fprintf(stderr, "Failed to get status\n");
+            ret = -1;
+        }
+    }
+
+    if (ret == 0)
+    {
+        uint64_t start = timing_now();
+
+        // Intentionally overshoot with the firing time to (hopefully)
+        // ensure that the last missile actually gets fired
+        trace_sleep_until(&launcher->trace, start + FIRE_HOLD_TIME_US);
+
+        // Stop firing
+        if (send_command(launcher, CMD_STOP) != 0)
+        {
+            fprintf(stderr, "Failed to stop firing\n");
+            ret = -1;
+        }
+
+        hold_log_record(&launcher->holds, CMD_FIRE, FIRE_HOLD_TIME_US,
+                timing_now() - start);
+    }
+
+    return ret;
+}
+
+/**
+ * Moves the turret in a single direction, as move_turret and
+ * move_turret_exact describe
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] movement The direction to move the turret
+ * @param[in] duration The time to move (in microseconds)
+ * @param[out] moved Gets populated with the time actually spent moving (in
+ *             microseconds), or may be NULL
+ * @param[in] backoff Whether to poll less often while no limit switch is
+ *            expected
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int move_single(struct launcher *launcher, enum movement movement,
+        useconds_t duration, useconds_t *moved, bool backoff)
+{
+    int ret = 0;
+    struct axis_move axes[2];
+
+    if (movement == MOVEMENT_NONE || axis_init(&axes[0], movement,
+                duration) != 0)
+    {
+        fprintf(stderr, "Unrecognized movement\n");
+        ret = -1;
+    }
+    else
+    {
+        axis_init(&axes[1], MOVEMENT_NONE, 0);
+        ret = move_axes(launcher, axes, true, backoff);
+    }
+
+    if (moved != NULL)
+    {
+        *moved = ret == 0 ? axes[0].elapsed : 0;
+    }
+
+    return ret;
+}
+
+int move_turret(struct launcher *launcher, enum movement movement,
+        useconds_t duration, useconds_t *moved)
+{
+    return move_single(launcher, movement, duration, moved, true);
+}
+
+int move_turret_exact(struct launcher *launcher, enum movement movement,
+        useconds_t duration, useconds_t *moved)
+{
+    return move_single(launcher, movement, duration, moved, false);
+}
+
+int move_turret_diagonal(struct launcher *launcher, enum movement tilt,
+        useconds_t tilt_duration, enum movement pan, useconds_t pan_duration)
+{
+    return move_turret_segment(launcher, tilt, tilt_duration, pan,
+            pan_duration, true);
+}
+
+int move_turret_segment(struct launcher *launcher, enum movement tilt,
+        useconds_t tilt_duration, enum movement pan, useconds_t pan_duration,
+        bool stop)
+{
+    int ret = 0;
+    struct axis_move axes[2];
+
+    if ((tilt != MOVEMENT_NONE && tilt != MOVEMENT_TILT_UP &&
+                tilt != MOVEMENT_TILT_DOWN) ||
+            (pan != MOVEMENT_NONE && pan != MOVEMENT_PAN_LEFT &&
+                pan != MOVEMENT_PAN_RIGHT) ||
+            (tilt == MOVEMENT_NONE && pan == MOVEMENT_NONE))
+    {
+        fprintf(stderr, "Unrecognized diagonal movement\n");
+        ret = -1;
+    }
+    else
+    {
+        axis_init(&axes[0], tilt, tilt_duration);
+        axis_init(&axes[1], pan, pan_duration);
+        ret = move_axes(launcher, axes, stop, true);
+    }
+
+    return ret;
+}
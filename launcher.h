@@ -0,0 +1,382 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include "timing.h"
+#include "transport.h"
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+//
+// USB vendor ID and product ID for missile launcher
+//
+#define LAUNCHER_VID        0x0a81
+#define LAUNCHER_PID        0x0701
+
+//
+// Output report values
+//
+#define CMD_MOVE_DOWN       0x01
+#define CMD_MOVE_UP         0x02
+#define CMD_MOVE_LEFT       0x04
+#define CMD_MOVE_RIGHT      0x08
+#define CMD_FIRE            0x10
+#define CMD_STOP            0x20
+#define CMD_GET_STATUS      0x40
+
+//
+// Input report values
+//
+#define STATUS_DOWN_LIMIT   0x01
+#define STATUS_UP_LIMIT     0x02
+#define STATUS_LEFT_LIMIT   0x04
+#define STATUS_RIGHT_LIMIT  0x08
+#define STATUS_DEVICE_FIRED 0x10
+
+//
+// Default delay times
+//
+#define MOVE_HOLD_TIME_US   100000
+#define FIRE_HOLD_TIME_US   500000
+#define POLL_INTERVAL_US    10000
+#define POLL_MAX_INTERVAL_US 200000
+#define FIRE_TIMEOUT_US     8000000
+
+//
+// Return values from wait_for_status when the deadline passes first, or
+// when the launcher is told to abort
+//
+#define WAIT_TIMED_OUT      1
+#define WAIT_ABORTED        2
+
+//
+// Time spent spinning on the clock rather than sleeping before a volley's
+// release deadline, in microseconds
+//
+#define RELEASE_SPIN_US     2000
+
+/**
+ * The movements that the missile launcher can perform
+ */
+enum movement
+{
+    MOVEMENT_NONE,
+    MOVEMENT_TILT_UP,
+    MOVEMENT_TILT_DOWN,
+    MOVEMENT_PAN_LEFT,
+    MOVEMENT_PAN_RIGHT,
+};
+
+/**
+ * Dead-reckoned estimate of where the turret is pointing. Angles are in
+ * degrees, measured from the left and down limits. Rates are in degrees per
+ * millisecond of movement in each direction.
+ */
+struct position
+{
+    bool pan_known;
+    bool tilt_known;
+    double pan;
+    double tilt;
+    double pan_range;
+    double tilt_range;
+    double left_rate;
+    double right_rate;
+    double up_rate;
+    double down_rate;
+};
+
+struct status_snapshot;
+struct status_page;
+struct recording;
+
+/**
+ * An open launcher along with the settings used to drive it
+ */
+struct launcher
+{
+    const struct transport_ops *transport;
+    void *handle;               // The backend's handle for the open device
+    useconds_t poll_interval;   // Time between status polls while a change
+                                // is expected
+    useconds_t poll_max_interval;   // Longest time between status polls
+                                    // while none is
+    useconds_t fire_timeout;    // Longest to wait for a shot to complete
+    unsigned int fire_polls;    // Status polls taken by the most recent shot
+    uint64_t fire_sent;         // When the most recent volley's fire command
+                                // was written
+    uint64_t fire_seen;         // When its first missile was reported fired,
+                                // or zero if none were
+    struct position position;   // Updated by every movement
+    const char *state_path;     // Where the position is persisted, or NULL
+    struct hold_log holds;      // Requested versus actual hold times
+    struct trace trace;         // Timings of every transfer and sleep
+    struct status_snapshot *snapshot;   // Where status reads come from
+                                        // instead of the device, or NULL
+    struct recording *recording;    // Where reports are logged, or NULL
+    struct status_page *status_page;    // Where the latest status, command
+                                        // and position are published, or
+                                        // NULL
+    const atomic_bool *abort;   // Set to cut short whatever the launcher is
+                                // doing, or NULL
+    const atomic_bool *cancel;  // Set to cut short the current request
+                                // alone, or NULL
+    const atomic_uint_fast64_t *abort_ticket;   // Raised past ticket to cut
+                                                // short the current request,
+                                                // or NULL
+    uint64_t ticket;            // Where the current request stands among
+                                // those abort_ticket counts
+};
+
+/**
+ * Prepares a launcher handle for an open device, using the default settings
+ *
+ * @param[out] launcher The handle to initialize
+ * @param[in] transport The backend used to reach the device
+ * @param[in] handle The backend's handle for the open device
+ */
+void launcher_init(struct launcher *launcher,
+        const struct transport_ops *transport, void *handle);
+
+/**
+ * Closes the device behind a launcher, if it is open
+ *
+ * @param[in,out] launcher The launcher to close
+ */
+void launcher_close(struct launcher *launcher);
+
+/**
+ * Checks whether a launcher has been told to abort what it is doing, or to
+ * cancel the request it is carrying out, or whether a later request has
+ * overtaken it
+ *
+ * @param[in] launcher The launcher to check
+ *
+ * @return Returns true if the launcher should stop as soon as it can
+ */
+bool launcher_aborted(const struct launcher *launcher);
+
+/**
+ * Gets a file descriptor that reports when the launcher's device has input
+ * waiting or has gone away, if its transport has one
+ *
+ * @param[in] launcher The launcher to query
+ *
+ * @return Returns the file descriptor, or -1 if there is none
+ */
+int launcher_get_fd(struct launcher *launcher);
+
+/**
+ * Converts a movement name (up, down, left or right) into a movement
+ *
+ * @param[in] name The name of the movement
+ * @param[out] movement Gets populated with the corresponding movement
+ *
+ * @return Returns zero on success or non-zero if the name is not recognized
+ */
+int parse_movement(const char *name, enum movement *movement);
+
+/**
+ * Converts a diagonal movement name, written as a tilt direction and a pan
+ * direction joined by a hyphen (such as up-left), into its two movements
+ *
+ * @param[in] name The name of the diagonal movement
+ * @param[out] tilt Gets populated with the tilt movement
+ * @param[out] pan Gets populated with the pan movement
+ *
+ * @return Returns zero on success or non-zero if the name is not recognized
+ */
+int parse_diagonal(const char *name, enum movement *tilt, enum movement *pan);
+
+/**
+ * Sends a command to the launcher
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] cmd The command to send to the launcher
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int send_command(struct launcher *launcher, uint8_t cmd);
+
+/**
+ * Reads the current status byte from the launcher
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[out] status Gets populated with the status byte from the launcher
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int get_status(struct launcher *launcher, uint8_t *status);
+
+/**
+ * Reads the current status byte from the launcher, waiting a bounded time
+ * for the report. When the launcher has a status snapshot the latest
+ * published status is returned instead, without touching the device.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[out] status Gets populated with the status byte from the launcher
+ * @param[in] timeout_ms The longest time to wait for the report, in
+ *            milliseconds, or -1 to wait indefinitely
+ *
+ * @return Returns zero on success, WAIT_TIMED_OUT if no report arrived in
+ *         time, or another non-zero value otherwise
+ */
+int get_status_timeout(struct launcher *launcher, uint8_t *status,
+        int timeout_ms);
+
+/**
+ * Repeatedly reads the status byte from the launcher, no more often than the
+ * launcher's poll interval, until any of the requested bits are set or the
+ * timeout expires. Each read waits for the input report with a bounded
+ * timeout, so a device that stops responding cannot block forever. While no
+ * change is expected the reads are spaced out to the launcher's longest poll
+ * interval, though aborts are still noticed as quickly as before.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] mask The status bits to wait for
+ * @param[in] timeout The longest time to wait (in microseconds)
+ * @param[in] quiet_until Until when none of the bits are expected to be set
+ *            (as timing_now), or zero if they could be at any moment
+ * @param[out] status Gets populated with the last status byte read
+ * @param[out] polls Gets populated with the number of status reads made
+ *
+ * @return Returns zero once a requested bit is set, WAIT_TIMED_OUT if the
+ *         timeout expires first, WAIT_ABORTED if the launcher is told to
+ *         abort first, or another non-zero value on failure
+ */
+int wait_for_status(struct launcher *launcher, uint8_t mask,
+        useconds_t timeout, uint64_t quiet_until, uint8_t *status,
+        unsigned int *polls);
+
+/**
+ * Prints the fields of a previously retrieved status byte
+ *
+ * @param[in] status The status byte to print
+ */
+void print_status_flags(uint8_t status);
+
+/**
+ * Reads and prints the current status fields from the device
+ *
+ * @param[in] launcher The launcher to operate
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int print_status(struct launcher *launcher);
+
+/**
+ * Fires a single missile from the launcher. Gives up if the launcher does not
+ * report the shot within its fire timeout, and records the number of status
+ * polls taken in fire_polls.
+ *
+ * @param[in] launcher The launcher to operate
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int fire_missile(struct launcher *launcher);
+
+/**
+ * Fires several missiles in a row. The fire command stays asserted for the
+ * whole volley and each rising edge of the fired bit counts as one shot, so
+ * the launcher is only stopped, and the overshoot only paid, after the last
+ * one. Each shot gets its own fire timeout, and the status polls taken by
+ * the whole volley are recorded in fire_polls.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] shots The number of missiles to fire
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int fire_volley(struct launcher *launcher, unsigned int shots);
+
+/**
+ * Fires a volley as fire_volley does, but holds the fire command back until
+ * an absolute deadline. The last RELEASE_SPIN_US before it are spent spinning
+ * on the clock, so the command goes out within microseconds of the deadline
+ * whatever the scheduler does. When the command was written and when the
+ * first missile was reported fired are recorded in fire_sent and fire_seen.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] shots The number of missiles to fire
+ * @param[in] release When to send the fire command (as timing_now), or zero
+ *            to send it straight away
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int fire_volley_at(struct launcher *launcher, unsigned int shots,
+        uint64_t release);
+
+/**
+ * Moves the turret in the requested direction for the specified amount of
+ * time. The limit switches are polled while moving, and the movement stops
+ * early if the turret reaches the end of its travel in that direction. The
+ * launcher's position estimate is updated to match.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] movement The direction to move the turret
+ * @param[in] duration The time to move (in microseconds)
+ * @param[out] moved Gets populated with the time actually spent moving (in
+ *             microseconds), or may be NULL
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int move_turret(struct launcher *launcher, enum movement movement,
+        useconds_t duration, useconds_t *moved);
+
+/**
+ * Moves the turret as move_turret does, but polls the limit switches at the
+ * poll interval from the start, rather than less often while the position
+ * estimate says none can close yet. The time moved is then accurate to a
+ * poll interval, as timing a sweep between the limits needs.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] movement The direction to move the turret
+ * @param[in] duration The time to move (in microseconds)
+ * @param[out] moved Gets populated with the time actually spent moving (in
+ *             microseconds), or may be NULL
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int move_turret_exact(struct launcher *launcher, enum movement movement,
+        useconds_t duration, useconds_t *moved);
+
+/**
+ * Moves the turret along both axes at once, for a separate time on each.
+ * Both direction bits are sent in a single output report, and the shorter
+ * axis is dropped from the report when it finishes. Each axis stops early if
+ * it reaches its limit switch, and the position estimate is updated to
+ * match.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] tilt The tilt direction, or MOVEMENT_NONE
+ * @param[in] tilt_duration The time to tilt (in microseconds)
+ * @param[in] pan The pan direction, or MOVEMENT_NONE
+ * @param[in] pan_duration The time to pan (in microseconds)
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int move_turret_diagonal(struct launcher *launcher, enum movement tilt,
+        useconds_t tilt_duration, enum movement pan, useconds_t pan_duration);
+
+/**
+ * Moves the turret as move_turret_diagonal does, but can leave the motors
+ * running at the end instead of sending CMD_STOP. A move that follows
+ * straight on then replaces the direction bits without a stop in between,
+ * saving a report and a motor spin-down. A caller that doesn't stop must
+ * follow up with another move or a CMD_STOP.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] tilt The tilt direction, or MOVEMENT_NONE
+ * @param[in] tilt_duration The time to tilt (in microseconds)
+ * @param[in] pan The pan direction, or MOVEMENT_NONE
+ * @param[in] pan_duration The time to pan (in microseconds)
+ * @param[in] stop Whether to stop the turret at the end of the move
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int move_turret_segment(struct launcher *launcher, enum movement tilt,
+        useconds_t tilt_duration, enum movement pan, useconds_t pan_duration,
+        bool stop);
+
+#endif
@@ -0,0 +1,512 @@
+#include "metrics.h"
+#include "udp.h"
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The running totals of one histogram
+ */
+struct metric_distribution
+{
+    atomic_uint_fast64_t buckets[METRIC_BUCKETS];   // Not cumulative
+    atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;                       // Microseconds
+};
+
+/**
+ * The metrics recorded by a single thread. Only the owning thread writes to
+ * a shard, so updates need no read-modify-write and never contend, while
+ * readers sum every shard for a consistent enough view of each value.
+ * Shards outlive their threads so that no counts are lost.
+ */
+struct metrics_shard
+{
+    atomic_uint_fast64_t commands[METRIC_OPCODES];
+    atomic_uint_fast64_t counters[METRIC_COUNTER_COUNT];
+    struct metric_distribution histograms[METRIC_HISTOGRAM_COUNT];
+    struct metrics_shard *next;
+};
+
+/**
+ * Upper bounds of the finite buckets of each histogram, in microseconds
+ */
+static const uint64_t metric_bounds[METRIC_HISTOGRAM_COUNT][METRIC_BUCKETS] =
+{
+    [METRIC_FIRE_CYCLE] = { 500000, 1000000, 1500000, 2000000, 2500000,
+        3000000, 3500000, 4000000, 5000000, 7500000 },
+    [METRIC_HOLD_ERROR] = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+        50000, 100000 },
+};
+
+/**
+ * How each metric is named and described in the exposition format
+ */
+static const char *opcode_names[METRIC_OPCODES] =
+{
+    "move_down", "move_up", "move_left", "move_right", "fire", "stop",
+    "get_status",
+};
+
+static const char *counter_ops[METRIC_COUNTER_COUNT] =
+{
+    [METRIC_WRITE_FAILURES] = "write",
+    [METRIC_READ_FAILURES] = "read",
+};
+
+static const char *histogram_names[METRIC_HISTOGRAM_COUNT][2] =
+{
+    [METRIC_FIRE_CYCLE] = { "fire_cycle_seconds",
+        "Time from a fire command, or the previous shot, until a shot" },
+    [METRIC_HOLD_ERROR] = { "hold_error_seconds",
+        "Absolute difference between requested and actual hold times" },
+};
+
+static const char *gauge_names[METRIC_GAUGE_COUNT][2] =
+{
+    [METRIC_QUEUE_DEPTH] = { "queue_depth",
+        "Requests waiting when the daemon last looked" },
+    [METRIC_POLL_RATE] = { "status_poll_rate",
+        "Status polls per second made by the background reader" },
+};
+
+/**
+ * Whether metrics are being collected
+ */
+static atomic_bool metrics_enabled;
+
+/**
+ * Every shard created so far, newest first
+ */
+static _Atomic(struct metrics_shard *) metrics_shards;
+
+/**
+ * The latest value of each gauge
+ */
+static atomic_int_fast64_t metrics_gauges[METRIC_GAUGE_COUNT];
+
+/**
+ * The calling thread's shard, created on first use
+ */
+static _Thread_local struct metrics_shard *local_shard;
+
+/**
+ * Looks up the calling thread's shard, creating and publishing it if need
+ * be
+ *
+ * @return Returns the shard, or NULL if metrics are disabled or memory ran
+ *         out
+ */
+static struct metrics_shard *metrics_local(void)
+{
+    struct metrics_shard *shard = local_shard;
+
+    if (shard == NULL &&
+            atomic_load_explicit(&metrics_enabled, memory_order_relaxed))
+    {
+        shard = calloc(1, sizeof(*shard));
+
+        if (shard != NULL)
+        {
+            shard->next = atomic_load(&metrics_shards);
+
+            while (!atomic_compare_exchange_weak(&metrics_shards,
+                        &shard->next, shard))
+            {
+            }
+
+            local_shard = shard;
+        }
+    }
+
+    return shard;
+}
+
+/**
+ * Adds to a value that only the calling thread writes
+ *
+ * @param[in,out] value The value to add to
+ * @param[in] amount The amount to add
+ */
+static void shard_add(atomic_uint_fast64_t *value, uint64_t amount)
+{
+    atomic_store_explicit(value,
+            atomic_load_explicit(value, memory_order_relaxed) + amount,
+            memory_order_relaxed);
+}
+
+void metrics_enable(void)
+{
+    atomic_store(&metrics_enabled, true);
+}
+
+void metrics_count_command(uint8_t cmd)
+{
+    struct metrics_shard *shard = metrics_local();
+    unsigned int bit;
+
+    for (bit = 0; shard != NULL && bit < METRIC_OPCODES; bit++)
+    {
+        if (cmd & (1 << bit))
+        {
+            shard_add(&shard->commands[bit], 1);
+        }
+    }
+}
+
+void metrics_count(enum metric_counter counter)
+{
+    struct metrics_shard *shard = metrics_local();
+
+    if (shard != NULL)
+    {
+        shard_add(&shard->counters[counter], 1);
+    }
+}
+
+void metrics_observe(enum metric_histogram histogram, uint64_t value)
+{
+    struct metrics_shard *shard = metrics_local();
+    unsigned int bucket = 0;
+
+    if (shard != NULL)
+    {
+        struct metric_distribution *distribution =
+            &shard->histograms[histogram];
+
+        while (bucket < METRIC_BUCKETS &&
+                value > metric_bounds[histogram][bucket])
+        {
+            bucket++;
+        }
+
+        // Values past the last bound only appear in the count
+        if (bucket < METRIC_BUCKETS)
+        {
+            shard_add(&distribution->buckets[bucket], 1);
+        }
+
+        shard_add(&distribution->count, 1);
+        shard_add(&distribution->sum, value);
+    }
+}
+
+void metrics_set(enum metric_gauge gauge, int64_t value)
+{
+    if (atomic_load_explicit(&metrics_enabled, memory_order_relaxed))
+    {
+        atomic_store_explicit(&metrics_gauges[gauge], value,
+                memory_order_relaxed);
+    }
+}
+
+/**
+ * Reads a value from a shard
+ *
+ * @param[in] value The value to read
+ *
+ * @return Returns the value
+ */
+static uint64_t shard_read(atomic_uint_fast64_t *value)
+{
+    return atomic_load_explicit(value, memory_order_relaxed);
+}
+
+void metrics_print(FILE *out)
+{
+    struct metrics_shard *first = atomic_load(&metrics_shards);
+    struct metrics_shard *shard;
+    unsigned int i;
+    unsigned int j;
+
+    fprintf(out, "# HELP missile_launcher_commands_total Commands sent to "
+            "the launcher, by opcode bit\n"
+            "# TYPE missile_launcher_commands_total counter\n");
+
+    for (i = 0; i < METRIC_OPCODES; i++)
+    {
+        uint64_t total = 0;
+
+        for (shard = first; shard != NULL; shard = shard->next)
+        {
+            total += shard_read(&shard->commands[i]);
+        }
+
+        fprintf(out, "missile_launcher_commands_total{opcode=\"%s\"} %llu\n",
+                opcode_names[i], (unsigned long long)total);
+    }
+
+    fprintf(out, "# HELP missile_launcher_transport_failures_total Reports "
+            "the transport failed to transfer\n"
+            "# TYPE missile_launcher_transport_failures_total counter\n");
+
+    for (i = 0; i < METRIC_COUNTER_COUNT; i++)
+    {
+        uint64_t total = 0;
+
+        for (shard = first; shard != NULL; shard = shard->next)
+        {
+            total += shard_read(&shard->counters[i]);
+        }
+
+        fprintf(out, "missile_launcher_transport_failures_total{op=\"%s\"} "
+                "%llu\n", counter_ops[i], (unsigned long long)total);
+    }
+
+    for (i = 0; i < METRIC_HISTOGRAM_COUNT; i++)
+    {
+        const char *name = histogram_names[i][0];
+        uint64_t cumulative = 0;
+        uint64_t count = 0;
+        uint64_t sum = 0;
+
+        fprintf(out, "# HELP missile_launcher_%s %s\n"
+                "# TYPE missile_launcher_%s histogram\n",
+                name, histogram_names[i][1], name);
+
+        for (j = 0; j < METRIC_BUCKETS; j++)
+        {
+            for (shard = first; shard != NULL; shard = shard->next)
+            {
+                cumulative += shard_read(&shard->histograms[i].buckets[j]);
+            }
+
+            fprintf(out, "missile_launcher_%s_bucket{le=\"%g\"} %llu\n", name,
+                    metric_bounds[i][j] / 1e6, (unsigned long long)cumulative);
+        }
+
+        for (shard = first; shard != NULL; shard = shard->next)
+        {
+            count += shard_read(&shard->histograms[i].count);
+            sum += shard_read(&shard->histograms[i].sum);
+        }
+
+        // Counts are read separately from the buckets, so make sure a value
+        // added in between can't leave the total short of them
+        if (count < cumulative)
+        {
+            count = cumulative;
+        }
+
+        fprintf(out, "missile_launcher_%s_bucket{le=\"+Inf\"} %llu\n"
+                "missile_launcher_%s_sum %.6f\n"
+                "missile_launcher_%s_count %llu\n",
+                name, (unsigned long long)count, name, sum / 1e6, name,
+                (unsigned long long)count);
+    }
+
+    for (i = 0; i < METRIC_GAUGE_COUNT; i++)
+    {
+        const char *name = gauge_names[i][0];
+
+        fprintf(out, "# HELP missile_launcher_%s %s\n"
+                "# TYPE missile_launcher_%s gauge\n"
+                "missile_launcher_%s %lld\n",
+                name, gauge_names[i][1], name, name,
+                (long long)atomic_load_explicit(&metrics_gauges[i],
+                    memory_order_relaxed));
+    }
+}
+
+/**
+ * Reads the monotonic clock in milliseconds. The metrics server keeps to
+ * real time even while the launcher runs on the virtual clock.
+ *
+ * @return Returns the current monotonic time, in milliseconds
+ */
+static int64_t monotonic_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Reads the head of an HTTP request and answers it with the metrics. Only
+ * the request line matters, since there is only one thing to serve.
+ *
+ * @param[in] fd The client's socket
+ */
+static void serve_scrape(int fd)
+{
+    char request[MAX_METRICS_REQUEST];
+    size_t length = 0;
+    char *body = NULL;
+    size_t body_length = 0;
+    FILE *out;
+    struct pollfd poll_fd = { fd, POLLIN, 0 };
+    bool complete = false;
+    int64_t deadline = monotonic_ms() + METRICS_TIMEOUT_MS;
+    int64_t remaining = METRICS_TIMEOUT_MS;
+
+    // Wait for the end of the headers, but never for long. The time allowed
+    // covers the whole request, so that a client trickling it in a byte at
+    // a time can't hold up the scrapes queued behind it.
+    while (!complete && length < sizeof(request) - 1 && remaining > 0 &&
+            poll(&poll_fd, 1, (int)remaining) > 0)
+    {
+        ssize_t len = recv(fd, request + length,
+                sizeof(request) - 1 - length, 0);
+
+        if (len <= 0)
+        {
+            break;
+        }
+
+        length += len;
+        request[length] = '\0';
+        complete = strstr(request, "\r\n\r\n") != NULL ||
+            strstr(request, "\n\n") != NULL;
+        remaining = deadline - monotonic_ms();
+    }
+
+    out = open_memstream(&body, &body_length);
+
+    if (!complete)
+    {
+        // Nothing worth answering
+    }
+    else if (out != NULL && strncmp(request, "GET ", 4) == 0)
+    {
+        metrics_print(out);
+        fclose(out);
+        out = NULL;
+        dprintf(fd, "HTTP/1.0 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: %zu\r\n"
+                "Connection: close\r\n\r\n", body_length);
+        send(fd, body, body_length, MSG_NOSIGNAL);
+    }
+    else
+    {
+        dprintf(fd, "HTTP/1.0 405 Method Not Allowed\r\n"
+                "Content-Length: 0\r\n"
+                "Connection: close\r\n\r\n");
+    }
+
+    if (out != NULL)
+    {
+        fclose(out);
+    }
+
+    free(body);
+}
+
+/**
+ * Body of the metrics server thread
+ *
+ * @param[in] context The metrics_server
+ *
+ * @return Returns NULL
+ */
+static void *metrics_thread(void *context)
+{
+    struct metrics_server *server = context;
+    struct pollfd fds[2] =
+    {
+        { server->listen_fd, POLLIN, 0 },
+        { server->stop_fds[0], POLLIN, 0 },
+    };
+
+    while (poll(fds, 2, -1) >= 0 || errno == EINTR)
+    {
+        if (fds[1].revents != 0)
+        {
+            break;
+        }
+        else if (fds[0].revents & POLLIN)
+        {
+            int fd = accept4(server->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            struct timeval timeout = { 0, METRICS_TIMEOUT_MS * 1000 };
+
+            if (fd >= 0)
+            {
+                // A client that stops reading mustn't hold up the next one
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                        sizeof(timeout));
+                serve_scrape(fd);
+                close(fd);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+int metrics_serve_start(struct metrics_server *server, const char *address)
+{
+    int ret = 0;
+
+    server->running = false;
+    server->stop_fds[0] = -1;
+    server->stop_fds[1] = -1;
+    server->listen_fd = inet_open(address, SOCK_STREAM);
+
+    if (server->listen_fd < 0)
+    {
+        ret = -1;
+    }
+    else if (listen(server->listen_fd, SOMAXCONN) != 0 ||
+            pipe2(server->stop_fds, O_CLOEXEC) != 0)
+    {
+        fprintf(stderr, "Failed to listen on %s: %s\n", address,
+                strerror(errno));
+        ret = -1;
+    }
+    else
+    {
+        metrics_enable();
+
+        if (pthread_create(&server->thread, NULL, metrics_thread,
+                    server) != 0)
+        {
+            fprintf(stderr, "Failed to start metrics thread\n");
+            ret = -1;
+        }
+        else
+        {
+            server->running = true;
+        }
+    }
+
+    if (ret != 0)
+    {
+        metrics_serve_stop(server);
+    }
+
+    return ret;
+}
+
+void metrics_serve_stop(struct metrics_server *server)
+{
+    if (server->running && write(server->stop_fds[1], "", 1) == 1)
+    {
+        pthread_join(server->thread, NULL);
+    }
+
+    if (server->stop_fds[0] >= 0)
+    {
+        close(server->stop_fds[0]);
+        close(server->stop_fds[1]);
+    }
+
+    if (server->listen_fd >= 0)
+    {
+        close(server->listen_fd);
+    }
+
+    server->running = false;
+    server->listen_fd = -1;
+    server->stop_fds[0] = -1;
+    server->stop_fds[1] = -1;
+}
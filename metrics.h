@@ -0,0 +1,135 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//
+// Number of command opcode bits counted, one for each CMD_* value
+//
+#define METRIC_OPCODES      7
+
+//
+// Number of finite buckets in each histogram
+//
+#define METRIC_BUCKETS      10
+
+//
+// Longest request accepted by the metrics endpoint, in bytes, and how long
+// a client gets to send all of it, in milliseconds
+//
+#define MAX_METRICS_REQUEST 4096
+#define METRICS_TIMEOUT_MS  1000
+
+/**
+ * Events counted by the metrics
+ */
+enum metric_counter
+{
+    METRIC_WRITE_FAILURES,      // Output reports the transport failed to send
+    METRIC_READ_FAILURES,       // Input reports the transport failed to read
+    METRIC_COUNTER_COUNT,
+};
+
+/**
+ * Durations whose distribution is kept by the metrics, all in microseconds
+ */
+enum metric_histogram
+{
+    METRIC_FIRE_CYCLE,          // From CMD_FIRE, or the previous shot, until
+                                // STATUS_DEVICE_FIRED is seen
+    METRIC_HOLD_ERROR,          // Difference between a requested and actual
+                                // hold
+    METRIC_HISTOGRAM_COUNT,
+};
+
+/**
+ * Values sampled by the metrics, where only the latest one matters
+ */
+enum metric_gauge
+{
+    METRIC_QUEUE_DEPTH,         // Requests waiting when the daemon last
+                                // looked
+    METRIC_POLL_RATE,           // Status polls per second made by the
+                                // background reader
+    METRIC_GAUGE_COUNT,
+};
+
+/**
+ * A thread serving the metrics as text over HTTP
+ */
+struct metrics_server
+{
+    pthread_t thread;
+    bool running;
+    int listen_fd;
+    int stop_fds[2];            // Pipe written to ask the thread to stop
+};
+
+/**
+ * Starts collecting metrics. Until this is called every recording function
+ * returns straight away, so runs that never report metrics pay nothing for
+ * them.
+ */
+void metrics_enable(void);
+
+/**
+ * Counts a command sent to a launcher under each opcode bit it carries
+ *
+ * @param[in] cmd The command byte
+ */
+void metrics_count_command(uint8_t cmd);
+
+/**
+ * Counts an event
+ *
+ * @param[in] counter What happened
+ */
+void metrics_count(enum metric_counter counter);
+
+/**
+ * Adds a duration to a histogram
+ *
+ * @param[in] histogram The histogram to add to
+ * @param[in] value The duration (in microseconds)
+ */
+void metrics_observe(enum metric_histogram histogram, uint64_t value);
+
+/**
+ * Sets the latest value of a gauge
+ *
+ * @param[in] gauge The gauge to set
+ * @param[in] value Its value
+ */
+void metrics_set(enum metric_gauge gauge, int64_t value);
+
+/**
+ * Prints every metric in the Prometheus text exposition format, summed
+ * across all threads
+ *
+ * @param[in] out The stream to print to
+ */
+void metrics_print(FILE *out);
+
+/**
+ * Enables metrics and starts a thread answering every HTTP request on a
+ * network address with metrics_print's output. Scrapes are served away from
+ * the command path, which never waits on them.
+ *
+ * @param[out] server The server to start
+ * @param[in] address The address to listen on, as accepted by inet_open
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int metrics_serve_start(struct metrics_server *server, const char *address);
+
+/**
+ * Stops a server started by metrics_serve_start
+ *
+ * @param[in,out] server The server to stop
+ */
+void metrics_serve_stop(struct metrics_server *server);
+
+#endif
@@ -1,5 +1,15 @@
-#include <hidapi.h>
-#include <unistd.h>
+#include "launcher.h"
+#include "daemon.h"
+#include "script.h"
+#include "fleet.h"
+#include "usb.h"
+#include "position.h"
+#include "recording.h"
+#include "calibration.h"
+#include "realtime.h"
+#include "status-page.h"
+#include "retry.h"
+#include "pathcache.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -7,38 +17,6 @@
 #include <stdint.h>
 #include <argp.h>
 
-//
-// USB vendor ID and product ID for missile launcher
-//
-#define LAUNCHER_VID        0x0a81
-#define LAUNCHER_PID        0x0701
-
-//
-// Output report values
-//
-#define CMD_MOVE_DOWN       0x01
-#define CMD_MOVE_UP         0x02
-#define CMD_MOVE_LEFT       0x04
-#define CMD_MOVE_RIGHT      0x08
-#define CMD_FIRE            0x10
-#define CMD_STOP            0x20
-#define CMD_GET_STATUS      0x40
-
-//
-// Input report values
-//
-#define STATUS_DOWN_LIMIT   0x01
-#define STATUS_UP_LIMIT     0x02
-#define STATUS_LEFT_LIMIT   0x04
-#define STATUS_RIGHT_LIMIT  0x08
-#define STATUS_DEVICE_FIRED 0x10
-
-//
-// Default delay times
-//
-#define MOVE_HOLD_TIME_US   100000
-#define FIRE_HOLD_TIME_US   500000
-
 /**
  * Version information string
  */
@@ -56,27 +34,75 @@ static char doc[] =
     "USB missile launcher application for Dream Cheeky's Rocket Baby device. ";
 
 /**
- * Command-line options supported by this application
+ * Keys for options that have no short form
  */
-static struct argp_option options[] =
+enum long_option
 {
-    { "move",       'm', "DIR",     0,  "Move the turret in the requested direction. Must be one of up, down, left, or right" },
-    { "time",       't', "TIME",    0,  "The duration for moving the requested direction, in milliseconds" },
-    { "fire",       'f', 0,         0,  "Fire the turret" },
-    { "status",     'p', 0,         0,  "Print out status information" },
-    { 0 }
+    OPTION_STATE = 0x100,
+    OPTION_SPIN,
+    OPTION_HOLDS,
+    OPTION_TRACE,
+    OPTION_STATS,
+    OPTION_UDP,
+    OPTION_RECORD,
+    OPTION_REPLAY,
+    OPTION_TARGET,
+    OPTION_CALIBRATE,
+    OPTION_CALIBRATION,
+    OPTION_REALTIME,
+    OPTION_CPU,
+    OPTION_GRACE,
+    OPTION_METRICS,
+    OPTION_ABORT,
+    OPTION_SHM,
+    OPTION_SALVO,
+    OPTION_POLL_MAX,
+    OPTION_RETRIES,
+    OPTION_DEVICE_CACHE,
 };
 
 /**
- * The movements that the missile launcher can perform
+ * Command-line options supported by this application
  */
-enum movement
+static struct argp_option options[] =
 {
-    MOVEMENT_NONE,
-    MOVEMENT_TILT_UP,
-    MOVEMENT_TILT_DOWN,
-    MOVEMENT_PAN_LEFT,
-    MOVEMENT_PAN_RIGHT,
+    { "move",       'm', "DIR",     0,  "Move the turret in the requested direction. Must be one of up, down, left, or right, or a tilt and pan joined by a hyphen (such as up-left) to move diagonally" },
+    { "time",       't', "TIME",    0,  "The duration for moving the requested direction, in milliseconds. Diagonal moves accept TILT,PAN for a separate time on each axis" },
+    { "fire",       'f', "COUNT",   OPTION_ARG_OPTIONAL, "Fire the turret, or fire COUNT missiles in a single volley (given as --fire=COUNT or -fCOUNT)" },
+    { "status",     'p', 0,         0,  "Print out status information" },
+    { "abort",      OPTION_ABORT, 0, 0,  "Stop the turret before any other actions. A daemon cuts short whatever it is doing and cancels the requests still waiting" },
+    { "home",       'H', 0,         0,  "Drive the turret to its left and down limits so that its position is known" },
+    { "goto",       'g', "PAN,TILT", 0, "Move the turret to an absolute position, in degrees from the left and down limits" },
+    { "target",     OPTION_TARGET, "PAN,TILT", 0, "Move to an absolute position and fire. May be repeated, and the targets are engaged in whichever order is quickest" },
+    { "state",      OPTION_STATE, "FILE", 0, "Where the position estimate is kept between runs (default " DEFAULT_STATE_PATH "). With --all, each launcher's is kept in FILE.KEY, after its serial number or its path if it has none" },
+    { "calibrate",  OPTION_CALIBRATE, 0, 0,  "Measure the turret's rate of travel in each direction by sweeping between its limit switches, and store the rates for this launcher before any other actions" },
+    { "calibration", OPTION_CALIBRATION, "FILE", 0, "Where the rates measured for each launcher are kept (default " DEFAULT_CALIBRATION_PATH ")" },
+    { "script",     's', "FILE",    0,  "Run the actions listed in FILE ('-' for standard input) after any others requested" },
+    { "poll-interval", 'i', "TIME", 0,  "The time between status polls while waiting on the device for a change that could come at any moment, in milliseconds" },
+    { "poll-max",   OPTION_POLL_MAX, "TIME", 0, "The longest time between status polls while no change is expected, such as far from a limit switch or while a daemon is idle, in milliseconds (default 200)" },
+    { "fire-timeout", 'T', "TIME",  0,  "The longest time to wait for a missile to fire, in milliseconds" },
+    { "retries",    OPTION_RETRIES, "COUNT", 0, "How many times a failed transfer is tried again, backing off between tries, before giving up (default 2). Zero gives up straight away" },
+    { "list",       'l', 0,         0,  "List the attached launchers" },
+    { "device",     'd', "PATH",    0,  "Use the launcher with the given device path" },
+    { "serial",     'n', "SERIAL",  0,  "Use the launcher with the given serial number" },
+    { "device-cache", OPTION_DEVICE_CACHE, "FILE", 0, "Where the device path each launcher was last found at is kept, so that it can be opened without searching for it (default " DEFAULT_PATH_CACHE_PATH ")" },
+    { "all",        'a', 0,         0,  "Perform the actions on every attached launcher at once" },
+    { "salvo",      OPTION_SALVO, "LEAD", OPTION_ARG_OPTIONAL, "With --all, fire every launcher at the same moment, LEAD milliseconds (default 50) after the last one is ready, and report the skew between them" },
+    { "spin",       OPTION_SPIN, "TIME", 0, "Spin on the clock for the last TIME microseconds of every hold, for tighter timing at the cost of CPU" },
+    { "realtime",   OPTION_REALTIME, "PRIORITY", OPTION_ARG_OPTIONAL, "Lock memory, run at SCHED_FIFO PRIORITY (default 50) and pin to one CPU for deterministic hold timing, reporting any missed deadlines on exit" },
+    { "cpu",        OPTION_CPU, "CPU", 0,    "The CPU that --realtime pins to (default the one it starts on); with --all, the CPU of the first launcher, the rest taking the CPUs after it" },
+    { "holds",      OPTION_HOLDS, 0, 0,      "Print the requested and actual time of every hold on exit" },
+    { "trace",      OPTION_TRACE, 0, 0,      "Log the time taken by every transfer and sleep to standard error as it happens" },
+    { "stats",      OPTION_STATS, "FORMAT", OPTION_ARG_OPTIONAL, "Print the count, total, min, mean and max time of each kind of transfer and sleep on exit, as text (the default) or json" },
+    { "record",     OPTION_RECORD, "FILE", 0, "Log every command sent and status read, with its timing, to FILE" },
+    { "replay",     OPTION_REPLAY, "FILE", 0, "Send the commands logged by --record to FILE again with the same timing, before any other actions" },
+    { "daemon",     'D', 0,         0,  "Keep the device open and serve commands from other invocations" },
+    { "socket",     'S', "PATH",    0,  "The socket used to reach the daemon (default " DEFAULT_SOCKET_PATH ")" },
+    { "udp",        OPTION_UDP, "ADDRESS", 0, "While serving as a daemon, also take binary commands over UDP on ADDRESS, given as [HOST:]PORT; HOST defaults to 127.0.0.1, so use 0.0.0.0 or [::] to accept remote commands" },
+    { "metrics",    OPTION_METRICS, "ADDRESS", 0, "While serving as a daemon, also serve Prometheus metrics over HTTP on ADDRESS, given as [HOST:]PORT; HOST defaults to 127.0.0.1" },
+    { "shm",        OPTION_SHM, "NAME", OPTION_ARG_OPTIONAL, "While serving as a daemon, publish the status, position and latest command in shared memory under NAME (default " DEFAULT_STATUS_PAGE "). With --status, read them from there instead of opening the device" },
+    { "grace",      OPTION_GRACE, "TIME", 0, "While serving as a daemon, how long requests wait for an unplugged launcher to come back before failing, in milliseconds" },
+    { 0 }
 };
 
 /**
@@ -87,8 +113,47 @@ struct arguments
 {
     enum movement movement;
     useconds_t movement_duration;
+    enum movement pan_movement;
+    useconds_t pan_duration;
     bool fire;
+    uint8_t shots;
     bool display_status;
+    bool abort;
+    bool home;
+    bool go_to;
+    int16_t target_pan;
+    int16_t target_tilt;
+    struct action_list targets;
+    const char *state_path;
+    bool calibrate;
+    const char *calibration_path;
+    const char *script_path;
+    useconds_t poll_interval;
+    useconds_t poll_max_interval;
+    useconds_t fire_timeout;
+    unsigned int retries;
+    useconds_t spin;
+    bool realtime;
+    int realtime_priority;
+    int realtime_cpu;
+    bool print_holds;
+    bool trace;
+    bool print_stats;
+    enum trace_format stats_format;
+    bool list_devices;
+    const char *device_path;
+    const char *serial;
+    const char *device_cache_path;
+    bool all_devices;
+    useconds_t salvo_lead;
+    bool daemon;
+    const char *socket_path;
+    const char *udp_address;
+    const char *metrics_address;
+    const char *status_page;
+    useconds_t grace_period;
+    const char *record_path;
+    const char *replay_path;
 };
 
 /**
@@ -110,15 +175,11 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
     switch (key)
     {
         case 'm':
-            if (strcmp(arg, "up") == 0)
-                arguments->movement = MOVEMENT_TILT_UP;
-            else if (strcmp(arg, "down") == 0)
-                arguments->movement = MOVEMENT_TILT_DOWN;
-            else if (strcmp(arg, "left") == 0)
-                arguments->movement = MOVEMENT_PAN_LEFT;
-            else if (strcmp(arg, "right") == 0)
-                arguments->movement = MOVEMENT_PAN_RIGHT;
-            else
+            arguments->pan_movement = MOVEMENT_NONE;
+
+            if (parse_movement(arg, &arguments->movement) != 0 &&
+                    parse_diagonal(arg, &arguments->movement,
+                        &arguments->pan_movement) != 0)
             {
                 fprintf(stderr, "Invalid movement: %s\n", arg);
                 argp_usage(state);
@@ -126,29 +187,272 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
             break;
         case 'f':
             arguments->fire = true;
+            arguments->shots = 1;
+
+            if (arg != NULL && parse_shots(arg, &arguments->shots) != 0)
+            {
+                fprintf(stderr, "Invalid missile count: %s\n", arg);
+                argp_usage(state);
+            }
             break;
         case 't':
+            if (parse_durations(arg, &arguments->movement_duration,
+                        &arguments->pan_duration) != 0)
+            {
+                fprintf(stderr, "Invalid duration specified\n");
+                argp_usage(state);
+            }
+            break;
+        case 'p':
+            arguments->display_status = true;
+            break;
+        case 'H':
+            arguments->home = true;
+            break;
+        case 'g':
+            if (parse_target(arg, &arguments->target_pan,
+                        &arguments->target_tilt) != 0)
+            {
+                fprintf(stderr, "Invalid position: %s\n", arg);
+                argp_usage(state);
+            }
+            arguments->go_to = true;
+            break;
+        case OPTION_TARGET:
         {
-            unsigned long duration_ms;
+            struct action action;
+
+            memset(&action, 0, sizeof(action));
+            action.type = ACTION_TARGET;
+            action.shots = 1;
+
+            if (parse_target(arg, &action.pan, &action.tilt) != 0)
+            {
+                fprintf(stderr, "Invalid position: %s\n", arg);
+                argp_usage(state);
+            }
+            else if (action_list_add(&arguments->targets, &action) != 0)
+            {
+                fprintf(stderr, "Failed to add target\n");
+                ret = ENOMEM;
+            }
+        }
+        break;
+        case OPTION_STATE:
+            arguments->state_path = arg;
+            break;
+        case OPTION_DEVICE_CACHE:
+            arguments->device_cache_path = arg;
+            break;
+        case OPTION_CALIBRATE:
+            arguments->calibrate = true;
+            break;
+        case OPTION_CALIBRATION:
+            arguments->calibration_path = arg;
+            break;
+        case 's':
+            arguments->script_path = arg;
+            break;
+        case 'i':
+            if (parse_duration(arg, &arguments->poll_interval) != 0)
+            {
+                fprintf(stderr, "Invalid poll interval specified\n");
+                argp_usage(state);
+            }
+            break;
+        case OPTION_POLL_MAX:
+            if (parse_duration(arg, &arguments->poll_max_interval) != 0)
+            {
+                fprintf(stderr, "Invalid maximum poll interval specified\n");
+                argp_usage(state);
+            }
+            break;
+        case 'T':
+            if (parse_duration(arg, &arguments->fire_timeout) != 0)
+            {
+                fprintf(stderr, "Invalid fire timeout specified\n");
+                argp_usage(state);
+            }
+            break;
+        case OPTION_RETRIES:
+        {
+            unsigned long retries;
             char *endptr;
 
-            duration_ms = strtoul(arg, &endptr, 0);
-            
-            // Check for a valid numeric argument
-            if (arg != '\0' && *endptr == '\0' && duration_ms < 10000)
+            retries = strtoul(arg, &endptr, 0);
+
+            if (*arg != '\0' && *endptr == '\0' && retries <= MAX_RETRIES)
             {
-                arguments->movement_duration = duration_ms * 1000;
+                arguments->retries = retries;
             }
             else
             {
-                fprintf(stderr, "Invalid duration specified\n");
+                fprintf(stderr, "Invalid retry count specified\n");
                 argp_usage(state);
             }
         }
         break;
-            
-        case 'p':
-            arguments->display_status = true;
+        case OPTION_SPIN:
+        {
+            unsigned long spin;
+            char *endptr;
+
+            spin = strtoul(arg, &endptr, 0);
+
+            if (*arg != '\0' && *endptr == '\0' && spin < MOVE_HOLD_TIME_US)
+            {
+                arguments->spin = spin;
+            }
+            else
+            {
+                fprintf(stderr, "Invalid spin time specified\n");
+                argp_usage(state);
+            }
+        }
+        break;
+        case OPTION_REALTIME:
+        case OPTION_CPU:
+        {
+            long value = 0;
+            char *endptr = NULL;
+
+            if (arg != NULL)
+            {
+                value = strtol(arg, &endptr, 0);
+            }
+
+            if (arg != NULL && (*arg == '\0' || *endptr != '\0' ||
+                        value < 0 || value > INT16_MAX))
+            {
+                fprintf(stderr, "Invalid %s specified\n",
+                        key == OPTION_CPU ? "CPU" : "priority");
+                argp_usage(state);
+            }
+            else if (key == OPTION_CPU)
+            {
+                arguments->realtime_cpu = (int)value;
+            }
+            else
+            {
+                arguments->realtime = true;
+                arguments->realtime_priority = arg != NULL ?
+                    (int)value : DEFAULT_REALTIME_PRIORITY;
+            }
+        }
+        break;
+        case OPTION_HOLDS:
+            arguments->print_holds = true;
+            break;
+        case OPTION_TRACE:
+            arguments->trace = true;
+            break;
+        case OPTION_STATS:
+            if (arg != NULL &&
+                    parse_trace_format(arg, &arguments->stats_format) != 0)
+            {
+                fprintf(stderr, "Invalid stats format: %s\n", arg);
+                argp_usage(state);
+            }
+            arguments->print_stats = true;
+            break;
+        case 'l':
+            arguments->list_devices = true;
+            break;
+        case 'd':
+            arguments->device_path = arg;
+            break;
+        case 'n':
+            arguments->serial = arg;
+            break;
+        case 'a':
+            arguments->all_devices = true;
+            break;
+        case 'D':
+            arguments->daemon = true;
+            break;
+        case 'S':
+            arguments->socket_path = arg;
+            break;
+        case OPTION_UDP:
+            arguments->udp_address = arg;
+            break;
+        case OPTION_ABORT:
+            arguments->abort = true;
+            break;
+        case OPTION_METRICS:
+            arguments->metrics_address = arg;
+            break;
+        case OPTION_SALVO:
+            arguments->salvo_lead = DEFAULT_SALVO_LEAD_MS * 1000;
+
+            if (arg != NULL && (parse_duration(arg,
+                            &arguments->salvo_lead) != 0 ||
+                        arguments->salvo_lead == 0))
+            {
+                fprintf(stderr, "Invalid salvo lead time: %s\n", arg);
+                argp_usage(state);
+            }
+            break;
+        case OPTION_SHM:
+            arguments->status_page = arg != NULL ? arg : DEFAULT_STATUS_PAGE;
+            break;
+        case OPTION_GRACE:
+            if (parse_duration(arg, &arguments->grace_period) != 0)
+            {
+                fprintf(stderr, "Invalid grace period specified\n");
+                argp_usage(state);
+            }
+            break;
+        case OPTION_RECORD:
+            arguments->record_path = arg;
+            break;
+        case OPTION_REPLAY:
+            arguments->replay_path = arg;
+            break;
+        case ARGP_KEY_END:
+            if (arguments->all_devices && (arguments->daemon ||
+                        arguments->device_path || arguments->serial))
+            {
+                argp_error(state, "--all cannot be combined with --daemon, "
+                        "--device or --serial");
+            }
+            else if (arguments->salvo_lead != 0 && !arguments->all_devices)
+            {
+                argp_error(state, "--salvo can only be used with --all");
+            }
+            else if ((arguments->udp_address || arguments->metrics_address) &&
+                    !arguments->daemon)
+            {
+                argp_error(state, "--udp and --metrics can only be used with "
+                        "--daemon");
+            }
+            else if (arguments->status_page && !arguments->daemon &&
+                    !arguments->display_status)
+            {
+                argp_error(state, "--shm can only be used with --status or "
+                        "--daemon");
+            }
+            else if ((arguments->record_path || arguments->replay_path) &&
+                    (arguments->daemon || arguments->all_devices))
+            {
+                argp_error(state, "--record and --replay cannot be combined "
+                        "with --daemon or --all");
+            }
+            else if (arguments->poll_max_interval < arguments->poll_interval)
+            {
+                argp_error(state, "--poll-max cannot be shorter than "
+                        "--poll-interval");
+            }
+            else if (arguments->realtime_cpu >= 0 && !arguments->realtime)
+            {
+                argp_error(state, "--cpu can only be used with --realtime");
+            }
+            else if (arguments->calibrate &&
+                    (arguments->daemon || arguments->all_devices))
+            {
+                argp_error(state, "--calibrate cannot be combined with "
+                        "--daemon or --all");
+            }
             break;
         case ARGP_KEY_ARG:
             if (state->arg_num >= 0)
@@ -170,193 +474,177 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state)
 static struct argp argp = { options, parse_opt, NULL, doc };
 
 /**
- * Sends a command to the launcher
+ * What the daemon needs to find its launcher again after it goes away
+ */
+struct reopen_context
+{
+    const struct arguments *arguments;
+    const char *key;                // The calibration key it was opened with
+    struct retry_counts *retry_counts;  // Where failed transfers are counted
+};
+
+/**
+ * Reopens the launcher the daemon was started on, preferring the one with
+ * the same serial number since a replugged launcher usually gets a new path
  *
- * @param[in] device The HID device corresponding to the launcher
- * @param[in] cmd The command to send to the launcher
+ * @param[in] context The reopen_context
  *
- * @return Returns zero on success or non-zero otherwise
+ * @return Returns a handle for use with the launcher's transport on success
+ *         or NULL otherwise
  */
-static int send_command(hid_device *device, uint8_t cmd)
+static void *reopen_device(void *context)
 {
-    int ret = 0;
-    uint8_t buf[2];
+    const struct reopen_context *reopen = context;
+    char *key = NULL;
+    void *device = fleet_open(NULL, reopen->key, &key);
 
-    buf[0] = 0;     // First byte is report number (always 0 for this device)
-    buf[1] = cmd;   // Second byte is report value (command)
+    if (device == NULL)
+    {
+        device = fleet_open(reopen->arguments->device_path,
+                reopen->arguments->serial, &key);
+    }
 
-    // Write an output report to the device
-    if (hid_write(device, buf, sizeof(buf)) < 0)
+    if (device != NULL && reopen->arguments->retries != 0)
     {
-        fprintf(stderr, "Output report write failed\n");
-        ret = -1;
+        device = retry_open(&usb_transport, device,
+                reopen->arguments->retries, reopen->retry_counts);
     }
 
-    return ret;
+    free(key);
+
+    return device;
+}
+
+/**
+ * Status handler that prints each status read to standard output
+ *
+ * @param[in] status The status byte read from the launcher
+ * @param[in] context Unused
+ */
+static void show_status(uint8_t status, void *context)
+{
+    print_status_flags(status);
+
+    // Whoever is reading a pipe gets the report now rather than on exit
+    fflush(stdout);
 }
 
 /**
- * Reads the current status byte from the launcher
+ * Prints the status a daemon publishes in shared memory, without going
+ * through the daemon or the device
  *
- * @param[in] device The HID device corresponding to the launcher
- * @param[out] status Gets populated with the status byte from the launcher
+ * @param[in] name The name of the shared memory object
  *
  * @return Returns zero on success or non-zero otherwise
  */
-static int get_status(hid_device *device, uint8_t *status)
+static int show_status_page(const char *name)
 {
     int ret = 0;
+    struct status_view view;
+    const struct status_page *page = status_page_open(name);
 
-    // Send a request for a status report
-    if (send_command(device, CMD_GET_STATUS)!= 0)
+    if (page == NULL)
     {
-        fprintf(stderr, "Failed to send command to fetch status\n");
         ret = -1;
     }
     else
     {
-        // Read the input report
-        if (hid_read(device, status, sizeof(*status)) < 0)
+        if (status_page_read(page, &view) != 0)
         {
-            fprintf(stderr, "Failed to read input report\n");
             ret = -1;
         }
+        else
+        {
+            status_view_print(&view);
+        }
+
+        status_page_close(page);
     }
 
     return ret;
 }
 
 /**
- * Reads and prints the current status fields from the device
+ * Builds the list of actions requested on the command line. The homing, goto,
+ * targets, movement, shot and status read (in that order) come first,
+ * followed by the script.
  *
- * @param[in] device The HID device corresponding to the launcher
+ * @param[in] arguments The parsed command-line options
+ * @param[out] list Gets populated with the requested actions
  *
  * @return Returns zero on success or non-zero otherwise
  */
-static int print_status(hid_device *device)
+static int build_actions(const struct arguments *arguments,
+        struct action_list *list)
 {
     int ret = 0;
-    uint8_t status;
+    size_t i;
 
-    if (get_status(device, &status) != 0)
+    action_list_init(list);
+
+    // The daemon only treats a request as an abort when it stops first
+    if (arguments->abort)
     {
-        fprintf(stderr, "Failed to retrieve status information\n");
-        ret = -1;
+        ret = action_list_append(list, ACTION_STOP, MOVEMENT_NONE, 0);
     }
-    else
+
+    if (arguments->home && ret == 0)
     {
-        printf("Tilt up limit:      %s\n"
-                "Tilt down limit:    %s\n"
-                "Pan left limit:     %s\n"
-                "Pan right limit:    %s\n"
-                "Fire complete:      %s\n",
-                (status & STATUS_UP_LIMIT)       ? "true" : "false",
-                (status & STATUS_DOWN_LIMIT)     ? "true" : "false",
-                (status & STATUS_LEFT_LIMIT)     ? "true" : "false",
-                (status & STATUS_RIGHT_LIMIT)    ? "true" : "false",
-                (status & STATUS_DEVICE_FIRED)   ? "true" : "false");
+        ret = action_list_append(list, ACTION_HOME, MOVEMENT_NONE, 0);
     }
 
-    return ret;
-}
+    if (arguments->go_to && ret == 0)
+    {
+        struct action action;
 
-/**
- * Fires a single missile from the launcher
- *
- * @param[in] device The HID device corresponding to the launcher
- * 
- * @return Returns zero on success or non-zero otherwise
- */
-static int fire_missile(hid_device *device)
-{
-    int ret = 0;
+        memset(&action, 0, sizeof(action));
+        action.type = ACTION_GOTO;
+        action.pan = arguments->target_pan;
+        action.tilt = arguments->target_tilt;
+        ret = action_list_add(list, &action);
+    }
 
-    if (send_command(device, CMD_FIRE) != 0)
+    for (i = 0; i < arguments->targets.count && ret == 0; i++)
     {
-        fprintf(stderr, "Failed to perform requested movement\n");
-        ret = -1;
+        ret = action_list_add(list, &arguments->targets.actions[i]);
     }
-    else
-    {
-        uint8_t status;
 
-        // Keep reading status until failure or we've completed firing
-        do
-        {
-            if (get_status(device, &status) != 0)
-            {
-                fprintf(stderr, "Failed to get status\n");
-                ret = -1;
-            }
-        }
-        while (!(status & STATUS_DEVICE_FIRED) && ret == 0);
-
-        if (ret == 0)
-        {
-            // Intentionally overshoot with the firing time to (hopefully)
-            // ensure that the missile actually gets fired
-            usleep(FIRE_HOLD_TIME_US);
-
-            // Stop firing
-            if (send_command(device, CMD_STOP) != 0)
-            {
-                fprintf(stderr, "Failed to stop firing\n");
-                ret = -1;
-            }
-        }
+    if (arguments->pan_movement != MOVEMENT_NONE && ret == 0)
+    {
+        struct action action;
+
+        memset(&action, 0, sizeof(action));
+        action.type = ACTION_DIAGONAL;
+        action.movement = arguments->movement;
+        action.duration = arguments->movement_duration;
+        action.pan_movement = arguments->pan_movement;
+        action.pan_duration = arguments->pan_duration;
+        ret = action_list_add(list, &action);
+    }
+    else if (arguments->movement != MOVEMENT_NONE && ret == 0)
+    {
+        ret = action_list_append(list, ACTION_MOVE, arguments->movement,
+                arguments->movement_duration);
     }
 
-    return ret;
-}
+    if (arguments->fire && ret == 0)
+    {
+        struct action action;
 
-/**
- * Moves the turret in the requested direction for the specified amount of time
- *
- * @param[in] device The HID device corresponding to the launcher
- * @param[in] movement The direction to move the turret
- * @param[in] duration The time to move (in microseconds)
- *
- * @return Returns zero on success or non-zero otherwise
- */
-static int move_turret(hid_device *device, enum movement movement,
-        useconds_t duration)
-{
-    int ret = 0;
-    uint8_t cmd;
+        memset(&action, 0, sizeof(action));
+        action.type = ACTION_FIRE;
+        action.shots = arguments->shots;
+        ret = action_list_add(list, &action);
+    }
 
-    // Determine which command to send based on the action
-    switch (movement)
+    if (arguments->display_status && ret == 0)
     {
-        case MOVEMENT_TILT_UP:    cmd = CMD_MOVE_UP;      break;
-        case MOVEMENT_TILT_DOWN:  cmd = CMD_MOVE_DOWN;    break;
-        case MOVEMENT_PAN_LEFT:   cmd = CMD_MOVE_LEFT;    break;
-        case MOVEMENT_PAN_RIGHT:  cmd = CMD_MOVE_RIGHT;   break;
-        default:
-              fprintf(stderr, "Unrecognized movement\n");
-              ret = -1;
-              break;
+        ret = action_list_append(list, ACTION_STATUS, MOVEMENT_NONE, 0);
     }
 
-    if (ret == 0)
-    { 
-        // Send the movement command
-        if (send_command(device, cmd) != 0)
-        {
-            fprintf(stderr, "Failed to perform requested movement\n");
-            ret = -1;
-        }
-        else
-        {
-            // Move for the specified amount of time
-            usleep(duration);
-
-            // Stop moving
-            if (send_command(device, CMD_STOP) != 0)
-            {
-                fprintf(stderr, "Failed to stop movement\n");
-                ret = -1;
-            }
-        }
+    if (arguments->script_path != NULL && ret == 0)
+    {
+        ret = script_load(arguments->script_path, list);
     }
 
     return ret;
@@ -374,63 +662,296 @@ int main(int argc, char **argv)
 {
     int ret = EXIT_SUCCESS;
     struct arguments arguments;
-    hid_device *device;
+    struct action_list list;
+    struct launcher launcher;
+    struct recording recording;
+    struct calibration_table calibrations = { NULL, false };
+    struct retry_counts retry_counts;
+    void *device;
+    char *key = NULL;
+    int result = DAEMON_NOT_RUNNING;
 
     // Set default options
     arguments.movement = MOVEMENT_NONE;
     arguments.movement_duration = MOVE_HOLD_TIME_US;
+    arguments.pan_movement = MOVEMENT_NONE;
+    arguments.pan_duration = MOVE_HOLD_TIME_US;
     arguments.display_status = false;
     arguments.fire = false;
+    arguments.shots = 1;
+    arguments.abort = false;
+    arguments.home = false;
+    arguments.go_to = false;
+    action_list_init(&arguments.targets);
+    arguments.state_path = DEFAULT_STATE_PATH;
+    arguments.calibrate = false;
+    arguments.calibration_path = DEFAULT_CALIBRATION_PATH;
+    arguments.script_path = NULL;
+    arguments.poll_interval = POLL_INTERVAL_US;
+    arguments.poll_max_interval = POLL_MAX_INTERVAL_US;
+    arguments.fire_timeout = FIRE_TIMEOUT_US;
+    arguments.retries = DEFAULT_RETRIES;
+    arguments.spin = 0;
+    arguments.realtime = false;
+    arguments.realtime_priority = DEFAULT_REALTIME_PRIORITY;
+    arguments.realtime_cpu = -1;
+    arguments.print_holds = false;
+    arguments.trace = false;
+    arguments.print_stats = false;
+    arguments.stats_format = TRACE_FORMAT_TEXT;
+    arguments.list_devices = false;
+    arguments.device_path = NULL;
+    arguments.serial = NULL;
+    arguments.device_cache_path = DEFAULT_PATH_CACHE_PATH;
+    arguments.all_devices = false;
+    arguments.salvo_lead = 0;
+    arguments.daemon = false;
+    arguments.socket_path = DEFAULT_SOCKET_PATH;
+    arguments.udp_address = NULL;
+    arguments.metrics_address = NULL;
+    arguments.status_page = NULL;
+    arguments.grace_period = DEFAULT_GRACE_PERIOD_MS * 1000;
+    arguments.record_path = NULL;
+    arguments.replay_path = NULL;
 
     // Parse user-specified options
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
-    
-    // Attempt to open the missile launcher device
-    device = hid_open(LAUNCHER_VID, LAUNCHER_PID, NULL);
 
-    if (device == NULL)
+    if (arguments.list_devices)
+    {
+        return fleet_list() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Gather everything to be done up front, so that a bad script is
+    // reported before the device is touched
+    if (build_actions(&arguments, &list) != 0)
     {
-        fprintf(stderr, "Failed to open requested device\n");
         ret = EXIT_FAILURE;
     }
     else
     {
-        // Perform the requested movement, if any
-        if (arguments.movement != MOVEMENT_NONE)
+        action_list_plan(&list);
+    }
+
+    // The published status stands in for a status read and nothing else
+    if (arguments.status_page != NULL && !arguments.daemon)
+    {
+        if (ret == EXIT_SUCCESS && (list.count != 1 || arguments.calibrate ||
+                    arguments.replay_path != NULL || arguments.all_devices))
         {
-            if (move_turret(device, arguments.movement,
-                        arguments.movement_duration) != 0)
-            {
-                fprintf(stderr, "Failed to move turret\n");
-                ret = EXIT_FAILURE;
-            }
+            fprintf(stderr, "--shm cannot be combined with actions other "
+                    "than --status\n");
+            ret = EXIT_FAILURE;
+        }
+        else if (ret == EXIT_SUCCESS && show_status_page(
+                    arguments.status_page) != 0)
+        {
+            ret = EXIT_FAILURE;
+        }
+
+        action_list_free(&list);
+        action_list_free(&arguments.targets);
+
+        return ret;
+    }
+
+    // Hand the actions to a running daemon if there is one, which saves
+    // opening the device ourselves. A daemon only serves a single launcher,
+    // so asking for particular launchers bypasses it, as does calibrating,
+    // recording or replaying the reports sent to the device.
+    if (!arguments.daemon && !arguments.all_devices &&
+            arguments.device_path == NULL && arguments.serial == NULL &&
+            arguments.record_path == NULL && arguments.replay_path == NULL &&
+            !arguments.calibrate && ret == EXIT_SUCCESS)
+    {
+        result = daemon_request(arguments.socket_path, list.actions,
+                list.count, show_status, NULL);
+
+        if (result != 0 && result != DAEMON_NOT_RUNNING)
+        {
+            fprintf(stderr, "Daemon failed to carry out actions\n");
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    launcher_init(&launcher, &usb_transport, NULL);
+    launcher.poll_interval = arguments.poll_interval;
+    launcher.poll_max_interval = arguments.poll_max_interval;
+    launcher.fire_timeout = arguments.fire_timeout;
+    hold_log_init(&launcher.holds, arguments.print_holds);
+    trace_init(&launcher.trace, arguments.trace || arguments.print_stats ||
+            arguments.realtime, arguments.trace ? stderr : NULL);
+    timing_set_spin(arguments.spin);
+
+    // Only the process driving the device needs real-time treatment, and
+    // with several devices only their workers do, each on a CPU of its own
+    if (result == DAEMON_NOT_RUNNING && ret == EXIT_SUCCESS &&
+            arguments.realtime && !arguments.all_devices &&
+            realtime_enter(arguments.realtime_priority,
+                arguments.realtime_cpu) != 0)
+    {
+        ret = EXIT_FAILURE;
+    }
+
+    // The calibration table is only needed when driving devices directly
+    if (result == DAEMON_NOT_RUNNING && ret == EXIT_SUCCESS &&
+            calibration_open(&calibrations, arguments.calibration_path,
+                arguments.calibrate) != 0)
+    {
+        if (arguments.calibrate)
+        {
+            ret = EXIT_FAILURE;
+        }
+        else
+        {
+            fprintf(stderr, "Ignoring calibration table\n");
+        }
+    }
+
+    if (result == DAEMON_NOT_RUNNING && ret == EXIT_SUCCESS &&
+            arguments.all_devices)
+    {
+        if (fleet_run(&launcher, &calibrations, list.actions, list.count,
+                    arguments.salvo_lead, arguments.retries,
+                    arguments.state_path,
+                    arguments.realtime ? arguments.realtime_priority : 0,
+                    arguments.realtime_cpu, arguments.print_stats,
+                    arguments.stats_format) != 0)
+        {
+            ret = EXIT_FAILURE;
+        }
+    }
+    else if (result == DAEMON_NOT_RUNNING && ret == EXIT_SUCCESS)
+    {
+        // Attempt to open the missile launcher device, where it was last
+        // found if it is still there
+        device = fleet_open_cached(arguments.device_cache_path,
+                arguments.device_path, arguments.serial, &key);
+
+        // Ride out transient transfer failures rather than abandoning the
+        // whole sequence over one of them
+        if (device != NULL && arguments.retries != 0)
+        {
+            memset(&retry_counts, 0, sizeof(retry_counts));
+            device = retry_open(&usb_transport, device, arguments.retries,
+                    &retry_counts);
+            launcher.transport = &retry_transport;
+            launcher.trace.retries = &retry_counts;
         }
 
-        // To fire a single shot, we must initiate firing, read status
-        // information until the fire cycling indicator toggles, delay briefly
-        // to allow firing to complete, then stop firing
-        if (arguments.fire && ret == EXIT_SUCCESS)
+        if (device == NULL)
+        {
+            fprintf(stderr, "Failed to open requested device\n");
+            ret = EXIT_FAILURE;
+        }
+        else
         {
-            if (fire_missile(device) != 0)
+            launcher.handle = device;
+            launcher.state_path = arguments.state_path;
+
+            // Carry on from wherever the last run left the turret
+            if (position_load(&launcher.position, launcher.state_path) != 0)
+            {
+                fprintf(stderr, "Ignoring saved position\n");
+                position_init(&launcher.position);
+            }
+
+            // Measured rates take precedence over those in the state file
+            calibration_apply(&calibrations, key, &launcher.position);
+
+            if (arguments.record_path != NULL)
+            {
+                if (recording_open(&recording, arguments.record_path) != 0)
+                {
+                    ret = EXIT_FAILURE;
+                }
+                else
+                {
+                    launcher.recording = &recording;
+                }
+            }
+
+            if (ret == EXIT_SUCCESS && arguments.daemon)
+            {
+                struct reopen_context context;
+                struct daemon_config config;
+
+                context.arguments = &arguments;
+                context.key = key;
+                context.retry_counts = &retry_counts;
+                config.socket_path = arguments.socket_path;
+                config.udp_address = arguments.udp_address;
+                config.metrics_address = arguments.metrics_address;
+                config.status_page = arguments.status_page;
+                config.grace_period = arguments.grace_period;
+                config.reopen = reopen_device;
+                config.reopen_context = &context;
+
+                if (daemon_serve(&launcher, &config) != 0)
+                {
+                    fprintf(stderr, "Daemon exited with an error\n");
+                    ret = EXIT_FAILURE;
+                }
+            }
+            else if (ret == EXIT_SUCCESS)
+            {
+                // Calibration and then a replay go first, so that actions
+                // can follow on from wherever they leave the turret
+                if (arguments.calibrate &&
+                        (calibrate_turret(&launcher) != 0 ||
+                         calibration_store(&calibrations, key,
+                             &launcher.position) != 0))
+                {
+                    ret = EXIT_FAILURE;
+                }
+                else if (arguments.replay_path != NULL &&
+                        recording_replay(&launcher,
+                            arguments.replay_path) != 0)
+                {
+                    ret = EXIT_FAILURE;
+                }
+                else if (run_actions(&launcher, list.actions, list.count,
+                            show_status, NULL) != 0)
+                {
+                    ret = EXIT_FAILURE;
+                }
+            }
+
+            if (launcher.recording != NULL &&
+                    recording_close(launcher.recording) != 0)
             {
-                fprintf(stderr, "Failed to fire missile\n");
                 ret = EXIT_FAILURE;
             }
-        }
 
-        // Display the status information, if requested
-        if (arguments.display_status && ret == EXIT_SUCCESS)
-        {
-            if (print_status(device) != 0)
+            if (position_save(&launcher.position, launcher.state_path) != 0)
             {
-                fprintf(stderr, "Failed to print status information\n");
                 ret = EXIT_FAILURE;
             }
+
+            if (arguments.print_holds)
+            {
+                hold_log_print(&launcher.holds, stdout);
+            }
+
+            if (arguments.print_stats)
+            {
+                trace_print(&launcher.trace, stdout, arguments.stats_format,
+                        NULL);
+            }
+            else if (arguments.realtime)
+            {
+                trace_print_deadlines(&launcher.trace, stderr);
+            }
+
+            // Clean up the device
+            launcher_close(&launcher);
         }
-        
-        // Clean up the device
-        hid_close(device);
     }
 
+    action_list_free(&list);
+    action_list_free(&arguments.targets);
+    calibration_close(&calibrations);
+    free(key);
+
     return ret;
 }
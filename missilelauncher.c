@@ -0,0 +1,200 @@
+#include "missilelauncher.h"
+#include "executor.h"
+#include "script.h"
+#include "fleet.h"
+#include "usb.h"
+#include "retry.h"
+#include <sys/eventfd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+/**
+ * An open launcher and the executor driving it
+ */
+struct ml_launcher
+{
+    struct launcher launcher;
+    struct executor executor;
+};
+
+/**
+ * What a request needs once it has finished, kept as its job's context
+ */
+struct ml_request
+{
+    struct job *job;
+    ml_callback callback;
+    void *context;
+};
+
+struct ml_launcher *ml_open(const char *path, const char *serial)
+{
+    char *key = NULL;
+    void *device = fleet_open(path, serial, &key);
+    struct ml_launcher *ml = NULL;
+
+    if (device == NULL)
+    {
+        fprintf(stderr, "Failed to open requested device\n");
+    }
+    else
+    {
+        device = retry_open(&usb_transport, device, DEFAULT_RETRIES, NULL);
+    }
+
+    if (device != NULL)
+    {
+        ml = ml_open_transport(&retry_transport, device);
+    }
+
+    free(key);
+
+    return ml;
+}
+
+struct ml_launcher *ml_open_transport(const struct transport_ops *transport,
+        void *handle)
+{
+    struct ml_launcher *ml = calloc(1, sizeof(*ml));
+
+    if (ml == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        transport->close(handle);
+    }
+    else
+    {
+        launcher_init(&ml->launcher, transport, handle);
+
+        if (executor_start(&ml->executor, &ml->launcher) != 0)
+        {
+            launcher_close(&ml->launcher);
+            free(ml);
+            ml = NULL;
+        }
+    }
+
+    return ml;
+}
+
+void ml_close(struct ml_launcher *ml)
+{
+    if (ml != NULL)
+    {
+        executor_stop(&ml->executor);
+        launcher_close(&ml->launcher);
+        free(ml);
+    }
+}
+
+struct ml_request *ml_submit(struct ml_launcher *ml, const char *script,
+        ml_callback callback, void *context)
+{
+    struct ml_request *request = NULL;
+    struct action_list list;
+    FILE *file = fmemopen((void *)script, strlen(script), "r");
+
+    action_list_init(&list);
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to read script\n");
+    }
+    else
+    {
+        if (script_parse(file, "request", &list) == 0)
+        {
+            action_list_plan(&list);
+            request = ml_submit_actions(ml, list.actions, list.count,
+                    callback, context);
+        }
+
+        fclose(file);
+    }
+
+    action_list_free(&list);
+
+    return request;
+}
+
+struct ml_request *ml_submit_actions(struct ml_launcher *ml,
+        const struct action *actions, size_t count, ml_callback callback,
+        void *context)
+{
+    struct ml_request *request = NULL;
+    struct job *job = job_create();
+    size_t i;
+    int ret = job != NULL ? 0 : -1;
+
+    for (i = 0; i < count && ret == 0; i++)
+    {
+        ret = action_list_add(&job->actions, &actions[i]);
+    }
+
+    if (ret == 0)
+    {
+        request = malloc(sizeof(*request));
+    }
+
+    if (request == NULL)
+    {
+        fprintf(stderr, "Failed to queue request\n");
+        job_free(job);
+    }
+    else
+    {
+        request->job = job;
+        request->callback = callback;
+        request->context = context;
+        job->context = request;
+
+        // A request that starts by stopping the turret is an abort, just as
+        // it is for the daemon
+        if (count != 0 && actions[0].type == ACTION_STOP)
+        {
+            job->priority = JOB_ABORT;
+        }
+
+        executor_submit(&ml->executor, job);
+    }
+
+    return request;
+}
+
+void ml_cancel(struct ml_request *request)
+{
+    executor_cancel(request->job);
+}
+
+int ml_get_fd(const struct ml_launcher *ml)
+{
+    return ml->executor.done_fd;
+}
+
+size_t ml_dispatch(struct ml_launcher *ml)
+{
+    size_t dispatched = 0;
+    struct job *job;
+    eventfd_t value;
+
+    // Drain the count first, so that a job finishing after the queue is
+    // emptied still leaves the fd readable
+    eventfd_read(ml->executor.done_fd, &value);
+
+    while ((job = executor_collect(&ml->executor)) != NULL)
+    {
+        struct ml_request *request = job->context;
+
+        if (request->callback != NULL)
+        {
+            request->callback(job->result, job->statuses, job->status_count,
+                    request->context);
+        }
+
+        job_free(job);
+        dispatched++;
+    }
+
+    return dispatched;
+}
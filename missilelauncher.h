@@ -0,0 +1,148 @@
+#ifndef MISSILELAUNCHER_H
+#define MISSILELAUNCHER_H
+
+#include "transport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Public interface of libmissilelauncher, for driving launchers from an
+ * existing event loop. It needs nothing beyond this header and transport.h,
+ * so it can be used from C++ as well as C.
+ *
+ * Each open launcher gets a worker thread of its own that does all the
+ * sleeping and polling on the device, so none of these functions ever block
+ * on it. Requests are carried out one at a time in the order submitted.
+ * When one finishes, the file descriptor from ml_get_fd polls readable, and
+ * ml_dispatch calls its callback on whichever thread calls ml_dispatch.
+ */
+
+/**
+ * An open launcher driven in the background
+ */
+struct ml_launcher;
+
+/**
+ * A request submitted to a launcher, valid until its callback is called
+ */
+struct ml_request;
+
+/**
+ * An action as defined in action.h, for C callers that build their own
+ */
+struct action;
+
+/**
+ * Called once a request has finished
+ *
+ * @param[in] result Zero if every action succeeded, or non-zero if any
+ *            failed or the request was cancelled
+ * @param[in] statuses The status bytes read by the request, one for each
+ *            status action in order, valid until the callback returns
+ * @param[in] count The number of status bytes
+ * @param[in] context The context pointer given when submitting
+ */
+typedef void (*ml_callback)(int result, const uint8_t *statuses,
+        size_t count, void *context);
+
+/**
+ * Opens a launcher attached over USB and starts its worker thread
+ *
+ * @param[in] path The device path of the launcher, or NULL
+ * @param[in] serial The serial number of the launcher, or NULL to take the
+ *            first one found when no path is given either
+ *
+ * @return Returns the launcher on success or NULL otherwise
+ */
+struct ml_launcher *ml_open(const char *path, const char *serial);
+
+/**
+ * Starts driving a launcher reached through any transport, such as the
+ * simulators in mock.h and sim.h
+ *
+ * @param[in] transport The backend used to reach the device
+ * @param[in] handle The backend's handle for the open device, which belongs
+ *            to the launcher from now on
+ *
+ * @return Returns the launcher on success or NULL otherwise
+ */
+struct ml_launcher *ml_open_transport(const struct transport_ops *transport,
+        void *handle);
+
+/**
+ * Cuts short whatever a launcher is doing, stops its worker thread and
+ * closes it. Requests whose callbacks have not been called yet are released
+ * without them ever being called.
+ *
+ * @param[in] ml The launcher to close
+ */
+void ml_close(struct ml_launcher *ml);
+
+/**
+ * Queues a script of actions to be carried out, in the language described
+ * in script.h (for instance "goto 90,10\nfire 2\nstatus\n"), without
+ * waiting for any of them
+ *
+ * @param[in,out] ml The launcher to operate
+ * @param[in] script The script
+ * @param[in] callback Called once the actions have finished
+ * @param[in] context Passed through to the callback
+ *
+ * @return Returns the request on success or NULL if the script is malformed
+ *         or the request could not be queued
+ */
+struct ml_request *ml_submit(struct ml_launcher *ml, const char *script,
+        ml_callback callback, void *context);
+
+/**
+ * Queues actions to be carried out, as ml_submit does
+ *
+ * @param[in,out] ml The launcher to operate
+ * @param[in] actions The actions to carry out, which are copied
+ * @param[in] count The number of actions
+ * @param[in] callback Called once the actions have finished
+ * @param[in] context Passed through to the callback
+ *
+ * @return Returns the request on success or NULL otherwise
+ */
+struct ml_request *ml_submit_actions(struct ml_launcher *ml,
+        const struct action *actions, size_t count, ml_callback callback,
+        void *context);
+
+/**
+ * Cancels a request. One still waiting never starts, and one in progress
+ * stops the turret at its next status poll. Its callback is called as
+ * usual, with a failed result.
+ *
+ * @param[in,out] request The request, whose callback must not have been
+ *                called yet
+ */
+void ml_cancel(struct ml_request *request);
+
+/**
+ * Gets a file descriptor that polls readable whenever finished requests are
+ * waiting for ml_dispatch
+ *
+ * @param[in] ml The open launcher
+ *
+ * @return Returns the file descriptor
+ */
+int ml_get_fd(const struct ml_launcher *ml);
+
+/**
+ * Calls the callback of every request that has finished, and releases the
+ * requests. Never blocks. Must only be called from one thread at a time.
+ *
+ * @param[in,out] ml The open launcher
+ *
+ * @return Returns the number of callbacks called
+ */
+size_t ml_dispatch(struct ml_launcher *ml);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
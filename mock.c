@@ -0,0 +1,215 @@
+#include "mock.h"
+#include "launcher.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * The state of a simulated launcher
+ */
+struct mock_device
+{
+    struct mock_config config;
+    pthread_mutex_t lock;
+    uint64_t updated;       // When the simulation was last advanced
+    uint8_t cmd;            // Bits currently driving the motors
+    int64_t pan;            // Microseconds of travel right of the left limit
+    int64_t tilt;           // Microseconds of travel above the down limit
+    uint64_t fire_phase;    // Microseconds into the current firing cycle
+    unsigned int pending;   // Status requests waiting to be read
+};
+
+/**
+ * Limits a position to the range of travel of an axis
+ *
+ * @param[in] value The position to limit
+ * @param[in] travel The range of travel of the axis
+ *
+ * @return Returns the limited position
+ */
+static int64_t clamp_travel(int64_t value, int64_t travel)
+{
+    return value < 0 ? 0 : (value > travel ? travel : value);
+}
+
+/**
+ * Runs the simulation forward to the current time. Must be called with the
+ * lock held.
+ *
+ * @param[in,out] device The simulated launcher
+ */
+static void mock_advance(struct mock_device *device)
+{
+    uint64_t now = timing_now();
+    int64_t elapsed = now - device->updated;
+
+    if (device->cmd & CMD_MOVE_LEFT)
+        device->pan -= elapsed;
+    if (device->cmd & CMD_MOVE_RIGHT)
+        device->pan += elapsed;
+    if (device->cmd & CMD_MOVE_DOWN)
+        device->tilt -= elapsed;
+    if (device->cmd & CMD_MOVE_UP)
+        device->tilt += elapsed;
+
+    device->pan = clamp_travel(device->pan, device->config.pan_travel);
+    device->tilt = clamp_travel(device->tilt, device->config.tilt_travel);
+
+    if ((device->cmd & CMD_FIRE) && device->config.fire_cycle != 0)
+    {
+        device->fire_phase =
+            (device->fire_phase + elapsed) % device->config.fire_cycle;
+    }
+
+    device->updated = now;
+}
+
+/**
+ * Works out the status byte for the current state of the simulation. Must be
+ * called with the lock held.
+ *
+ * @param[in] device The simulated launcher
+ *
+ * @return Returns the status byte
+ */
+static uint8_t mock_status(const struct mock_device *device)
+{
+    uint8_t status = 0;
+
+    if (device->pan <= 0)
+        status |= STATUS_LEFT_LIMIT;
+    if (device->pan >= device->config.pan_travel)
+        status |= STATUS_RIGHT_LIMIT;
+    if (device->tilt <= 0)
+        status |= STATUS_DOWN_LIMIT;
+    if (device->tilt >= device->config.tilt_travel)
+        status |= STATUS_UP_LIMIT;
+    if (device->fire_phase + device->config.fire_switch >=
+            device->config.fire_cycle)
+        status |= STATUS_DEVICE_FIRED;
+
+    return status;
+}
+
+/**
+ * Accepts an output report. Status requests queue an input report, a stop
+ * clears the motors and any other command replaces the bits driving them.
+ */
+static int mock_write(void *handle, const uint8_t *data, size_t length)
+{
+    struct mock_device *device = handle;
+    int ret = (int)length;
+
+    timing_sleep(device->config.latency);
+
+    if (length < 2)
+    {
+        ret = -1;
+    }
+    else
+    {
+        pthread_mutex_lock(&device->lock);
+        mock_advance(device);
+
+        if (data[1] == CMD_GET_STATUS)
+            device->pending++;
+        else if (data[1] == CMD_STOP)
+            device->cmd = 0;
+        else
+            device->cmd = data[1];
+
+        pthread_mutex_unlock(&device->lock);
+    }
+
+    return ret;
+}
+
+/**
+ * Returns a queued input report, or waits out the timeout if none was
+ * requested. Nothing will ever arrive without a request, so waiting
+ * indefinitely for one is reported as a failure rather than hanging.
+ */
+static int mock_read(void *handle, uint8_t *data, size_t length,
+        int timeout_ms)
+{
+    struct mock_device *device = handle;
+    int ret = 0;
+    bool ready;
+
+    pthread_mutex_lock(&device->lock);
+    ready = device->pending != 0;
+    pthread_mutex_unlock(&device->lock);
+
+    if (length == 0)
+    {
+        ret = -1;
+    }
+    else if (!ready && timeout_ms < 0)
+    {
+        fprintf(stderr, "Simulated launcher has no report to read\n");
+        ret = -1;
+    }
+    else if (!ready)
+    {
+        timing_sleep((useconds_t)timeout_ms * 1000);
+    }
+    else
+    {
+        timing_sleep(device->config.latency);
+
+        pthread_mutex_lock(&device->lock);
+        mock_advance(device);
+        device->pending--;
+        data[0] = mock_status(device);
+        pthread_mutex_unlock(&device->lock);
+
+        ret = 1;
+    }
+
+    return ret;
+}
+
+/**
+ * Releases a simulated launcher
+ */
+static void mock_close(void *handle)
+{
+    struct mock_device *device = handle;
+
+    pthread_mutex_destroy(&device->lock);
+    free(device);
+}
+
+const struct transport_ops mock_transport =
+{
+    .name = "mock",
+    .write = mock_write,
+    .read = mock_read,
+    .close = mock_close,
+    .get_fd = NULL,
+};
+
+void mock_config_init(struct mock_config *config)
+{
+    config->latency = MOCK_LATENCY_US;
+    config->fire_cycle = MOCK_FIRE_CYCLE_US;
+    config->fire_switch = MOCK_FIRE_SWITCH_US;
+    config->pan_travel = MOCK_PAN_TRAVEL_US;
+    config->tilt_travel = MOCK_TILT_TRAVEL_US;
+}
+
+void *mock_open(const struct mock_config *config)
+{
+    struct mock_device *device = calloc(1, sizeof(*device));
+
+    if (device != NULL)
+    {
+        device->config = *config;
+        device->updated = timing_now();
+        device->pan = config->pan_travel / 2;
+        device->tilt = config->tilt_travel / 2;
+        pthread_mutex_init(&device->lock, NULL);
+    }
+
+    return device;
+}
@@ -0,0 +1,55 @@
+#ifndef MOCK_H
+#define MOCK_H
+
+#include "transport.h"
+#include <unistd.h>
+
+//
+// Default behaviour of the simulated launcher, chosen to match the real one
+//
+#define MOCK_LATENCY_US         1000
+#define MOCK_FIRE_CYCLE_US      3000000
+#define MOCK_FIRE_SWITCH_US     250000
+#define MOCK_PAN_TRAVEL_US      4500000
+#define MOCK_TILT_TRAVEL_US     1000000
+
+/**
+ * How a simulated launcher behaves
+ */
+struct mock_config
+{
+    useconds_t latency;     // Added to every transfer
+    useconds_t fire_cycle;  // Time to wind up and release one missile
+    useconds_t fire_switch; // Time at the end of each cycle the fired bit is set
+    useconds_t pan_travel;  // Time to pan from one limit switch to the other
+    useconds_t tilt_travel; // Time to tilt from one limit switch to the other
+};
+
+/**
+ * Transport that drives a simulated launcher rather than a real device. The
+ * simulation runs on the monotonic clock: the turret moves while direction
+ * bits are set and stops at the ends of its travel, where the limit switch
+ * bits are reported. The firing mechanism advances while the fire bit is set
+ * and raises the fired bit towards the end of each cycle. Every transfer is
+ * delayed by the configured latency.
+ */
+extern const struct transport_ops mock_transport;
+
+/**
+ * Fills in the default behaviour of a simulated launcher
+ *
+ * @param[out] config The configuration to initialize
+ */
+void mock_config_init(struct mock_config *config);
+
+/**
+ * Creates a simulated launcher with the turret in the middle of its travel
+ *
+ * @param[in] config How the launcher behaves
+ *
+ * @return Returns a handle for use with mock_transport on success or NULL
+ *         otherwise
+ */
+void *mock_open(const struct mock_config *config);
+
+#endif
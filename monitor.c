@@ -0,0 +1,270 @@
+#include "monitor.h"
+#include "metrics.h"
+#include "retry.h"
+#include <string.h>
+#include <stdio.h>
+
+//
+// Longest to wait for the launcher to answer a single poll, in milliseconds
+//
+#define MONITOR_READ_TIMEOUT_MS 1000
+
+//
+// Time over which the effective polling rate is measured, in microseconds
+//
+#define POLL_RATE_WINDOW_US     1000000
+
+//
+// Time allowed for waking up when polling ahead of a reader's request, in
+// microseconds
+//
+#define REQUEST_LEAD_US         1000
+
+void snapshot_publish(struct status_snapshot *snapshot, uint8_t status,
+        uint64_t timestamp)
+{
+    uint_fast32_t sequence =
+        atomic_load_explicit(&snapshot->sequence, memory_order_relaxed);
+
+    // Mark the snapshot as changing before touching the fields
+    atomic_store_explicit(&snapshot->sequence, sequence + 1,
+            memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&snapshot->status, status, memory_order_relaxed);
+    atomic_store_explicit(&snapshot->timestamp, timestamp,
+            memory_order_relaxed);
+
+    atomic_store_explicit(&snapshot->sequence, sequence + 2,
+            memory_order_release);
+}
+
+uint32_t snapshot_read(const struct status_snapshot *snapshot,
+        uint8_t *status, uint64_t *timestamp)
+{
+    uint_fast32_t before;
+    uint_fast32_t after;
+
+    // Retry until no update overlapped the read
+    do
+    {
+        before = atomic_load_explicit(&snapshot->sequence,
+                memory_order_acquire);
+        *status = atomic_load_explicit(&snapshot->status,
+                memory_order_relaxed);
+        *timestamp = atomic_load_explicit(&snapshot->timestamp,
+                memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&snapshot->sequence,
+                memory_order_relaxed);
+    }
+    while (before != after || (before & 1));
+
+    return before / 2;
+}
+
+void snapshot_request(struct status_snapshot *snapshot, uint64_t when)
+{
+    atomic_store_explicit(&snapshot->requested, when, memory_order_relaxed);
+}
+
+/**
+ * Works out when the monitor should next poll, which is on its own schedule
+ * unless a reader wants a status sooner
+ *
+ * @param[in] monitor The monitor
+ * @param[in] next_poll When the next poll is due on the monitor's schedule
+ * @param[in] took How long the last poll took (in microseconds), so that a
+ *            requested status can be published in time
+ *
+ * @return Returns when to poll (as timing_now)
+ */
+static uint64_t next_wake(struct monitor *monitor, uint64_t next_poll,
+        uint64_t took)
+{
+    uint64_t requested = atomic_load_explicit(&monitor->snapshot.requested,
+            memory_order_relaxed);
+    uint64_t lead = took + REQUEST_LEAD_US;
+
+    if (requested != 0 && requested < next_poll + lead)
+    {
+        next_poll = requested > lead ? requested - lead : 0;
+    }
+
+    return next_poll;
+}
+
+/**
+ * Monitor thread entry point. Polls the launcher until asked to stop.
+ *
+ * @param[in] arg The monitor
+ *
+ * @return Returns NULL always
+ */
+static void *monitor_main(void *arg)
+{
+    struct monitor *monitor = arg;
+    useconds_t interval = monitor->interval;
+    uint64_t window_start = timing_now();
+    unsigned int window_polls = 0;
+    bool failing = false;
+    bool published = false;
+    uint8_t last = 0;
+
+    while (!atomic_load(&monitor->stopping))
+    {
+        uint8_t status;
+        uint64_t start = timing_now();
+        uint64_t requested = atomic_load_explicit(
+                &monitor->snapshot.requested, memory_order_relaxed);
+        int result = get_status_timeout(&monitor->device, &status,
+                MONITOR_READ_TIMEOUT_MS);
+        uint64_t now = timing_now();
+        uint64_t took = now - start;
+        uint64_t next_poll;
+        uint64_t wake;
+
+        window_polls++;
+
+        if (result == 0)
+        {
+            snapshot_publish(&monitor->snapshot, status, now);
+
+            // One change is often the start of more, so poll quickly after
+            // it and back off only while the status holds steady
+            if (published && status == last)
+            {
+                interval = interval * 2 < monitor->max_interval ?
+                    interval * 2 : monitor->max_interval;
+            }
+            else
+            {
+                interval = monitor->interval;
+            }
+
+            published = true;
+            last = status;
+            failing = false;
+        }
+        else if (!failing)
+        {
+            // Report the start of a run of failures, not every one of them
+            fprintf(stderr, "Background status poll failed\n");
+            interval = monitor->interval;
+            failing = true;
+        }
+
+        // This poll answers any request it was in time for, unless the
+        // reader has since asked again
+        if (requested != 0 && requested <= now + took + REQUEST_LEAD_US)
+        {
+            atomic_compare_exchange_strong(&monitor->snapshot.requested,
+                    &requested, 0);
+        }
+
+        if (now - window_start >= POLL_RATE_WINDOW_US)
+        {
+            metrics_set(METRIC_POLL_RATE,
+                    (int64_t)window_polls * 1000000 / (now - window_start));
+            window_start = now;
+            window_polls = 0;
+        }
+
+        // Don't try to catch up on polls missed while the device was slow
+        next_poll = start + interval;
+
+        // Sleep in short steps, so that a request for a status sooner than
+        // the next poll is noticed in time to answer it. A reader already
+        // asking for the one after can bring the poll forward but not put
+        // it off.
+        wake = next_wake(monitor, next_poll, took);
+
+        while (!atomic_load(&monitor->stopping) && now < wake)
+        {
+            uint64_t requested_wake;
+
+            timing_sleep_until(wake < now + monitor->interval ? wake :
+                    now + monitor->interval);
+            now = timing_now();
+            requested_wake = next_wake(monitor, next_poll, took);
+            wake = requested_wake < wake ? requested_wake : wake;
+        }
+    }
+
+    return NULL;
+}
+
+int monitor_start(struct monitor *monitor, struct launcher *launcher,
+        useconds_t interval, useconds_t max_interval)
+{
+    int ret = 0;
+
+    memset(&monitor->snapshot, 0, sizeof(monitor->snapshot));
+    atomic_init(&monitor->stopping, false);
+    monitor->interval = interval;
+    monitor->max_interval = max_interval;
+
+    // The thread gets its own copy of the launcher, so that it reads the
+    // device itself and shares no trace or hold log with the command thread
+    monitor->device = *launcher;
+    monitor->device.snapshot = NULL;
+    monitor->device.abort = NULL;
+    monitor->device.cancel = NULL;
+    monitor->device.abort_ticket = NULL;
+    hold_log_init(&monitor->device.holds, false);
+    trace_init(&monitor->device.trace, false, NULL);
+
+    if (pthread_create(&monitor->thread, NULL, monitor_main, monitor) != 0)
+    {
+        fprintf(stderr, "Failed to start status reader\n");
+        ret = -1;
+    }
+    else
+    {
+        uint8_t status;
+        uint64_t timestamp;
+        uint64_t deadline = timing_now() + MONITOR_READ_TIMEOUT_MS * 2000;
+
+        // Commands can't be served from an empty snapshot, so give the
+        // thread time for at least one poll that waits out its timeout
+        while (snapshot_read(&monitor->snapshot, &status, &timestamp) == 0 &&
+                timing_now() < deadline)
+        {
+            timing_sleep(interval);
+        }
+
+        if (snapshot_read(&monitor->snapshot, &status, &timestamp) == 0)
+        {
+            fprintf(stderr, "Status reader never heard from the launcher\n");
+            atomic_store(&monitor->stopping, true);
+            pthread_join(monitor->thread, NULL);
+            ret = -1;
+        }
+        else
+        {
+            launcher->snapshot = &monitor->snapshot;
+
+            // A fire command about to be sent again checks the launcher is
+            // answering, which now has to go through this thread as well
+            if (launcher->transport == &retry_transport)
+            {
+                retry_use_snapshot(launcher->handle, &monitor->snapshot);
+            }
+        }
+    }
+
+    return ret;
+}
+
+void monitor_stop(struct monitor *monitor, struct launcher *launcher)
+{
+    launcher->snapshot = NULL;
+
+    if (launcher->transport == &retry_transport)
+    {
+        retry_use_snapshot(launcher->handle, NULL);
+    }
+
+    atomic_store(&monitor->stopping, true);
+    pthread_join(monitor->thread, NULL);
+}
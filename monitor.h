@@ -0,0 +1,102 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include "launcher.h"
+#include <stdatomic.h>
+#include <pthread.h>
+
+//
+// Oldest snapshot accepted in place of reading the device, on top of the
+// longest time between polls, in microseconds
+//
+#define SNAPSHOT_MAX_AGE_US 250000
+
+/**
+ * The most recent status byte read from a launcher, published by a single
+ * writer and read without locking. The sequence is odd while an update is
+ * in progress, so a reader that sees it change knows to try again.
+ */
+struct status_snapshot
+{
+    atomic_uint_fast32_t sequence;
+    atomic_uint_fast64_t timestamp;     // When the status was read
+    atomic_uint_fast8_t status;
+    atomic_uint_fast64_t requested;     // When a reader wants a fresh status
+                                        // by, or zero
+};
+
+/**
+ * A background thread that keeps polling a launcher's status and publishes
+ * each result in a snapshot. It polls quickly when the status has just
+ * changed, backing off while it stays the same, and otherwise polls when a
+ * reader asks it to.
+ */
+struct monitor
+{
+    pthread_t thread;
+    struct launcher device;     // Private copy used only by the thread
+    useconds_t interval;        // Shortest time between polls
+    useconds_t max_interval;    // Longest time between polls
+    atomic_bool stopping;
+    struct status_snapshot snapshot;
+};
+
+/**
+ * Publishes a new status byte in a snapshot. Only one thread may publish to
+ * a given snapshot.
+ *
+ * @param[in,out] snapshot The snapshot to update
+ * @param[in] status The status byte read from the launcher
+ * @param[in] timestamp When the status was read (as timing_now)
+ */
+void snapshot_publish(struct status_snapshot *snapshot, uint8_t status,
+        uint64_t timestamp);
+
+/**
+ * Reads a consistent copy of a snapshot, without locking
+ *
+ * @param[in] snapshot The snapshot to read
+ * @param[out] status Gets populated with the latest status byte
+ * @param[out] timestamp Gets populated with when it was read
+ *
+ * @return Returns the number of statuses published so far, so zero means
+ *         nothing has been read yet
+ */
+uint32_t snapshot_read(const struct status_snapshot *snapshot,
+        uint8_t *status, uint64_t *timestamp);
+
+/**
+ * Asks for a fresh status to be published in a snapshot by a given time.
+ * Takes the place of any earlier request, so only one thread may make them.
+ *
+ * @param[in,out] snapshot The snapshot to update
+ * @param[in] when When the status is wanted by (as timing_now)
+ */
+void snapshot_request(struct status_snapshot *snapshot, uint64_t when);
+
+/**
+ * Starts polling a launcher's status in the background, and points the
+ * launcher at the snapshot so that its status reads come from memory rather
+ * than the device. Waits for the first status to be published before
+ * returning. The transport must accept writes from two threads at once.
+ *
+ * @param[out] monitor The monitor to start
+ * @param[in,out] launcher The launcher to poll
+ * @param[in] interval The shortest time between polls (in microseconds)
+ * @param[in] max_interval The longest time between polls (in microseconds)
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int monitor_start(struct monitor *monitor, struct launcher *launcher,
+        useconds_t interval, useconds_t max_interval);
+
+/**
+ * Stops a monitor started by monitor_start, and returns the launcher to
+ * reading its status from the device
+ *
+ * @param[in,out] monitor The monitor to stop
+ * @param[in,out] launcher The launcher being polled
+ */
+void monitor_stop(struct monitor *monitor, struct launcher *launcher);
+
+#endif
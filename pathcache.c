@@ -0,0 +1,170 @@
+#include "pathcache.h"
+#include "launcher.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/**
+ * Splits a line of the cache into its fields, in place
+ *
+ * @param[in,out] line The line, which is cut up
+ * @param[out] vendor Gets populated with the vendor ID
+ * @param[out] product Gets populated with the product ID
+ * @param[out] serial Gets populated with the serial number asked for
+ * @param[out] path Gets populated with the device path
+ *
+ * @return Returns zero if the line is well formed or non-zero otherwise
+ */
+static int parse_line(char *line, unsigned int *vendor,
+        unsigned int *product, char **serial, char **path)
+{
+    int ret = -1;
+    char *first;
+    char *second = NULL;
+
+    line[strcspn(line, "\n")] = '\0';
+    first = strchr(line, '\t');
+
+    if (first != NULL)
+    {
+        second = strchr(first + 1, '\t');
+    }
+
+    if (second != NULL && second[1] != '\0' &&
+            sscanf(line, "%x:%x", vendor, product) == 2)
+    {
+        *first = '\0';
+        *second = '\0';
+        *serial = first + 1;
+        *path = second + 1;
+        ret = 0;
+    }
+
+    return ret;
+}
+
+char *path_cache_lookup(const char *cache_path, const char *serial)
+{
+    char *found = NULL;
+    const char *wanted = serial != NULL ? serial : PATH_CACHE_ANY;
+    char line[MAX_PATH_CACHE_LINE];
+    FILE *file = fopen(cache_path, "r");
+
+    // A missing cache simply has nothing in it
+    while (file != NULL && found == NULL &&
+            fgets(line, sizeof(line), file) != NULL)
+    {
+        unsigned int vendor;
+        unsigned int product;
+        char *entry_serial;
+        char *entry_path;
+
+        if (parse_line(line, &vendor, &product, &entry_serial,
+                    &entry_path) == 0 && vendor == LAUNCHER_VID &&
+                product == LAUNCHER_PID && strcmp(entry_serial, wanted) == 0)
+        {
+            found = strdup(entry_path);
+        }
+    }
+
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+
+    return found;
+}
+
+int path_cache_store(const char *cache_path, const char *serial,
+        const char *path)
+{
+    int ret = 0;
+    const char *wanted = serial != NULL ? serial : PATH_CACHE_ANY;
+    size_t length = strlen(cache_path) + sizeof(".XXXXXX");
+    char *temp = malloc(length);
+    char line[MAX_PATH_CACHE_LINE];
+    FILE *old = NULL;
+    FILE *file = NULL;
+    size_t kept = 1;
+    int fd = -1;
+
+    if (temp == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        ret = -1;
+    }
+    else if (strpbrk(wanted, "\t\n") != NULL ||
+            strpbrk(path, "\t\n") != NULL ||
+            strlen(wanted) + strlen(path) + sizeof("xxxx:xxxx\t\t\n") >
+            sizeof(line))
+    {
+        // Entries that couldn't be read back are not worth writing
+        ret = -1;
+    }
+    else
+    {
+        snprintf(temp, length, "%s.XXXXXX", cache_path);
+        fd = mkstemp(temp);
+
+        if (fd < 0 || (file = fdopen(fd, "w")) == NULL)
+        {
+            fprintf(stderr, "Failed to update %s: %s\n", cache_path,
+                    strerror(errno));
+            ret = -1;
+        }
+    }
+
+    if (ret == 0)
+    {
+        // Newest first, so that the oldest entries are the ones to go
+        fprintf(file, "%04x:%04x\t%s\t%s\n", LAUNCHER_VID, LAUNCHER_PID,
+                wanted, path);
+        old = fopen(cache_path, "r");
+    }
+
+    while (old != NULL && kept < MAX_PATH_CACHE_ENTRIES &&
+            fgets(line, sizeof(line), old) != NULL)
+    {
+        unsigned int vendor;
+        unsigned int product;
+        char *entry_serial;
+        char *entry_path;
+
+        if (parse_line(line, &vendor, &product, &entry_serial,
+                    &entry_path) == 0 && (vendor != LAUNCHER_VID ||
+                    product != LAUNCHER_PID ||
+                    strcmp(entry_serial, wanted) != 0))
+        {
+            fprintf(file, "%04x:%04x\t%s\t%s\n", vendor, product,
+                    entry_serial, entry_path);
+            kept++;
+        }
+    }
+
+    if (old != NULL)
+    {
+        fclose(old);
+    }
+
+    if (file != NULL && (fclose(file) != 0 || rename(temp, cache_path) != 0))
+    {
+        fprintf(stderr, "Failed to update %s: %s\n", cache_path,
+                strerror(errno));
+        ret = -1;
+    }
+    else if (file == NULL && fd >= 0)
+    {
+        close(fd);
+    }
+
+    if (ret != 0 && fd >= 0)
+    {
+        unlink(temp);
+    }
+
+    free(temp);
+
+    return ret;
+}
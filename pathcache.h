@@ -0,0 +1,53 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+//
+// Default location of the cache of launcher device paths
+//
+#define DEFAULT_PATH_CACHE_PATH "/tmp/" PROGRAM_NAME ".dev"
+
+//
+// Most launchers the cache remembers, and the longest line it holds for each
+//
+#define MAX_PATH_CACHE_ENTRIES  16
+#define MAX_PATH_CACHE_LINE     512
+
+//
+// Stands in for the serial number of an entry that was asked for no
+// launcher in particular
+//
+#define PATH_CACHE_ANY          "*"
+
+/*
+ * The cache is a text file with one line for each launcher found, giving its
+ * vendor and product IDs, the serial number asked for and the device path it
+ * was found at, separated by tabs. Entries are only hints, so whoever opens a
+ * cached path must check that it still leads to the launcher asked for.
+ */
+
+/**
+ * Looks up where a launcher was last found
+ *
+ * @param[in] cache_path The path of the cache file
+ * @param[in] serial The serial number asked for, or NULL for any launcher
+ *
+ * @return Returns the device path, which the caller must free, or NULL if
+ *         the cache has none
+ */
+char *path_cache_lookup(const char *cache_path, const char *serial);
+
+/**
+ * Records where a launcher was found, replacing any earlier entry for it.
+ * When the cache is full the entry stored longest ago makes way. The file is
+ * replaced as a whole, so concurrent readers never see it half written.
+ *
+ * @param[in] cache_path The path of the cache file
+ * @param[in] serial The serial number asked for, or NULL for any launcher
+ * @param[in] path The device path the launcher was found at
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int path_cache_store(const char *cache_path, const char *serial,
+        const char *path);
+
+#endif
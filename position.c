@@ -0,0 +1,321 @@
+#include "position.h"
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <math.h>
+
+//
+// Extra travel added when a target lies at a limit, so that the move ends on
+// the switch and resynchronizes the estimate
+//
+#define LIMIT_OVERDRIVE     1.1
+
+/**
+ * Clamps an angle to the range of travel of an axis
+ *
+ * @param[in] angle The angle to clamp
+ * @param[in] range The range of travel of the axis
+ *
+ * @return Returns the clamped angle
+ */
+static double clamp_angle(double angle, double range)
+{
+    return angle < 0.0 ? 0.0 : (angle > range ? range : angle);
+}
+
+/**
+ * Works out the movement needed to take a single axis of the turret from its
+ * current estimated angle to a target angle
+ *
+ * @param[in] current The current angle of the axis
+ * @param[in] target The target angle of the axis
+ * @param[in] range The range of travel of the axis
+ * @param[in] decrease The movement that decreases the angle
+ * @param[in] decrease_rate The rate of travel when decreasing the angle
+ * @param[in] increase The movement that increases the angle
+ * @param[in] increase_rate The rate of travel when increasing the angle
+ * @param[out] movement Gets populated with the movement, or MOVEMENT_NONE if
+ *             the axis is already close enough
+ * @param[out] duration Gets populated with the time to move (in
+ *             microseconds)
+ */
+static void plan_axis(double current, double target, double range,
+        enum movement decrease, double decrease_rate,
+        enum movement increase, double increase_rate,
+        enum movement *movement, useconds_t *duration)
+{
+    double delta = target - current;
+    double rate = delta < 0.0 ? decrease_rate : increase_rate;
+    double duration_ms = fabs(delta) / rate;
+
+    // Targets at either end are reached by driving onto the switch
+    if (target <= 0.0 || target >= range)
+    {
+        duration_ms *= LIMIT_OVERDRIVE;
+    }
+
+    // Anything shorter than a millisecond is below what the motors resolve
+    *movement = duration_ms >= 1.0 ?
+        (delta < 0.0 ? decrease : increase) : MOVEMENT_NONE;
+    *duration = (useconds_t)(duration_ms * 1000.0);
+}
+
+void position_init(struct position *position)
+{
+    position->pan_known = false;
+    position->tilt_known = false;
+    position->pan = 0.0;
+    position->tilt = 0.0;
+    position->pan_range = DEFAULT_PAN_RANGE;
+    position->tilt_range = DEFAULT_TILT_RANGE;
+    position->left_rate = DEFAULT_PAN_RATE;
+    position->right_rate = DEFAULT_PAN_RATE;
+    position->up_rate = DEFAULT_TILT_RATE;
+    position->down_rate = DEFAULT_TILT_RATE;
+}
+
+void position_update(struct position *position, enum movement movement,
+        useconds_t moved, bool at_limit)
+{
+    double moved_ms = moved / 1000.0;
+
+    switch (movement)
+    {
+        case MOVEMENT_PAN_LEFT:
+            position->pan = at_limit ? 0.0 :
+                position->pan - moved_ms * position->left_rate;
+            position->pan_known |= at_limit;
+            break;
+        case MOVEMENT_PAN_RIGHT:
+            position->pan = at_limit ? position->pan_range :
+                position->pan + moved_ms * position->right_rate;
+            position->pan_known |= at_limit;
+            break;
+        case MOVEMENT_TILT_DOWN:
+            position->tilt = at_limit ? 0.0 :
+                position->tilt - moved_ms * position->down_rate;
+            position->tilt_known |= at_limit;
+            break;
+        case MOVEMENT_TILT_UP:
+            position->tilt = at_limit ? position->tilt_range :
+                position->tilt + moved_ms * position->up_rate;
+            position->tilt_known |= at_limit;
+            break;
+        default:
+            break;
+    }
+
+    position->pan = clamp_angle(position->pan, position->pan_range);
+    position->tilt = clamp_angle(position->tilt, position->tilt_range);
+}
+
+int position_load(struct position *position, const char *path)
+{
+    int ret = 0;
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        // Nothing has been saved yet
+        if (errno != ENOENT)
+        {
+            fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+            ret = -1;
+        }
+    }
+    else
+    {
+        char key[32];
+        double value;
+
+        while (fscanf(file, "%31s %lf", key, &value) == 2)
+        {
+            if (strcmp(key, "pan_known") == 0)
+                position->pan_known = value != 0.0;
+            else if (strcmp(key, "tilt_known") == 0)
+                position->tilt_known = value != 0.0;
+            else if (strcmp(key, "pan") == 0)
+                position->pan = value;
+            else if (strcmp(key, "tilt") == 0)
+                position->tilt = value;
+            else if (strcmp(key, "pan_range") == 0 && value > 0.0)
+                position->pan_range = value;
+            else if (strcmp(key, "tilt_range") == 0 && value > 0.0)
+                position->tilt_range = value;
+            else if (strcmp(key, "left_rate") == 0 && value > 0.0)
+                position->left_rate = value;
+            else if (strcmp(key, "right_rate") == 0 && value > 0.0)
+                position->right_rate = value;
+            else if (strcmp(key, "up_rate") == 0 && value > 0.0)
+                position->up_rate = value;
+            else if (strcmp(key, "down_rate") == 0 && value > 0.0)
+                position->down_rate = value;
+        }
+
+        if (!feof(file))
+        {
+            fprintf(stderr, "%s: Malformed state file\n", path);
+            ret = -1;
+        }
+
+        fclose(file);
+    }
+
+    return ret;
+}
+
+int position_save(const struct position *position, const char *path)
+{
+    int ret = 0;
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        ret = -1;
+    }
+    else
+    {
+        fprintf(file,
+                "pan_known %d\n"
+                "tilt_known %d\n"
+                "pan %.3f\n"
+                "tilt %.3f\n"
+                "pan_range %.3f\n"
+                "tilt_range %.3f\n"
+                "left_rate %.6f\n"
+                "right_rate %.6f\n"
+                "up_rate %.6f\n"
+                "down_rate %.6f\n",
+                position->pan_known, position->tilt_known,
+                position->pan, position->tilt,
+                position->pan_range, position->tilt_range,
+                position->left_rate, position->right_rate,
+                position->up_rate, position->down_rate);
+
+        if (fclose(file) != 0)
+        {
+            fprintf(stderr, "Failed to write %s\n", path);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int home_turret(struct launcher *launcher)
+{
+    int ret = 0;
+    struct position *position = &launcher->position;
+
+    // Forget the old estimate so that only reaching the switches counts
+    position->pan_known = false;
+    position->tilt_known = false;
+
+    // Both axes head for their switches together
+    if (move_turret_diagonal(launcher, MOVEMENT_TILT_DOWN, HOME_TIMEOUT_US,
+                MOVEMENT_PAN_LEFT, HOME_TIMEOUT_US) != 0)
+    {
+        fprintf(stderr, "Failed to move turret while homing\n");
+        ret = -1;
+    }
+    else if (!position->pan_known || !position->tilt_known)
+    {
+        fprintf(stderr, "Turret never reached its limit switches\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+useconds_t travel_time(const struct position *position, double from_pan,
+        double from_tilt, double to_pan, double to_tilt)
+{
+    enum movement movement;
+    useconds_t pan_duration;
+    useconds_t tilt_duration;
+
+    plan_axis(clamp_angle(from_pan, position->pan_range),
+            clamp_angle(to_pan, position->pan_range), position->pan_range,
+            MOVEMENT_PAN_LEFT, position->left_rate,
+            MOVEMENT_PAN_RIGHT, position->right_rate,
+            &movement, &pan_duration);
+    plan_axis(clamp_angle(from_tilt, position->tilt_range),
+            clamp_angle(to_tilt, position->tilt_range), position->tilt_range,
+            MOVEMENT_TILT_DOWN, position->down_rate,
+            MOVEMENT_TILT_UP, position->up_rate,
+            &movement, &tilt_duration);
+
+    return pan_duration > tilt_duration ? pan_duration : tilt_duration;
+}
+
+useconds_t limit_time(const struct position *position,
+        enum movement movement)
+{
+    double time_ms = 0.0;
+
+    switch (movement)
+    {
+        case MOVEMENT_PAN_LEFT:
+            time_ms = position->pan_known ?
+                position->pan / position->left_rate : 0.0;
+            break;
+        case MOVEMENT_PAN_RIGHT:
+            time_ms = position->pan_known ? (position->pan_range -
+                    position->pan) / position->right_rate : 0.0;
+            break;
+        case MOVEMENT_TILT_DOWN:
+            time_ms = position->tilt_known ?
+                position->tilt / position->down_rate : 0.0;
+            break;
+        case MOVEMENT_TILT_UP:
+            time_ms = position->tilt_known ? (position->tilt_range -
+                    position->tilt) / position->up_rate : 0.0;
+            break;
+        default:
+            break;
+    }
+
+    return (useconds_t)(time_ms * 1000.0);
+}
+
+int goto_position(struct launcher *launcher, double pan, double tilt)
+{
+    int ret = 0;
+    struct position *position = &launcher->position;
+
+    if (!position->pan_known || !position->tilt_known)
+    {
+        ret = home_turret(launcher);
+    }
+
+    pan = clamp_angle(pan, position->pan_range);
+    tilt = clamp_angle(tilt, position->tilt_range);
+
+    if (ret == 0)
+    {
+        enum movement pan_movement;
+        enum movement tilt_movement;
+        useconds_t pan_duration;
+        useconds_t tilt_duration;
+
+        plan_axis(position->pan, pan, position->pan_range,
+                MOVEMENT_PAN_LEFT, position->left_rate,
+                MOVEMENT_PAN_RIGHT, position->right_rate,
+                &pan_movement, &pan_duration);
+        plan_axis(position->tilt, tilt, position->tilt_range,
+                MOVEMENT_TILT_DOWN, position->down_rate,
+                MOVEMENT_TILT_UP, position->up_rate,
+                &tilt_movement, &tilt_duration);
+
+        // Drive both axes at once, so the move takes only as long as the
+        // longer of the two
+        if (pan_movement != MOVEMENT_NONE || tilt_movement != MOVEMENT_NONE)
+        {
+            ret = move_turret_diagonal(launcher, tilt_movement,
+                    tilt_duration, pan_movement, pan_duration);
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,119 @@
+#ifndef POSITION_H
+#define POSITION_H
+
+#include "launcher.h"
+
+//
+// Default location of the persisted position estimate
+//
+#define DEFAULT_STATE_PATH  "/tmp/" PROGRAM_NAME ".state"
+
+//
+// Nominal range of travel, in degrees, and rates of travel, in degrees per
+// millisecond, used until better figures are stored in the state file
+//
+#define DEFAULT_PAN_RANGE   270.0
+#define DEFAULT_TILT_RANGE  30.0
+#define DEFAULT_PAN_RATE    0.06
+#define DEFAULT_TILT_RATE   0.03
+
+//
+// Longest time to drive towards a limit switch while homing
+//
+#define HOME_TIMEOUT_US     8000000
+
+/**
+ * Resets a position estimate to an unknown position with the default rates
+ *
+ * @param[out] position The position estimate to initialize
+ */
+void position_init(struct position *position);
+
+/**
+ * Folds a completed movement into a position estimate. Reaching a limit
+ * switch pins the corresponding axis to the end of its range, which makes
+ * the position along that axis known.
+ *
+ * @param[in,out] position The position estimate to update
+ * @param[in] movement The direction the turret moved
+ * @param[in] moved The time spent moving (in microseconds)
+ * @param[in] at_limit Whether the movement ended at the limit switch
+ */
+void position_update(struct position *position, enum movement movement,
+        useconds_t moved, bool at_limit);
+
+/**
+ * Restores a position estimate saved by position_save. A missing file is
+ * not an error and leaves the estimate unchanged.
+ *
+ * @param[in,out] position The position estimate to populate
+ * @param[in] path The path of the state file
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int position_load(struct position *position, const char *path);
+
+/**
+ * Saves a position estimate so that later invocations can carry on from it
+ *
+ * @param[in] position The position estimate to save
+ * @param[in] path The path of the state file
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int position_save(const struct position *position, const char *path);
+
+/**
+ * Drives the turret to its left and down limits, which makes its position
+ * known
+ *
+ * @param[in] launcher The launcher to operate
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int home_turret(struct launcher *launcher);
+
+/**
+ * Estimates how long goto_position takes to move the turret between two
+ * positions. Both axes move at once, so the move takes as long as the slower
+ * of the two, including the extra travel used to land on a limit switch.
+ * Positions outside the range of travel are clamped to the nearest limit.
+ *
+ * @param[in] position The position estimate, for its ranges and rates
+ * @param[in] from_pan The starting angle, in degrees right of the left limit
+ * @param[in] from_tilt The starting angle, in degrees above the down limit
+ * @param[in] to_pan The target angle, in degrees right of the left limit
+ * @param[in] to_tilt The target angle, in degrees above the down limit
+ *
+ * @return Returns the time the move takes (in microseconds)
+ */
+useconds_t travel_time(const struct position *position, double from_pan,
+        double from_tilt, double to_pan, double to_tilt);
+
+/**
+ * Predicts how long the turret can move in a direction before it reaches
+ * the limit switch at that end
+ *
+ * @param[in] position The position estimate
+ * @param[in] movement The direction of travel
+ *
+ * @return Returns the time until the limit should be reached (in
+ *         microseconds), or zero if the position along that axis is unknown
+ */
+useconds_t limit_time(const struct position *position,
+        enum movement movement);
+
+/**
+ * Moves the turret to an absolute position, homing first if the current
+ * position is not known. Both axes move at once. Targets outside the range
+ * of travel are clamped to the nearest limit.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] pan The target angle, in degrees right of the left limit
+ * @param[in] tilt The target angle, in degrees above the down limit
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int goto_position(struct launcher *launcher, double pan, double tilt);
+
+#endif
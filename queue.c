@@ -0,0 +1,62 @@
+#include "queue.h"
+#include <stddef.h>
+
+void queue_init(struct queue *queue)
+{
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->head, &queue->stub);
+    queue->tail = &queue->stub;
+}
+
+void queue_push(struct queue *queue, struct queue_node *node)
+{
+    struct queue_node *prev;
+
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+
+    // Claim the back of the queue, then link the previous node to this one.
+    // Between the two the consumer sees the queue end at the previous node.
+    prev = atomic_exchange_explicit(&queue->head, node, memory_order_acq_rel);
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+struct queue_node *queue_pop(struct queue *queue)
+{
+    struct queue_node *tail = queue->tail;
+    struct queue_node *next =
+        atomic_load_explicit(&tail->next, memory_order_acquire);
+    struct queue_node *node = NULL;
+
+    // Step over the stub, which only marks an empty queue
+    if (tail == &queue->stub && next != NULL)
+    {
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    }
+
+    if (tail == &queue->stub)
+    {
+        // Nothing queued
+    }
+    else if (next != NULL)
+    {
+        queue->tail = next;
+        node = tail;
+    }
+    else if (tail == atomic_load_explicit(&queue->head, memory_order_acquire))
+    {
+        // The last node can only be taken once another follows it, so put
+        // the stub back behind it
+        queue_push(queue, &queue->stub);
+        next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+        if (next != NULL)
+        {
+            queue->tail = next;
+            node = tail;
+        }
+    }
+
+    return node;
+}
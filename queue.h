@@ -0,0 +1,54 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdatomic.h>
+
+/**
+ * Link embedded in anything that can be queued
+ */
+struct queue_node
+{
+    _Atomic(struct queue_node *) next;
+};
+
+/**
+ * An unbounded first-in first-out queue that any number of threads may push
+ * onto at once without locking, while a single thread pops from it. A push
+ * is one atomic exchange followed by a store, so a producer never waits on
+ * the consumer or on other producers. Nodes are linked in place, and belong
+ * to the queue from being pushed until being popped.
+ */
+struct queue
+{
+    _Atomic(struct queue_node *) head;  // Most recently pushed node
+    struct queue_node *tail;            // Next node to pop, consumer only
+    struct queue_node stub;             // Stands in when the queue is empty
+};
+
+/**
+ * Prepares an empty queue
+ *
+ * @param[out] queue The queue to initialize
+ */
+void queue_init(struct queue *queue);
+
+/**
+ * Adds a node to the back of a queue. May be called from any thread.
+ *
+ * @param[in,out] queue The queue to add to
+ * @param[in] node The node to add
+ */
+void queue_push(struct queue *queue, struct queue_node *node);
+
+/**
+ * Takes the node from the front of a queue. Must only be called from the
+ * queue's consumer thread. A node whose push is still in progress is not
+ * yet visible, so the caller should try again once told of the push.
+ *
+ * @param[in,out] queue The queue to take from
+ *
+ * @return Returns the node, or NULL if the queue is empty
+ */
+struct queue_node *queue_pop(struct queue *queue);
+
+#endif
@@ -0,0 +1,118 @@
+#include "realtime.h"
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+//
+// Stack touched up front so that later calls don't fault in fresh pages
+//
+#define PREFAULT_STACK_SIZE (64 * 1024)
+
+/**
+ * Touches a stretch of stack so that its pages are resident, and therefore
+ * locked, before any time-critical work starts
+ */
+static void prefault_stack(void)
+{
+    volatile unsigned char stack[PREFAULT_STACK_SIZE];
+    size_t i;
+
+    for (i = 0; i < sizeof(stack); i += 4096)
+    {
+        stack[i] = 0;
+    }
+}
+
+int realtime_enter(int priority, int cpu)
+{
+    int ret = 0;
+    int error;
+    struct sched_param param;
+    cpu_set_t cpus;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+
+    if (cpu < 0)
+    {
+        cpu = sched_getcpu();
+    }
+
+    if (priority < sched_get_priority_min(SCHED_FIFO) ||
+            priority > sched_get_priority_max(SCHED_FIFO))
+    {
+        fprintf(stderr, "Invalid real-time priority: %d\n", priority);
+        ret = -1;
+    }
+    else if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        fprintf(stderr, "Invalid CPU: %d\n", cpu);
+        ret = -1;
+    }
+    else if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    {
+        fprintf(stderr, "Failed to lock memory: %s\n", strerror(errno));
+        ret = -1;
+    }
+    else
+    {
+        prefault_stack();
+
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+
+        error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+        if (error != 0)
+        {
+            fprintf(stderr, "Failed to pin to CPU %d: %s\n", cpu,
+                    strerror(error));
+            ret = -1;
+        }
+    }
+
+    if (ret == 0)
+    {
+        error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+        if (error != 0)
+        {
+            fprintf(stderr, "Failed to switch to real-time scheduling: %s\n",
+                    strerror(error));
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+int realtime_spread_cpu(int first, size_t index)
+{
+    int cpu = first < 0 ? sched_getcpu() : first;
+    int allowed;
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+
+    if (cpu >= 0 && cpu < CPU_SETSIZE &&
+            sched_getaffinity(0, sizeof(cpus), &cpus) == 0)
+    {
+        allowed = CPU_COUNT(&cpus);
+
+        // Step over the CPUs the process is kept off, wrapping round once
+        // every thread has one
+        for (index %= allowed > 0 ? (size_t)allowed : 1; index != 0; index--)
+        {
+            do
+            {
+                cpu = (cpu + 1) % CPU_SETSIZE;
+            }
+            while (!CPU_ISSET(cpu, &cpus));
+        }
+    }
+
+    return cpu;
+}
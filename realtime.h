@@ -0,0 +1,41 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stddef.h>
+
+//
+// Real-time priority used when none is given
+//
+#define DEFAULT_REALTIME_PRIORITY   50
+
+/**
+ * Readies the calling thread for deterministic hold timing. All of the
+ * process's memory is locked so that page faults can't stall it, the thread
+ * switches to the SCHED_FIFO scheduling policy so that ordinary work can't
+ * preempt it, and it is pinned to a single CPU so that it isn't migrated
+ * mid-hold. Threads it starts afterwards inherit the policy and the CPU.
+ * Usually needs root or CAP_SYS_NICE and CAP_IPC_LOCK.
+ *
+ * @param[in] priority The SCHED_FIFO priority, from 1 to 99
+ * @param[in] cpu The CPU to pin to, or -1 for the one currently running the
+ *            thread
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int realtime_enter(int priority, int cpu);
+
+/**
+ * Picks a CPU for one of several threads entering real-time mode, so that
+ * each gets a CPU of its own rather than all of them contending for one.
+ * The threads take turns through the CPUs the process may run on, starting
+ * from the first, and share them only once every one is taken.
+ *
+ * @param[in] first The CPU for the first thread, or -1 for the one currently
+ *            running the calling thread
+ * @param[in] index Which of the threads the CPU is for, counting from zero
+ *
+ * @return Returns the CPU, or -1 if none could be found
+ */
+int realtime_spread_cpu(int first, size_t index);
+
+#endif
@@ -0,0 +1,207 @@
+#include "recording.h"
+#include <string.h>
+
+//
+// Longest delay a single entry can hold, in microseconds
+//
+#define MAX_ENTRY_DELAY     UINT32_MAX
+
+int recording_open(struct recording *recording, const char *path)
+{
+    int ret = 0;
+    uint8_t header[RECORDING_HEADER_SIZE];
+
+    memset(recording, 0, sizeof(*recording));
+    memset(header, 0, sizeof(header));
+    memcpy(header, RECORDING_MAGIC, strlen(RECORDING_MAGIC));
+    header[4] = RECORDING_VERSION;
+
+    recording->file = fopen(path, "wb");
+
+    if (recording->file == NULL)
+    {
+        fprintf(stderr, "Failed to create recording %s\n", path);
+        ret = -1;
+    }
+    else if (fwrite(header, sizeof(header), 1, recording->file) != 1)
+    {
+        fprintf(stderr, "Failed to write recording %s\n", path);
+        fclose(recording->file);
+        recording->file = NULL;
+        ret = -1;
+    }
+
+    return ret;
+}
+
+void recording_add(struct recording *recording, enum record_kind kind,
+        uint8_t value, uint64_t when)
+{
+    uint8_t entry[RECORDING_ENTRY_SIZE];
+    uint64_t delay = 0;
+
+    if (recording->started && when > recording->last)
+    {
+        delay = when - recording->last;
+    }
+
+    // Anything longer than an entry can hold was idle time anyway
+    if (delay > MAX_ENTRY_DELAY)
+    {
+        delay = MAX_ENTRY_DELAY;
+    }
+
+    entry[0] = (uint8_t)(delay >> 24);
+    entry[1] = (uint8_t)(delay >> 16);
+    entry[2] = (uint8_t)(delay >> 8);
+    entry[3] = (uint8_t)delay;
+    entry[4] = kind;
+    entry[5] = value;
+
+    if (fwrite(entry, sizeof(entry), 1, recording->file) != 1)
+    {
+        recording->failed = true;
+    }
+
+    recording->started = true;
+    recording->last = when;
+}
+
+int recording_close(struct recording *recording)
+{
+    int ret = 0;
+
+    if (fclose(recording->file) != 0 || recording->failed)
+    {
+        fprintf(stderr, "Failed to write recording\n");
+        ret = -1;
+    }
+
+    recording->file = NULL;
+
+    return ret;
+}
+
+/**
+ * Checks that a file starts with a recording header this version can read
+ *
+ * @param[in] file The file to check
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+static int read_header(FILE *file)
+{
+    int ret = 0;
+    uint8_t header[RECORDING_HEADER_SIZE];
+
+    if (fread(header, sizeof(header), 1, file) != 1 ||
+            memcmp(header, RECORDING_MAGIC, strlen(RECORDING_MAGIC)) != 0)
+    {
+        fprintf(stderr, "Not a recording\n");
+        ret = -1;
+    }
+    else if (header[4] != RECORDING_VERSION)
+    {
+        fprintf(stderr, "Unsupported recording version %u\n", header[4]);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int recording_replay(struct launcher *launcher, const char *path)
+{
+    int ret = 0;
+    FILE *file = fopen(path, "rb");
+    uint8_t entry[RECORDING_ENTRY_SIZE];
+    uint64_t deadline = timing_now();
+    uint8_t status = 0;
+    bool status_read = false;
+    unsigned int statuses = 0;
+    unsigned int mismatches = 0;
+    uint8_t cmd = 0;
+    size_t len = 0;
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Failed to open recording %s\n", path);
+        ret = -1;
+    }
+    else
+    {
+        ret = read_header(file);
+    }
+
+    while (ret == 0 &&
+            (len = fread(entry, 1, sizeof(entry), file)) == sizeof(entry))
+    {
+        deadline += ((uint32_t)entry[0] << 24) | ((uint32_t)entry[1] << 16) |
+            ((uint32_t)entry[2] << 8) | entry[3];
+
+        if (entry[4] == RECORD_COMMAND)
+        {
+            trace_sleep_until(&launcher->trace, deadline);
+
+            if (entry[5] == CMD_GET_STATUS)
+            {
+                // The request has to be read back like any other, and the
+                // status recorded next is what it should say
+                ret = get_status(launcher, &status);
+                status_read = ret == 0;
+            }
+            else
+            {
+                ret = send_command(launcher, entry[5]);
+                cmd = entry[5];
+            }
+        }
+        else if (entry[4] == RECORD_STATUS)
+        {
+            if (status_read)
+            {
+                statuses++;
+                mismatches += status != entry[5];
+            }
+
+            status_read = false;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown entry in recording\n");
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 && ferror(file))
+    {
+        fprintf(stderr, "Failed to read recording %s\n", path);
+        ret = -1;
+    }
+    else if (ret == 0 && len != 0)
+    {
+        fprintf(stderr, "Recording %s is truncated\n", path);
+        ret = -1;
+    }
+
+    // Don't leave the motors running if the replay was cut short
+    if (ret != 0 && cmd != 0 && cmd != CMD_STOP)
+    {
+        send_command(launcher, CMD_STOP);
+    }
+
+    if (mismatches != 0)
+    {
+        fprintf(stderr, "%u of %u status reads differed from the recording\n",
+                mismatches, statuses);
+    }
+
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+
+    launcher->position.pan_known = false;
+    launcher->position.tilt_known = false;
+
+    return ret;
+}
@@ -0,0 +1,97 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "launcher.h"
+#include <stdio.h>
+
+//
+// Identifies a recording file, and the version of its layout
+//
+#define RECORDING_MAGIC         "MLRC"
+#define RECORDING_VERSION       1
+
+//
+// Sizes of the parts of a recording file, in bytes
+//
+#define RECORDING_HEADER_SIZE   8
+#define RECORDING_ENTRY_SIZE    6
+
+/*
+ * A recording is a header followed by one entry for every output report
+ * written and every status byte read. Multi-byte fields are big-endian.
+ *
+ *     header:  char[4] RECORDING_MAGIC, uint8 version, uint8[3] reserved
+ *     entry:   uint32 delay, uint8 kind, uint8 value
+ *
+ * The delay is in microseconds since the previous entry, or zero for the
+ * first. The value is the command sent for a RECORD_COMMAND entry and the
+ * status byte received for a RECORD_STATUS entry.
+ */
+
+/**
+ * The kinds of entry in a recording
+ */
+enum record_kind
+{
+    RECORD_COMMAND,
+    RECORD_STATUS,
+};
+
+/**
+ * A recording being written as a launcher is driven
+ */
+struct recording
+{
+    FILE *file;
+    bool started;           // Whether any entry has been written yet
+    bool failed;            // Whether any write has failed
+    uint64_t last;          // When the previous entry happened, as timing_now
+};
+
+/**
+ * Creates a recording file and writes its header
+ *
+ * @param[out] recording The recording to open
+ * @param[in] path The file to write, which is replaced if it exists
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int recording_open(struct recording *recording, const char *path);
+
+/**
+ * Appends an entry to a recording. Failures are remembered and reported by
+ * recording_close, so as not to disturb the launcher being recorded.
+ *
+ * @param[in,out] recording The recording to append to
+ * @param[in] kind The kind of entry
+ * @param[in] value The command sent or status byte received
+ * @param[in] when When it happened (as timing_now)
+ */
+void recording_add(struct recording *recording, enum record_kind kind,
+        uint8_t value, uint64_t when);
+
+/**
+ * Finishes a recording and closes its file
+ *
+ * @param[in,out] recording The recording to close
+ *
+ * @return Returns zero if the whole recording was written or non-zero
+ *         otherwise
+ */
+int recording_close(struct recording *recording);
+
+/**
+ * Sends the commands in a recording to a launcher with the same timing as
+ * when they were recorded. Each status request is answered by the launcher
+ * again, and any status that differs from the recorded one is counted and
+ * reported at the end. The commands bypass the position estimate, so the
+ * turret's position is unknown afterwards.
+ *
+ * @param[in] launcher The launcher to operate
+ * @param[in] path The recording to replay
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int recording_replay(struct launcher *launcher, const char *path);
+
+#endif
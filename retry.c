@@ -0,0 +1,234 @@
+#include "retry.h"
+#include "launcher.h"
+#include "monitor.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * A device whose failed transfers are tried again
+ */
+struct retry_device
+{
+    const struct transport_ops *transport;
+    void *handle;                   // The wrapped backend's handle
+    unsigned int retries;
+    struct retry_counts *counts;    // Where failures are counted
+    struct retry_counts own_counts; // Used when the caller keeps none
+    struct status_snapshot *snapshot;   // Where another thread publishes
+                                        // the status, or NULL
+};
+
+/**
+ * Waits before trying a transfer again
+ *
+ * @param[in] attempt The number of retries already made
+ */
+static void retry_backoff(unsigned int attempt)
+{
+    useconds_t delay = attempt < 16 ? RETRY_BACKOFF_US << attempt :
+        RETRY_MAX_BACKOFF_US;
+
+    delay = delay < RETRY_MAX_BACKOFF_US ? delay : RETRY_MAX_BACKOFF_US;
+
+    // The low digits of the clock are as good as random at this scale
+    timing_sleep(delay - timing_now() % (delay / 2 + 1));
+}
+
+/**
+ * Adds one to a failure count
+ *
+ * @param[in,out] count The count
+ */
+static void retry_count(atomic_uint_fast64_t *count)
+{
+    atomic_fetch_add_explicit(count, 1, memory_order_relaxed);
+}
+
+/**
+ * Checks that the launcher answers a status request, straight through the
+ * wrapped backend, or through the snapshot if another thread does all the
+ * reading
+ *
+ * @param[in] device The device
+ *
+ * @return Returns zero if a status report arrived or non-zero otherwise
+ */
+static int retry_check(const struct retry_device *device)
+{
+    int ret = -1;
+    uint8_t request[2] = { 0, CMD_GET_STATUS };
+    uint8_t status;
+
+    if (device->snapshot != NULL)
+    {
+        uint64_t start = timing_now();
+        uint64_t deadline = start + RETRY_CHECK_TIMEOUT_MS * 1000;
+        uint64_t timestamp;
+
+        // Reading the device here would race the monitor for its reports,
+        // so ask it for a fresh one instead
+        snapshot_request(device->snapshot, start);
+
+        while (ret != 0 && timing_now() < deadline)
+        {
+            timing_sleep(RETRY_CHECK_POLL_US);
+
+            if (snapshot_read(device->snapshot, &status, &timestamp) != 0 &&
+                    timestamp >= start)
+            {
+                ret = 0;
+            }
+        }
+    }
+    else if (device->transport->write(device->handle, request,
+                sizeof(request)) >= 0 &&
+            device->transport->read(device->handle, &status,
+                sizeof(status), RETRY_CHECK_TIMEOUT_MS) > 0)
+    {
+        ret = 0;
+    }
+
+    return ret;
+}
+
+/**
+ * Writes an output report, trying again with backoff if the command is safe
+ * to repeat
+ */
+static int retry_write(void *handle, const uint8_t *data, size_t length)
+{
+    struct retry_device *device = handle;
+    uint8_t cmd = length >= 2 ? data[1] : 0;
+    unsigned int attempt = 0;
+    bool repeatable = true;
+    int ret = device->transport->write(device->handle, data, length);
+
+    while (ret < 0 && attempt < device->retries && repeatable)
+    {
+        retry_backoff(attempt);
+        attempt++;
+
+        // Don't send a fire command to a launcher that can't even answer
+        repeatable = !(cmd & CMD_FIRE) || retry_check(device) == 0;
+
+        if (repeatable)
+        {
+            retry_count(&device->counts->retries);
+            ret = device->transport->write(device->handle, data, length);
+        }
+    }
+
+    if (ret < 0)
+    {
+        retry_count(&device->counts->failed);
+    }
+    else if (attempt != 0)
+    {
+        retry_count(&device->counts->recovered);
+    }
+
+    return ret;
+}
+
+/**
+ * Reads an input report, asking for the status again and retrying with
+ * backoff if the read fails
+ */
+static int retry_read(void *handle, uint8_t *data, size_t length,
+        int timeout_ms)
+{
+    struct retry_device *device = handle;
+    uint8_t request[2] = { 0, CMD_GET_STATUS };
+    unsigned int attempt = 0;
+    int ret = device->transport->read(device->handle, data, length,
+            timeout_ms);
+
+    // Running out of time isn't a failure, so only errors are retried
+    while (ret < 0 && attempt < device->retries)
+    {
+        retry_backoff(attempt);
+        attempt++;
+        retry_count(&device->counts->retries);
+
+        if (device->transport->write(device->handle, request,
+                    sizeof(request)) >= 0)
+        {
+            ret = device->transport->read(device->handle, data, length,
+                    timeout_ms);
+        }
+    }
+
+    if (ret < 0)
+    {
+        retry_count(&device->counts->failed);
+    }
+    else if (attempt != 0)
+    {
+        retry_count(&device->counts->recovered);
+    }
+
+    return ret;
+}
+
+/**
+ * Closes the wrapped device and releases the wrapper
+ */
+static void retry_close(void *handle)
+{
+    struct retry_device *device = handle;
+
+    device->transport->close(device->handle);
+    free(device);
+}
+
+/**
+ * Gets the wrapped device's file descriptor, if it has one
+ */
+static int retry_get_fd(void *handle)
+{
+    struct retry_device *device = handle;
+
+    return device->transport->get_fd != NULL ?
+        device->transport->get_fd(device->handle) : -1;
+}
+
+const struct transport_ops retry_transport =
+{
+    .name = "retry",
+    .write = retry_write,
+    .read = retry_read,
+    .close = retry_close,
+    .get_fd = retry_get_fd,
+};
+
+void *retry_open(const struct transport_ops *transport, void *handle,
+        unsigned int retries, struct retry_counts *counts)
+{
+    struct retry_device *device = malloc(sizeof(*device));
+
+    if (device == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        transport->close(handle);
+    }
+    else
+    {
+        device->transport = transport;
+        device->handle = handle;
+        device->retries = retries;
+        atomic_init(&device->own_counts.retries, 0);
+        atomic_init(&device->own_counts.recovered, 0);
+        atomic_init(&device->own_counts.failed, 0);
+        device->counts = counts != NULL ? counts : &device->own_counts;
+        device->snapshot = NULL;
+    }
+
+    return device;
+}
+
+void retry_use_snapshot(void *handle, struct status_snapshot *snapshot)
+{
+    struct retry_device *device = handle;
+
+    device->snapshot = snapshot;
+}
@@ -0,0 +1,84 @@
+#ifndef RETRY_H
+#define RETRY_H
+
+#include "transport.h"
+#include <stdatomic.h>
+
+//
+// Default and greatest number of times a failed transfer is tried again
+//
+#define DEFAULT_RETRIES     2
+#define MAX_RETRIES         10
+
+//
+// Delay before the first retry of a transfer, doubling for each retry after
+// it up to the maximum, in microseconds. Each delay is jittered down by up
+// to half, so that two threads failing together don't retry in lockstep.
+//
+#define RETRY_BACKOFF_US        2000
+#define RETRY_MAX_BACKOFF_US    50000
+
+//
+// Longest to wait for the status read that has to succeed before a fire
+// command is sent again, in milliseconds
+//
+#define RETRY_CHECK_TIMEOUT_MS  100
+
+//
+// Time between looks at a status snapshot while waiting for that read, in
+// microseconds
+//
+#define RETRY_CHECK_POLL_US     1000
+
+struct status_snapshot;
+
+/**
+ * Running totals of the failed transfers seen by retry_transport. They may
+ * be shared between the threads and reconnections of a launcher.
+ */
+struct retry_counts
+{
+    atomic_uint_fast64_t retries;   // Transfers tried again
+    atomic_uint_fast64_t recovered; // Transfers that succeeded on a retry
+    atomic_uint_fast64_t failed;    // Transfers given up on
+};
+
+/**
+ * Transport that wraps another and tries failed transfers again, backing off
+ * between tries. Only transfers that are safe to repeat are retried. Status
+ * requests and reads are, with each read retry asking for the status again,
+ * since a report only ever arrives in answer to a request. So are stops and
+ * movements, which only set which motors are running. A fire command is
+ * only sent again once a status round trip shows the launcher answering, so
+ * that it is never repeated into a link that is still failing. While a
+ * monitor is polling the launcher that round trip is the monitor's, asked
+ * for through its snapshot, since only the monitor may read the device.
+ */
+extern const struct transport_ops retry_transport;
+
+/**
+ * Wraps an open device so that its failed transfers are tried again
+ *
+ * @param[in] transport The backend that reaches the device
+ * @param[in] handle The backend's handle for the open device, which belongs
+ *            to the wrapper from now on
+ * @param[in] retries The number of times each failed transfer is tried again
+ * @param[in,out] counts Where failed transfers are counted, or NULL
+ *
+ * @return Returns a handle for use with retry_transport on success or NULL
+ *         otherwise, in which case the device has been closed
+ */
+void *retry_open(const struct transport_ops *transport, void *handle,
+        unsigned int retries, struct retry_counts *counts);
+
+/**
+ * Points a wrapped device at the snapshot another thread publishes its
+ * status in, or back at reading the device itself. Must not be called while
+ * a transfer is in progress.
+ *
+ * @param[in,out] handle The handle returned by retry_open
+ * @param[in] snapshot The snapshot, or NULL to read the device directly
+ */
+void retry_use_snapshot(void *handle, struct status_snapshot *snapshot);
+
+#endif
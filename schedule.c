@@ -0,0 +1,141 @@
+#include "schedule.h"
+#include "position.h"
+
+/**
+ * Works out how long the turret takes to travel from one target to another
+ *
+ * @param[in] position The turret's position estimate
+ * @param[in] pan The starting pan angle, in degrees
+ * @param[in] tilt The starting tilt angle, in degrees
+ * @param[in] target The target to travel to
+ *
+ * @return Returns the travel time (in microseconds)
+ */
+static uint64_t leg_time(const struct position *position, double pan,
+        double tilt, const struct action *target)
+{
+    return travel_time(position, pan, tilt, target->pan / 10.0,
+            target->tilt / 10.0);
+}
+
+/**
+ * Works out how long the turret takes to visit a sequence of targets in
+ * order from a starting position
+ *
+ * @param[in] position The turret's position estimate
+ * @param[in] pan The starting pan angle, in degrees
+ * @param[in] tilt The starting tilt angle, in degrees
+ * @param[in] targets The targets, in the order they are visited
+ * @param[in] count The number of targets
+ *
+ * @return Returns the total travel time (in microseconds)
+ */
+static uint64_t tour_time(const struct position *position, double pan,
+        double tilt, const struct action *targets, size_t count)
+{
+    uint64_t total = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        total += leg_time(position, pan, tilt, &targets[i]);
+        pan = targets[i].pan / 10.0;
+        tilt = targets[i].tilt / 10.0;
+    }
+
+    return total;
+}
+
+/**
+ * Reverses the order of a stretch of targets
+ *
+ * @param[in,out] targets The targets to reverse
+ * @param[in] count The number of targets
+ */
+static void reverse_targets(struct action *targets, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < count / 2; i++)
+    {
+        struct action swap = targets[i];
+
+        targets[i] = targets[count - 1 - i];
+        targets[count - 1 - i] = swap;
+    }
+}
+
+void schedule_targets(const struct position *position, struct action *targets,
+        size_t count)
+{
+    bool known = position->pan_known && position->tilt_known;
+    double start_pan = known ? position->pan : 0.0;
+    double start_tilt = known ? position->tilt : 0.0;
+    double pan = start_pan;
+    double tilt = start_tilt;
+    uint64_t best;
+    bool improved = true;
+    size_t i;
+    size_t j;
+
+    // Visit whichever remaining target is quickest to reach next
+    for (i = 0; i + 1 < count; i++)
+    {
+        size_t nearest = i;
+        uint64_t nearest_time = leg_time(position, pan, tilt, &targets[i]);
+
+        for (j = i + 1; j < count; j++)
+        {
+            uint64_t time = leg_time(position, pan, tilt, &targets[j]);
+
+            if (time < nearest_time)
+            {
+                nearest = j;
+                nearest_time = time;
+            }
+        }
+
+        if (nearest != i)
+        {
+            struct action swap = targets[i];
+
+            targets[i] = targets[nearest];
+            targets[nearest] = swap;
+        }
+
+        pan = targets[i].pan / 10.0;
+        tilt = targets[i].tilt / 10.0;
+    }
+
+    // Then keep reversing whichever stretches shorten the tour. The rates
+    // differ by direction, so reversing a stretch changes its own length as
+    // well as its ends, and the whole tour is measured each time.
+    best = tour_time(position, start_pan, start_tilt, targets, count);
+
+    while (improved)
+    {
+        improved = false;
+
+        for (i = 0; i + 1 < count; i++)
+        {
+            for (j = i + 2; j <= count; j++)
+            {
+                uint64_t time;
+
+                reverse_targets(&targets[i], j - i);
+                time = tour_time(position, start_pan, start_tilt, targets,
+                        count);
+
+                if (time < best)
+                {
+                    best = time;
+                    improved = true;
+                }
+                else
+                {
+                    reverse_targets(&targets[i], j - i);
+                }
+            }
+        }
+    }
+}
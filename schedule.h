@@ -0,0 +1,23 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "action.h"
+
+/**
+ * Reorders a batch of targets to cut the time spent travelling between them.
+ * The tour starts from the turret's current position, or from the left and
+ * down limits if the position is unknown, since that's where homing leaves
+ * it. A nearest-neighbour tour is built first and then improved by
+ * reversing stretches of it (2-opt) for as long as that shortens it. Travel
+ * times come from travel_time, so they follow the turret's per-direction
+ * rates and the extra travel used to land on a limit switch.
+ *
+ * @param[in] position The turret's position estimate
+ * @param[in,out] targets The targets to reorder, which are goto or target
+ *                actions
+ * @param[in] count The number of targets
+ */
+void schedule_targets(const struct position *position, struct action *targets,
+        size_t count);
+
+#endif
@@ -0,0 +1,231 @@
+#include "script.h"
+#include <string.h>
+#include <errno.h>
+
+//
+// Longest script line accepted, including the terminator
+//
+#define MAX_LINE_LENGTH     256
+
+//
+// Characters separating the words on a script line
+//
+#define WORD_SEPARATORS     " \t\r\n"
+
+/**
+ * Parses the words of a single script line into an action
+ *
+ * @param[in] words The words of the line, NULL-terminated
+ * @param[in,out] list The list to append the parsed action to
+ *
+ * @return Returns zero on success or non-zero if the line is malformed
+ */
+static int parse_line(char **words, struct action_list *list)
+{
+    int ret = 0;
+    enum movement movement = MOVEMENT_NONE;
+    enum movement pan_movement;
+    useconds_t duration = MOVE_HOLD_TIME_US;
+
+    if (strcmp(words[0], "move") == 0 && words[1] != NULL &&
+            strchr(words[1], '-') != NULL)
+    {
+        struct action action;
+
+        memset(&action, 0, sizeof(action));
+        action.type = ACTION_DIAGONAL;
+        action.duration = MOVE_HOLD_TIME_US;
+        action.pan_duration = MOVE_HOLD_TIME_US;
+
+        if (parse_diagonal(words[1], &movement, &pan_movement) != 0 ||
+                (words[2] != NULL &&
+                    parse_duration(words[2], &action.duration) != 0) ||
+                (words[2] != NULL && words[3] == NULL &&
+                    parse_duration(words[2], &action.pan_duration) != 0) ||
+                (words[2] != NULL && words[3] != NULL &&
+                    parse_duration(words[3], &action.pan_duration) != 0))
+        {
+            ret = -1;
+        }
+        else
+        {
+            action.movement = movement;
+            action.pan_movement = pan_movement;
+            ret = action_list_add(list, &action);
+        }
+    }
+    else if (strcmp(words[0], "move") == 0)
+    {
+        if (words[1] == NULL || parse_movement(words[1], &movement) != 0 ||
+                (words[2] != NULL && (parse_duration(words[2], &duration) != 0 ||
+                                      words[3] != NULL)))
+        {
+            ret = -1;
+        }
+        else
+        {
+            ret = action_list_append(list, ACTION_MOVE, movement, duration);
+        }
+    }
+    else if (strcmp(words[0], "fire") == 0 &&
+            (words[1] == NULL || words[2] == NULL))
+    {
+        struct action action;
+
+        memset(&action, 0, sizeof(action));
+        action.type = ACTION_FIRE;
+        action.shots = 1;
+
+        if (words[1] != NULL && parse_shots(words[1], &action.shots) != 0)
+        {
+            ret = -1;
+        }
+        else
+        {
+            ret = action_list_add(list, &action);
+        }
+    }
+    else if (strcmp(words[0], "status") == 0 && words[1] == NULL)
+    {
+        ret = action_list_append(list, ACTION_STATUS, movement, 0);
+    }
+    else if (strcmp(words[0], "wait") == 0 && words[1] != NULL &&
+            words[2] == NULL && parse_duration(words[1], &duration) == 0)
+    {
+        ret = action_list_append(list, ACTION_WAIT, movement, duration);
+    }
+    else if (strcmp(words[0], "stop") == 0 && words[1] == NULL)
+    {
+        ret = action_list_append(list, ACTION_STOP, movement, 0);
+    }
+    else if (strcmp(words[0], "home") == 0 && words[1] == NULL)
+    {
+        ret = action_list_append(list, ACTION_HOME, movement, 0);
+    }
+    else if (strcmp(words[0], "goto") == 0 && words[1] != NULL &&
+            words[2] == NULL)
+    {
+        struct action action;
+
+        memset(&action, 0, sizeof(action));
+        action.type = ACTION_GOTO;
+
+        if (parse_target(words[1], &action.pan, &action.tilt) != 0)
+        {
+            ret = -1;
+        }
+        else
+        {
+            ret = action_list_add(list, &action);
+        }
+    }
+    else if (strcmp(words[0], "target") == 0 && words[1] != NULL &&
+            (words[2] == NULL || words[3] == NULL))
+    {
+        struct action action;
+
+        memset(&action, 0, sizeof(action));
+        action.type = ACTION_TARGET;
+        action.shots = 1;
+
+        if (parse_target(words[1], &action.pan, &action.tilt) != 0 ||
+                (words[2] != NULL && parse_shots(words[2], &action.shots) != 0))
+        {
+            ret = -1;
+        }
+        else
+        {
+            ret = action_list_add(list, &action);
+        }
+    }
+    else
+    {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int script_parse(FILE *file, const char *name, struct action_list *list)
+{
+    int ret = 0;
+    char line[MAX_LINE_LENGTH];
+    unsigned int line_number = 0;
+
+    while (ret == 0 && fgets(line, sizeof(line), file) != NULL)
+    {
+        char *words[5];
+        char *comment;
+        char *saveptr;
+        size_t count = 0;
+
+        line_number++;
+
+        if (strchr(line, '\n') == NULL && !feof(file))
+        {
+            fprintf(stderr, "%s:%u: Line too long\n", name, line_number);
+            ret = -1;
+            break;
+        }
+
+        // Drop comments, then split what's left into words
+        if ((comment = strchr(line, '#')) != NULL)
+        {
+            *comment = '\0';
+        }
+
+        words[count] = strtok_r(line, WORD_SEPARATORS, &saveptr);
+
+        while (words[count] != NULL && count < 4)
+        {
+            words[++count] = strtok_r(NULL, WORD_SEPARATORS, &saveptr);
+        }
+
+        if (count == 0)
+        {
+            continue;
+        }
+
+        // Anything with more words than the longest valid line is invalid
+        if (words[count] != NULL || parse_line(words, list) != 0)
+        {
+            fprintf(stderr, "%s:%u: Invalid action\n", name, line_number);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 && ferror(file))
+    {
+        fprintf(stderr, "%s: Read failed\n", name);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int script_load(const char *path, struct action_list *list)
+{
+    int ret = 0;
+
+    if (strcmp(path, "-") == 0)
+    {
+        ret = script_parse(stdin, "<stdin>", list);
+    }
+    else
+    {
+        FILE *file = fopen(path, "r");
+
+        if (file == NULL)
+        {
+            fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+            ret = -1;
+        }
+        else
+        {
+            ret = script_parse(file, path, list);
+            fclose(file);
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,46 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "action.h"
+#include <stdio.h>
+
+/**
+ * Parses a script of actions, one per line, and appends them to a list.
+ * Blank lines and anything following a '#' are ignored. Recognized lines
+ * are:
+ *
+ *     move DIR [MS]   Move up, down, left or right, for MS milliseconds
+ *     move TILT-PAN [TILT_MS [PAN_MS]]
+ *                     Move diagonally (e.g. up-left), for a separate time
+ *                     on each axis
+ *     fire [COUNT]    Fire a single missile, or COUNT in one volley
+ *     status          Read and report the status flags
+ *     wait MS         Pause for MS milliseconds
+ *     stop            Stop the turret; at the start of a request to the
+ *                     daemon, cuts short whatever it is doing
+ *     home            Drive to the left and down limits
+ *     goto PAN,TILT   Move to an absolute position, in degrees
+ *     target PAN,TILT [COUNT]
+ *                     Move to an absolute position and fire one missile,
+ *                     or COUNT; a run of targets is engaged in whichever
+ *                     order is quickest
+ *
+ * @param[in] file The stream to read the script from
+ * @param[in] name The name of the script, used in error messages
+ * @param[in,out] list The list to append the parsed actions to
+ *
+ * @return Returns zero on success or non-zero if the script is malformed
+ */
+int script_parse(FILE *file, const char *name, struct action_list *list);
+
+/**
+ * Parses the script in the named file, or standard input if the name is "-"
+ *
+ * @param[in] path The path of the script file
+ * @param[in,out] list The list to append the parsed actions to
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int script_load(const char *path, struct action_list *list);
+
+#endif
@@ -0,0 +1,324 @@
+#include "sim.h"
+#include "launcher.h"
+#include "position.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * The motor driving one axis of a simulated turret
+ */
+struct sim_axis
+{
+    uint8_t cmd;            // The direction bit it is driven by, or zero
+    uint64_t since;         // When it was last commanded
+    double angle;
+};
+
+/**
+ * The state of a simulated turret
+ */
+struct sim_device
+{
+    struct sim_config config;
+    pthread_mutex_t lock;
+    uint64_t updated;       // When the simulation was last advanced
+    struct sim_axis pan;
+    struct sim_axis tilt;
+    bool firing;
+    uint64_t fire_since;    // When the fire bit was last set
+    uint64_t fire_time;     // Time the firing mechanism has run, all told
+    unsigned int pending;   // Status requests waiting to be read
+};
+
+/**
+ * Works out how much of a stretch of time a motor spent actually turning
+ *
+ * @param[in] since When the motor was commanded
+ * @param[in] from The start of the stretch
+ * @param[in] to The end of the stretch
+ * @param[in] spin_up The time the motor takes to start
+ *
+ * @return Returns the time spent turning (in microseconds)
+ */
+static uint64_t running_time(uint64_t since, uint64_t from, uint64_t to,
+        useconds_t spin_up)
+{
+    uint64_t start = since + spin_up;
+
+    start = start > from ? start : from;
+
+    return to > start ? to - start : 0;
+}
+
+/**
+ * Runs one axis of the simulation forward
+ *
+ * @param[in,out] axis The axis to advance
+ * @param[in] config How the turret behaves
+ * @param[in] decrease The direction bit that decreases the angle
+ * @param[in] decrease_rate The rate of travel when decreasing
+ * @param[in] increase_rate The rate of travel when increasing
+ * @param[in] range Where the increasing limit switch is
+ * @param[in] from When the simulation was last advanced
+ * @param[in] to The time to advance to
+ */
+static void advance_axis(struct sim_axis *axis,
+        const struct sim_config *config, uint8_t decrease,
+        double decrease_rate, double increase_rate, double range,
+        uint64_t from, uint64_t to)
+{
+    double moved;
+
+    if (axis->cmd != 0)
+    {
+        moved = running_time(axis->since, from, to, config->spin_up) /
+            1000.0;
+        axis->angle += axis->cmd == decrease ? -moved * decrease_rate :
+            moved * increase_rate;
+        axis->angle = axis->angle < 0.0 ? 0.0 :
+            (axis->angle > range ? range : axis->angle);
+    }
+}
+
+/**
+ * Runs the simulation forward to the current time. Must be called with the
+ * lock held.
+ *
+ * @param[in,out] device The simulated turret
+ */
+static void sim_advance(struct sim_device *device)
+{
+    const struct sim_config *config = &device->config;
+    uint64_t now = timing_now();
+
+    advance_axis(&device->pan, config, CMD_MOVE_LEFT, config->left_rate,
+            config->right_rate, config->pan_range, device->updated, now);
+    advance_axis(&device->tilt, config, CMD_MOVE_DOWN, config->down_rate,
+            config->up_rate, config->tilt_range, device->updated, now);
+
+    if (device->firing)
+    {
+        device->fire_time += running_time(device->fire_since,
+                device->updated, now, config->spin_up);
+    }
+
+    device->updated = now;
+}
+
+/**
+ * Counts the missiles released so far. Each goes as its cycle enters the
+ * stretch where the fired bit is set.
+ *
+ * @param[in] device The simulated turret
+ *
+ * @return Returns the number of missiles
+ */
+static unsigned int sim_shots(const struct sim_device *device)
+{
+    const struct sim_config *config = &device->config;
+    uint64_t first = config->fire_cycle - config->fire_switch;
+
+    return device->fire_time < first ? 0 :
+        (device->fire_time - first) / config->fire_cycle + 1;
+}
+
+/**
+ * Works out the status byte for the current state of the simulation. Must be
+ * called with the lock held.
+ *
+ * @param[in] device The simulated turret
+ *
+ * @return Returns the status byte
+ */
+static uint8_t sim_status(const struct sim_device *device)
+{
+    const struct sim_config *config = &device->config;
+    uint8_t status = 0;
+
+    if (device->pan.angle <= 0.0)
+        status |= STATUS_LEFT_LIMIT;
+    if (device->pan.angle >= config->pan_range)
+        status |= STATUS_RIGHT_LIMIT;
+    if (device->tilt.angle <= 0.0)
+        status |= STATUS_DOWN_LIMIT;
+    if (device->tilt.angle >= config->tilt_range)
+        status |= STATUS_UP_LIMIT;
+    if (device->fire_time % config->fire_cycle + config->fire_switch >=
+            config->fire_cycle)
+        status |= STATUS_DEVICE_FIRED;
+
+    return status;
+}
+
+/**
+ * Points a motor in a new direction. Carrying on in the same direction
+ * keeps it turning, but anything else makes it spin up again.
+ *
+ * @param[in,out] axis The axis the motor drives
+ * @param[in] cmd The direction bit it is now driven by, or zero
+ * @param[in] now The current time
+ */
+static void command_axis(struct sim_axis *axis, uint8_t cmd, uint64_t now)
+{
+    if (axis->cmd != cmd)
+    {
+        axis->cmd = cmd;
+        axis->since = now;
+    }
+}
+
+/**
+ * Accepts an output report. Status requests queue an input report, and
+ * anything else replaces the bits driving the motors.
+ */
+static int sim_write(void *handle, const uint8_t *data, size_t length)
+{
+    struct sim_device *device = handle;
+    int ret = (int)length;
+
+    timing_sleep(device->config.latency);
+
+    if (length < 2)
+    {
+        ret = -1;
+    }
+    else
+    {
+        uint8_t cmd = data[1] == CMD_STOP ? 0 : data[1];
+        bool firing = (cmd & CMD_FIRE) != 0;
+
+        pthread_mutex_lock(&device->lock);
+        sim_advance(device);
+
+        if (data[1] == CMD_GET_STATUS)
+        {
+            device->pending++;
+        }
+        else
+        {
+            command_axis(&device->pan, cmd & (CMD_MOVE_LEFT | CMD_MOVE_RIGHT),
+                    device->updated);
+            command_axis(&device->tilt, cmd & (CMD_MOVE_DOWN | CMD_MOVE_UP),
+                    device->updated);
+
+            if (firing && !device->firing)
+            {
+                device->fire_since = device->updated;
+            }
+
+            device->firing = firing;
+        }
+
+        pthread_mutex_unlock(&device->lock);
+    }
+
+    return ret;
+}
+
+/**
+ * Returns a queued input report, or waits out the timeout if none was
+ * requested. Nothing will ever arrive without a request, so waiting
+ * indefinitely for one is reported as a failure rather than hanging.
+ */
+static int sim_read(void *handle, uint8_t *data, size_t length,
+        int timeout_ms)
+{
+    struct sim_device *device = handle;
+    int ret = 0;
+    bool ready;
+
+    pthread_mutex_lock(&device->lock);
+    ready = device->pending != 0;
+    pthread_mutex_unlock(&device->lock);
+
+    if (length == 0)
+    {
+        ret = -1;
+    }
+    else if (!ready && timeout_ms < 0)
+    {
+        fprintf(stderr, "Simulated turret has no report to read\n");
+        ret = -1;
+    }
+    else if (!ready)
+    {
+        timing_sleep((useconds_t)timeout_ms * 1000);
+    }
+    else
+    {
+        timing_sleep(device->config.latency);
+
+        pthread_mutex_lock(&device->lock);
+        sim_advance(device);
+        device->pending--;
+        data[0] = sim_status(device);
+        pthread_mutex_unlock(&device->lock);
+
+        ret = 1;
+    }
+
+    return ret;
+}
+
+/**
+ * Releases a simulated turret
+ */
+static void sim_close(void *handle)
+{
+    struct sim_device *device = handle;
+
+    pthread_mutex_destroy(&device->lock);
+    free(device);
+}
+
+const struct transport_ops sim_transport =
+{
+    .name = "sim",
+    .write = sim_write,
+    .read = sim_read,
+    .close = sim_close,
+    .get_fd = NULL,
+};
+
+void sim_config_init(struct sim_config *config)
+{
+    config->latency = SIM_LATENCY_US;
+    config->spin_up = SIM_SPIN_UP_US;
+    config->fire_cycle = SIM_FIRE_CYCLE_US;
+    config->fire_switch = SIM_FIRE_SWITCH_US;
+    config->pan_range = DEFAULT_PAN_RANGE;
+    config->tilt_range = DEFAULT_TILT_RANGE;
+    config->left_rate = DEFAULT_PAN_RATE;
+    config->right_rate = DEFAULT_PAN_RATE;
+    config->up_rate = DEFAULT_TILT_RATE;
+    config->down_rate = DEFAULT_TILT_RATE;
+}
+
+void *sim_open(const struct sim_config *config)
+{
+    struct sim_device *device = calloc(1, sizeof(*device));
+
+    if (device != NULL)
+    {
+        device->config = *config;
+        device->updated = timing_now();
+        device->pan.angle = config->pan_range / 2;
+        device->tilt.angle = config->tilt_range / 2;
+        pthread_mutex_init(&device->lock, NULL);
+    }
+
+    return device;
+}
+
+void sim_get_state(void *handle, struct sim_state *state)
+{
+    struct sim_device *device = handle;
+
+    pthread_mutex_lock(&device->lock);
+    sim_advance(device);
+    state->pan = device->pan.angle;
+    state->tilt = device->tilt.angle;
+    state->shots = sim_shots(device);
+    pthread_mutex_unlock(&device->lock);
+}
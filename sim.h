@@ -0,0 +1,83 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include "transport.h"
+#include <unistd.h>
+
+//
+// Default behaviour of the physical simulator. The ranges and rates match
+// the defaults assumed by the position estimate, and the motors take a
+// moment to get going after each command.
+//
+#define SIM_LATENCY_US          1000
+#define SIM_SPIN_UP_US          15000
+#define SIM_FIRE_CYCLE_US       3000000
+#define SIM_FIRE_SWITCH_US      250000
+
+/**
+ * How a simulated turret behaves. Angles are in degrees from the left and
+ * down limits, and rates in degrees per millisecond, as in struct position.
+ */
+struct sim_config
+{
+    useconds_t latency;     // Added to every transfer
+    useconds_t spin_up;     // Time a motor takes to start once commanded
+    useconds_t fire_cycle;  // Time to wind up and release one missile
+    useconds_t fire_switch; // Time at the end of each cycle the fired bit is
+                            // set
+    double pan_range;       // Where the right limit switch is
+    double tilt_range;      // Where the up limit switch is
+    double left_rate;
+    double right_rate;
+    double up_rate;
+    double down_rate;
+};
+
+/**
+ * Where a simulated turret really is, as opposed to where the launcher
+ * estimates it is
+ */
+struct sim_state
+{
+    double pan;
+    double tilt;
+    unsigned int shots;     // Missiles released so far
+};
+
+/**
+ * Transport that drives a physical model of the turret. Each axis moves at
+ * its own rate in each direction, only once its motor has spun up, and stops
+ * at the limit switches, whose bits are then reported. The firing mechanism
+ * winds through its cycle while the fire bit is set, keeping its place when
+ * stopped, and raises the fired bit for the last part of each cycle as the
+ * missile goes. The model runs on timing_now, so on the virtual clock it
+ * runs as fast as it is driven.
+ */
+extern const struct transport_ops sim_transport;
+
+/**
+ * Fills in the default behaviour of a simulated turret
+ *
+ * @param[out] config The configuration to initialize
+ */
+void sim_config_init(struct sim_config *config);
+
+/**
+ * Creates a simulated turret in the middle of its travel
+ *
+ * @param[in] config How the turret behaves
+ *
+ * @return Returns a handle for use with sim_transport on success or NULL
+ *         otherwise
+ */
+void *sim_open(const struct sim_config *config);
+
+/**
+ * Reads where a simulated turret has got to
+ *
+ * @param[in] handle The handle from sim_open
+ * @param[out] state Gets populated with the turret's state
+ */
+void sim_get_state(void *handle, struct sim_state *state);
+
+#endif
@@ -0,0 +1,305 @@
+#include "status-page.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+/**
+ * Starts an update, waiting out any other thread's. An odd sequence is taken
+ * to mean the page is being written, so claiming it from even to odd keeps
+ * writers apart as well as telling readers to retry.
+ *
+ * @param[in,out] page The page to update
+ *
+ * @return Returns the sequence the update started from
+ */
+static uint32_t begin_update(struct status_page *page)
+{
+    uint32_t sequence = atomic_load_explicit(&page->sequence,
+            memory_order_relaxed);
+
+    while ((sequence & 1) ||
+            !atomic_compare_exchange_weak_explicit(&page->sequence,
+                &sequence, sequence + 1, memory_order_acquire,
+                memory_order_relaxed))
+    {
+        sequence = atomic_load_explicit(&page->sequence,
+                memory_order_relaxed);
+    }
+
+    // Mark the page as changing before touching the fields
+    atomic_thread_fence(memory_order_release);
+
+    return sequence;
+}
+
+/**
+ * Finishes an update started by begin_update
+ *
+ * @param[in,out] page The page being updated
+ * @param[in] sequence The sequence begin_update returned
+ */
+static void end_update(struct status_page *page, uint32_t sequence)
+{
+    atomic_store_explicit(&page->sequence, sequence + 2,
+            memory_order_release);
+}
+
+struct status_page *status_page_create(const char *name)
+{
+    struct status_page *page = NULL;
+    int fd;
+
+    // Start from a fresh object, so a reader never sees a stale page from a
+    // daemon that died without removing it
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to create status page %s: %s\n", name,
+                strerror(errno));
+    }
+    else if (ftruncate(fd, sizeof(*page)) != 0)
+    {
+        fprintf(stderr, "Failed to size status page %s: %s\n", name,
+                strerror(errno));
+        shm_unlink(name);
+    }
+    else
+    {
+        page = mmap(NULL, sizeof(*page), PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+
+        if (page == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed to map status page %s: %s\n", name,
+                    strerror(errno));
+            shm_unlink(name);
+            page = NULL;
+        }
+        else
+        {
+            // The object starts out zeroed, which is a page with nothing
+            // published yet
+            page->version = STATUS_PAGE_VERSION;
+            atomic_store(&page->pid, getpid());
+
+            // Readers check the magic last, so it goes in after the rest
+            atomic_thread_fence(memory_order_release);
+            page->magic = STATUS_PAGE_MAGIC;
+        }
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return page;
+}
+
+void status_page_destroy(struct status_page *page, const char *name)
+{
+    munmap(page, sizeof(*page));
+    shm_unlink(name);
+}
+
+const struct status_page *status_page_open(const char *name)
+{
+    const struct status_page *page = NULL;
+    struct stat st;
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to open status page %s: %s\n", name,
+                errno == ENOENT ? "no daemon is publishing one" :
+                strerror(errno));
+    }
+    else if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*page))
+    {
+        fprintf(stderr, "Status page %s is incomplete\n", name);
+    }
+    else
+    {
+        page = mmap(NULL, sizeof(*page), PROT_READ, MAP_SHARED, fd, 0);
+
+        if (page == MAP_FAILED)
+        {
+            fprintf(stderr, "Failed to map status page %s: %s\n", name,
+                    strerror(errno));
+            page = NULL;
+        }
+        else if (page->magic != STATUS_PAGE_MAGIC ||
+                page->version != STATUS_PAGE_VERSION)
+        {
+            fprintf(stderr, "Status page %s has an unknown layout\n", name);
+            status_page_close(page);
+            page = NULL;
+        }
+    }
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return page;
+}
+
+void status_page_close(const struct status_page *page)
+{
+    munmap((void *)page, sizeof(*page));
+}
+
+void status_page_set_status(struct status_page *page, uint8_t status,
+        uint64_t timestamp)
+{
+    uint32_t sequence = begin_update(page);
+
+    atomic_store_explicit(&page->status, status, memory_order_relaxed);
+    atomic_store_explicit(&page->status_time, timestamp,
+            memory_order_relaxed);
+
+    end_update(page, sequence);
+}
+
+void status_page_set_command(struct status_page *page, uint8_t cmd,
+        uint64_t timestamp)
+{
+    uint32_t sequence = begin_update(page);
+
+    atomic_store_explicit(&page->command, cmd, memory_order_relaxed);
+    atomic_store_explicit(&page->command_time, timestamp,
+            memory_order_relaxed);
+
+    end_update(page, sequence);
+}
+
+void status_page_set_position(struct status_page *page,
+        const struct position *position, uint64_t timestamp)
+{
+    uint32_t sequence = begin_update(page);
+
+    atomic_store_explicit(&page->pan_known, position->pan_known,
+            memory_order_relaxed);
+    atomic_store_explicit(&page->tilt_known, position->tilt_known,
+            memory_order_relaxed);
+    atomic_store_explicit(&page->pan, position->pan, memory_order_relaxed);
+    atomic_store_explicit(&page->tilt, position->tilt, memory_order_relaxed);
+    atomic_store_explicit(&page->position_time, timestamp,
+            memory_order_relaxed);
+
+    end_update(page, sequence);
+}
+
+void status_page_set_connected(struct status_page *page, bool connected)
+{
+    uint32_t sequence = begin_update(page);
+
+    atomic_store_explicit(&page->connected, connected, memory_order_relaxed);
+
+    end_update(page, sequence);
+}
+
+int status_page_read(const struct status_page *page,
+        struct status_view *view)
+{
+    int ret = -1;
+    uint32_t before;
+    uint32_t after;
+    unsigned int attempt;
+
+    // Retry until no update overlapped the read
+    for (attempt = 0; attempt < STATUS_PAGE_RETRIES && ret != 0; attempt++)
+    {
+        before = atomic_load_explicit(&page->sequence, memory_order_acquire);
+        view->pid = atomic_load_explicit(&page->pid, memory_order_relaxed);
+        view->connected = atomic_load_explicit(&page->connected,
+                memory_order_relaxed);
+        view->status = atomic_load_explicit(&page->status,
+                memory_order_relaxed);
+        view->command = atomic_load_explicit(&page->command,
+                memory_order_relaxed);
+        view->pan_known = atomic_load_explicit(&page->pan_known,
+                memory_order_relaxed);
+        view->tilt_known = atomic_load_explicit(&page->tilt_known,
+                memory_order_relaxed);
+        view->pan = atomic_load_explicit(&page->pan, memory_order_relaxed);
+        view->tilt = atomic_load_explicit(&page->tilt, memory_order_relaxed);
+        view->status_time = atomic_load_explicit(&page->status_time,
+                memory_order_relaxed);
+        view->command_time = atomic_load_explicit(&page->command_time,
+                memory_order_relaxed);
+        view->position_time = atomic_load_explicit(&page->position_time,
+                memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&page->sequence, memory_order_relaxed);
+
+        if (before == after && !(before & 1))
+        {
+            view->updates = before / 2;
+            ret = 0;
+        }
+    }
+
+    if (ret != 0)
+    {
+        fprintf(stderr, "Status page never settled\n");
+    }
+
+    return ret;
+}
+
+/**
+ * Prints how long ago something happened, or that it never has
+ *
+ * @param[in] label The label, padded to line up with print_status_flags
+ * @param[in] timestamp When it happened (as timing_now), or zero if never
+ * @param[in] now The current time (as timing_now)
+ */
+static void print_age(const char *label, uint64_t timestamp, uint64_t now)
+{
+    if (timestamp == 0)
+    {
+        printf("%s never\n", label);
+    }
+    else
+    {
+        printf("%s %llu ms ago\n", label,
+                (unsigned long long)(now - timestamp) / 1000);
+    }
+}
+
+void status_view_print(const struct status_view *view)
+{
+    uint64_t now = timing_now();
+
+    print_status_flags(view->status);
+    printf("Connected:          %s\n", view->connected ? "true" : "false");
+    print_age("Status read:       ", view->status_time, now);
+
+    if (view->pan_known)
+    {
+        printf("Pan position:       %.1f\n", view->pan);
+    }
+    else
+    {
+        printf("Pan position:       unknown\n");
+    }
+
+    if (view->tilt_known)
+    {
+        printf("Tilt position:      %.1f\n", view->tilt);
+    }
+    else
+    {
+        printf("Tilt position:      unknown\n");
+    }
+
+    printf("Last command:       0x%02x\n", view->command);
+    print_age("Command sent:      ", view->command_time, now);
+}
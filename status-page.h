@@ -0,0 +1,163 @@
+#ifndef STATUS_PAGE_H
+#define STATUS_PAGE_H
+
+#include "launcher.h"
+#include <stdatomic.h>
+
+//
+// Default name of the shared memory object a daemon publishes its status in
+//
+#define DEFAULT_STATUS_PAGE "/" PROGRAM_NAME ".status"
+
+//
+// Identifies a status page, and the version of its layout
+//
+#define STATUS_PAGE_MAGIC   0x4d4c5350
+#define STATUS_PAGE_VERSION 1
+
+//
+// Most attempts a reader makes at a consistent copy before giving up, which
+// only happens if the publisher died part way through an update
+//
+#define STATUS_PAGE_RETRIES 100000
+
+/**
+ * The layout of a status page in shared memory. The sequence is odd while an
+ * update is in progress, so a reader that sees it change knows to try again.
+ * Timestamps are on the monotonic clock used by timing_now, which every
+ * process on the machine shares, and are zero until the event first happens.
+ */
+struct status_page
+{
+    uint32_t magic;
+    uint32_t version;
+    _Atomic uint32_t sequence;
+    _Atomic int32_t pid;                // The publishing daemon
+    _Atomic uint8_t connected;          // Whether the launcher is plugged in
+    _Atomic uint8_t status;             // The latest STATUS_* bits read
+    _Atomic uint8_t command;            // The latest CMD_* value sent,
+                                        // other than CMD_GET_STATUS
+    _Atomic uint8_t pan_known;
+    _Atomic uint8_t tilt_known;
+    _Atomic double pan;                 // Estimated position, as in struct
+    _Atomic double tilt;                // position
+    _Atomic uint64_t status_time;       // When the status was read
+    _Atomic uint64_t command_time;      // When the command was sent
+    _Atomic uint64_t position_time;     // When the estimate last changed
+};
+
+/**
+ * A consistent copy of a status page, taken by status_page_read
+ */
+struct status_view
+{
+    uint32_t updates;                   // Updates published so far
+    pid_t pid;
+    bool connected;
+    uint8_t status;
+    uint8_t command;
+    bool pan_known;
+    bool tilt_known;
+    double pan;
+    double tilt;
+    uint64_t status_time;
+    uint64_t command_time;
+    uint64_t position_time;
+};
+
+/**
+ * Creates the shared memory object for a status page and maps it for
+ * writing, replacing any left behind by an earlier daemon
+ *
+ * @param[in] name The name of the shared memory object, as for shm_open
+ *
+ * @return Returns the page on success or NULL otherwise
+ */
+struct status_page *status_page_create(const char *name);
+
+/**
+ * Unmaps a page from status_page_create and removes its shared memory
+ * object, so that readers stop finding it
+ *
+ * @param[in] page The page to remove
+ * @param[in] name The name it was created with
+ */
+void status_page_destroy(struct status_page *page, const char *name);
+
+/**
+ * Maps a status page published by a daemon for reading
+ *
+ * @param[in] name The name of the shared memory object, as for shm_open
+ *
+ * @return Returns the page on success or NULL otherwise
+ */
+const struct status_page *status_page_open(const char *name);
+
+/**
+ * Unmaps a page from status_page_open
+ *
+ * @param[in] page The page to unmap
+ */
+void status_page_close(const struct status_page *page);
+
+/**
+ * Publishes the latest status bits read from the launcher. Like the other
+ * publishing functions, may be called from several threads at once.
+ *
+ * @param[in,out] page The page to update
+ * @param[in] status The status byte read
+ * @param[in] timestamp When it was read (as timing_now)
+ */
+void status_page_set_status(struct status_page *page, uint8_t status,
+        uint64_t timestamp);
+
+/**
+ * Publishes the latest command sent to the launcher, other than a status
+ * request
+ *
+ * @param[in,out] page The page to update
+ * @param[in] cmd The command byte
+ * @param[in] timestamp When it was sent (as timing_now)
+ */
+void status_page_set_command(struct status_page *page, uint8_t cmd,
+        uint64_t timestamp);
+
+/**
+ * Publishes the latest estimate of where the turret is pointing
+ *
+ * @param[in,out] page The page to update
+ * @param[in] position The estimate
+ * @param[in] timestamp When it changed (as timing_now)
+ */
+void status_page_set_position(struct status_page *page,
+        const struct position *position, uint64_t timestamp);
+
+/**
+ * Publishes whether the launcher is plugged in
+ *
+ * @param[in,out] page The page to update
+ * @param[in] connected Whether the daemon can reach the launcher
+ */
+void status_page_set_connected(struct status_page *page, bool connected);
+
+/**
+ * Takes a consistent copy of a status page without locking or making any
+ * system call
+ *
+ * @param[in] page The page to read
+ * @param[out] view Gets populated with the copy
+ *
+ * @return Returns zero on success or non-zero otherwise
+ */
+int status_page_read(const struct status_page *page,
+        struct status_view *view);
+
+/**
+ * Prints a copy of a status page: the status bits as print_status_flags
+ * does, followed by the connection, position and latest command
+ *
+ * @param[in] view The copy to print
+ */
+void status_view_print(const struct status_view *view);
+
+#endif
@@ -0,0 +1,370 @@
+#include "timing.h"
+#include "metrics.h"
+#include "retry.h"
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/**
+ * Time before each deadline spent spinning rather than sleeping
+ */
+static useconds_t spin_time;
+
+/**
+ * The time on the virtual clock, or zero while it is not in use
+ */
+static uint64_t virtual_now;
+
+/**
+ * Reads the monotonic clock itself, whichever clock is in use
+ *
+ * @return Returns the current monotonic time, in microseconds
+ */
+static uint64_t monotonic_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint64_t timing_now(void)
+{
+    return virtual_now != 0 ? virtual_now : monotonic_now();
+}
+
+void timing_use_virtual_clock(bool enabled)
+{
+    virtual_now = enabled ? monotonic_now() : 0;
+}
+
+void timing_set_spin(useconds_t spin)
+{
+    spin_time = spin;
+}
+
+void timing_sleep_until(uint64_t deadline)
+{
+    uint64_t wake = deadline > spin_time ? deadline - spin_time : 0;
+    struct timespec target;
+
+    target.tv_sec = wake / 1000000;
+    target.tv_nsec = (wake % 1000000) * 1000;
+
+    if (virtual_now != 0)
+    {
+        // Nothing else can happen in the meantime, so skip straight there
+        virtual_now = deadline > virtual_now ? deadline : virtual_now;
+    }
+    else
+    {
+        // Signals interrupt the sleep but not the deadline, so just go back
+        // to sleep until it arrives
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target,
+                    NULL) == EINTR)
+        {
+        }
+
+        while (spin_time != 0 && timing_now() < deadline)
+        {
+        }
+    }
+}
+
+void timing_spin_until(uint64_t deadline)
+{
+    if (virtual_now != 0)
+    {
+        timing_sleep_until(deadline);
+    }
+
+    while (timing_now() < deadline)
+    {
+    }
+}
+
+void timing_sleep(useconds_t duration)
+{
+    timing_sleep_until(timing_now() + duration);
+}
+
+void hold_log_init(struct hold_log *log, bool enabled)
+{
+    log->enabled = enabled;
+    log->total = 0;
+}
+
+void hold_log_record(struct hold_log *log, uint8_t cmd, useconds_t requested,
+        useconds_t actual)
+{
+    metrics_observe(METRIC_HOLD_ERROR,
+            actual > requested ? actual - requested : requested - actual);
+
+    if (log->enabled)
+    {
+        struct hold_record *record =
+            &log->records[log->total++ % HOLD_LOG_SIZE];
+
+        record->cmd = cmd;
+        record->requested = requested;
+        record->actual = actual;
+    }
+}
+
+void hold_log_print(const struct hold_log *log, FILE *out)
+{
+    size_t kept = log->total < HOLD_LOG_SIZE ? log->total : HOLD_LOG_SIZE;
+    size_t i;
+    int64_t total_error = 0;
+    int64_t worst_error = 0;
+
+    fprintf(out, "%-6s %12s %12s %10s\n", "cmd", "requested_us", "actual_us",
+            "error_us");
+
+    for (i = log->total - kept; i < log->total; i++)
+    {
+        const struct hold_record *record = &log->records[i % HOLD_LOG_SIZE];
+        int64_t error = (int64_t)record->actual - record->requested;
+        int64_t magnitude = error < 0 ? -error : error;
+
+        fprintf(out, "0x%02x   %12u %12u %+10lld\n", record->cmd,
+                record->requested, record->actual, (long long)error);
+
+        total_error += magnitude;
+
+        if (magnitude > worst_error)
+        {
+            worst_error = magnitude;
+        }
+    }
+
+    if (kept > 0)
+    {
+        fprintf(out, "%zu holds, mean |error| %lld us, worst |error| %lld us\n",
+                kept, (long long)(total_error / (int64_t)kept),
+                (long long)worst_error);
+    }
+}
+
+/**
+ * Names of the operations timed by a trace, as printed in the summary
+ */
+static const char *trace_op_names[TRACE_OP_COUNT] =
+{
+    [TRACE_WRITE] = "write",
+    [TRACE_READ] = "read",
+    [TRACE_SLEEP] = "sleep",
+    [TRACE_FIRE_WAIT] = "fire_wait",
+};
+
+void trace_init(struct trace *trace, bool enabled, FILE *events)
+{
+    memset(trace, 0, sizeof(*trace));
+    trace->enabled = enabled;
+    trace->events = events;
+    trace->origin = timing_now();
+}
+
+void trace_record(struct trace *trace, enum trace_op op, uint64_t start,
+        uint64_t end)
+{
+    if (trace->enabled)
+    {
+        struct trace_stat *stat = &trace->stats[op];
+        uint64_t duration = end - start;
+
+        if (stat->count == 0 || duration < stat->min)
+        {
+            stat->min = duration;
+        }
+
+        if (duration > stat->max)
+        {
+            stat->max = duration;
+        }
+
+        stat->count++;
+        stat->total += duration;
+
+        if (trace->events != NULL)
+        {
+            fprintf(trace->events, "%12.6f %-10s %10llu us\n",
+                    (start - trace->origin) / 1000000.0, trace_op_names[op],
+                    (unsigned long long)duration);
+        }
+    }
+}
+
+void trace_sleep_until(struct trace *trace, uint64_t deadline)
+{
+    uint64_t start = timing_now();
+    uint64_t end;
+
+    timing_sleep_until(deadline);
+    end = timing_now();
+    trace_record(trace, TRACE_SLEEP, start, end);
+
+    if (trace->enabled)
+    {
+        uint64_t late = end > deadline ? end - deadline : 0;
+
+        trace->deadlines++;
+
+        if (late > trace->worst_late)
+        {
+            trace->worst_late = late;
+        }
+
+        if (late > DEADLINE_SLACK_US)
+        {
+            trace->missed++;
+
+            if (trace->events != NULL)
+            {
+                fprintf(trace->events, "%12.6f %-10s %10llu us late\n",
+                        (end - trace->origin) / 1000000.0, "missed",
+                        (unsigned long long)late);
+            }
+        }
+    }
+}
+
+int parse_trace_format(const char *name, enum trace_format *format)
+{
+    int ret = 0;
+
+    if (strcmp(name, "text") == 0)
+        *format = TRACE_FORMAT_TEXT;
+    else if (strcmp(name, "json") == 0)
+        *format = TRACE_FORMAT_JSON;
+    else
+        ret = -1;
+
+    return ret;
+}
+
+void json_print_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+
+    for (; *text != '\0'; text++)
+    {
+        if (*text == '"' || *text == '\\')
+        {
+            fprintf(out, "\\%c", *text);
+        }
+        else if ((unsigned char)*text < ' ')
+        {
+            fprintf(out, "\\u%04x", (unsigned char)*text);
+        }
+        else
+        {
+            fputc(*text, out);
+        }
+    }
+
+    fputc('"', out);
+}
+
+void trace_print(const struct trace *trace, FILE *out,
+        enum trace_format format, const char *device)
+{
+    int op;
+
+    if (format == TRACE_FORMAT_JSON)
+    {
+        fprintf(out, "{");
+
+        if (device != NULL)
+        {
+            fprintf(out, "\"device\":");
+            json_print_string(out, device);
+            fprintf(out, ",");
+        }
+
+        fprintf(out, "\"ops\":{");
+
+        for (op = 0; op < TRACE_OP_COUNT; op++)
+        {
+            const struct trace_stat *stat = &trace->stats[op];
+
+            fprintf(out, "%s\"%s\":{\"count\":%llu,\"total_us\":%llu,"
+                    "\"min_us\":%llu,\"mean_us\":%llu,\"max_us\":%llu}",
+                    op ? "," : "", trace_op_names[op],
+                    (unsigned long long)stat->count,
+                    (unsigned long long)stat->total,
+                    (unsigned long long)stat->min,
+                    (unsigned long long)(stat->count ?
+                        stat->total / stat->count : 0),
+                    (unsigned long long)stat->max);
+        }
+
+        fprintf(out, "},\"deadlines\":{\"count\":%llu,\"missed\":%llu,"
+                "\"worst_late_us\":%llu}",
+                (unsigned long long)trace->deadlines,
+                (unsigned long long)trace->missed,
+                (unsigned long long)trace->worst_late);
+
+        if (trace->retries != NULL)
+        {
+            fprintf(out, ",\"failures\":{\"retries\":%llu,"
+                    "\"recovered\":%llu,\"failed\":%llu}",
+                    (unsigned long long)atomic_load(&trace->retries->retries),
+                    (unsigned long long)atomic_load(
+                        &trace->retries->recovered),
+                    (unsigned long long)atomic_load(&trace->retries->failed));
+        }
+
+        fprintf(out, "}\n");
+    }
+    else
+    {
+        if (device != NULL)
+        {
+            fprintf(out, "Device %s:\n", device);
+        }
+
+        fprintf(out, "%-10s %8s %12s %10s %10s %10s\n", "op", "count",
+                "total_us", "min_us", "mean_us", "max_us");
+
+        for (op = 0; op < TRACE_OP_COUNT; op++)
+        {
+            const struct trace_stat *stat = &trace->stats[op];
+
+            if (stat->count != 0)
+            {
+                fprintf(out, "%-10s %8llu %12llu %10llu %10llu %10llu\n",
+                        trace_op_names[op], (unsigned long long)stat->count,
+                        (unsigned long long)stat->total,
+                        (unsigned long long)stat->min,
+                        (unsigned long long)(stat->total / stat->count),
+                        (unsigned long long)stat->max);
+            }
+        }
+
+        if (trace->deadlines != 0)
+        {
+            trace_print_deadlines(trace, out);
+        }
+
+        if (trace->retries != NULL)
+        {
+            fprintf(out, "Retried failed transfers %llu times, %llu "
+                    "recovered and %llu given up on\n",
+                    (unsigned long long)atomic_load(&trace->retries->retries),
+                    (unsigned long long)atomic_load(
+                        &trace->retries->recovered),
+                    (unsigned long long)atomic_load(&trace->retries->failed));
+        }
+    }
+}
+
+void trace_print_deadlines(const struct trace *trace, FILE *out)
+{
+    fprintf(out, "Missed %llu of %llu deadlines by more than %d us "
+            "(latest wake %llu us late)\n",
+            (unsigned long long)trace->missed,
+            (unsigned long long)trace->deadlines, DEADLINE_SLACK_US,
+            (unsigned long long)trace->worst_late);
+}
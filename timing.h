@@ -0,0 +1,243 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+//
+// Number of most recent holds kept by a hold log
+//
+#define HOLD_LOG_SIZE       1024
+
+//
+// How late a sleep may wake before its deadline counts as missed
+//
+#define DEADLINE_SLACK_US   1000
+
+/**
+ * The requested and actual length of a single hold
+ */
+struct hold_record
+{
+    uint8_t cmd;            // The command that was held, or 0 for a pause
+    uint32_t requested;     // Microseconds
+    uint32_t actual;        // Microseconds
+};
+
+/**
+ * A ring of the most recent holds performed against a launcher
+ */
+struct hold_log
+{
+    bool enabled;
+    size_t total;           // Holds recorded since the log was cleared
+    struct hold_record records[HOLD_LOG_SIZE];
+};
+
+/**
+ * The operations timed by a trace
+ */
+enum trace_op
+{
+    TRACE_WRITE,            // Output report written to the device
+    TRACE_READ,             // Input report read from the device
+    TRACE_SLEEP,            // Hold or pause between reports
+    TRACE_FIRE_WAIT,        // Polling for a shot to complete
+    TRACE_OP_COUNT,
+};
+
+/**
+ * How a trace summary is printed
+ */
+enum trace_format
+{
+    TRACE_FORMAT_TEXT,
+    TRACE_FORMAT_JSON,
+};
+
+/**
+ * Running totals for one operation in a trace
+ */
+struct trace_stat
+{
+    uint64_t count;
+    uint64_t total;         // Microseconds
+    uint64_t min;           // Microseconds
+    uint64_t max;           // Microseconds
+};
+
+struct retry_counts;
+
+/**
+ * Timings of the transfers and sleeps performed against a launcher
+ */
+struct trace
+{
+    bool enabled;
+    FILE *events;           // Where each operation is logged, or NULL
+    uint64_t origin;        // Time the trace started, as timing_now
+    struct trace_stat stats[TRACE_OP_COUNT];
+    uint64_t deadlines;     // Sleeps until a deadline
+    uint64_t missed;        // Sleeps that woke more than DEADLINE_SLACK_US
+                            // after their deadline
+    uint64_t worst_late;    // Microseconds past the deadline of the latest
+                            // wake
+    const struct retry_counts *retries; // Failed transfers on the launcher,
+                                        // or NULL if they aren't retried
+};
+
+/**
+ * Reads the monotonic clock, or the virtual clock while it is in use
+ *
+ * @return Returns the current monotonic time, in microseconds
+ */
+uint64_t timing_now(void);
+
+/**
+ * Switches every reading of the clock and every sleep over to a virtual
+ * clock, or back to the monotonic one. The virtual clock starts at the
+ * current monotonic time and only moves when something sleeps, jumping
+ * straight to the deadline, so a simulation runs as fast as the CPU allows.
+ * Nothing could wake a thread waiting on it, so it is only for single
+ * threaded simulations.
+ *
+ * @param[in] enabled Whether to use the virtual clock
+ */
+void timing_use_virtual_clock(bool enabled);
+
+/**
+ * Sets how long before each deadline timing_sleep_until stops sleeping and
+ * starts spinning on the clock instead. Spinning trades CPU time for
+ * protection against the scheduler waking the thread late.
+ *
+ * @param[in] spin The spin time (in microseconds), or zero to never spin
+ */
+void timing_set_spin(useconds_t spin);
+
+/**
+ * Sleeps until an absolute point on the monotonic clock. Because the
+ * deadline is absolute, lateness in one sleep does not accumulate into the
+ * next.
+ *
+ * @param[in] deadline The time to wake (in microseconds, as timing_now)
+ */
+void timing_sleep_until(uint64_t deadline);
+
+/**
+ * Busy-waits until an absolute point on the monotonic clock, without ever
+ * giving up the CPU
+ *
+ * @param[in] deadline The time to return (in microseconds, as timing_now)
+ */
+void timing_spin_until(uint64_t deadline);
+
+/**
+ * Sleeps for a relative amount of time
+ *
+ * @param[in] duration The time to sleep (in microseconds)
+ */
+void timing_sleep(useconds_t duration);
+
+/**
+ * Empties a hold log
+ *
+ * @param[out] log The log to clear
+ * @param[in] enabled Whether the log should record holds
+ */
+void hold_log_init(struct hold_log *log, bool enabled);
+
+/**
+ * Records a hold in a log, if the log is enabled
+ *
+ * @param[in,out] log The log to record into
+ * @param[in] cmd The command that was held, or 0 for a pause
+ * @param[in] requested The requested hold time (in microseconds)
+ * @param[in] actual The measured hold time (in microseconds)
+ */
+void hold_log_record(struct hold_log *log, uint8_t cmd, useconds_t requested,
+        useconds_t actual);
+
+/**
+ * Prints the holds in a log, oldest first, followed by a summary of the
+ * error between requested and actual times
+ *
+ * @param[in] log The log to print
+ * @param[in] out The stream to print to
+ */
+void hold_log_print(const struct hold_log *log, FILE *out);
+
+/**
+ * Empties a trace
+ *
+ * @param[out] trace The trace to clear
+ * @param[in] enabled Whether the trace should time operations
+ * @param[in] events Where to log each operation as it completes, or NULL to
+ *            only keep the totals
+ */
+void trace_init(struct trace *trace, bool enabled, FILE *events);
+
+/**
+ * Records a completed operation in a trace, if the trace is enabled
+ *
+ * @param[in,out] trace The trace to record into
+ * @param[in] op The operation that was performed
+ * @param[in] start When the operation started (as timing_now)
+ * @param[in] end When the operation finished (as timing_now)
+ */
+void trace_record(struct trace *trace, enum trace_op op, uint64_t start,
+        uint64_t end);
+
+/**
+ * Sleeps until an absolute point on the monotonic clock, as
+ * timing_sleep_until, and records the sleep in a trace. A wake more than
+ * DEADLINE_SLACK_US after the deadline is counted as a missed deadline.
+ *
+ * @param[in,out] trace The trace to record into
+ * @param[in] deadline The time to wake (in microseconds, as timing_now)
+ */
+void trace_sleep_until(struct trace *trace, uint64_t deadline);
+
+/**
+ * Converts a summary format name (text or json) into a format
+ *
+ * @param[in] name The name of the format
+ * @param[out] format Gets populated with the corresponding format
+ *
+ * @return Returns zero on success or non-zero if the name is not recognized
+ */
+int parse_trace_format(const char *name, enum trace_format *format);
+
+/**
+ * Prints a string as a JSON string literal, escaping quotes, backslashes and
+ * control characters
+ *
+ * @param[in] out The stream to print to
+ * @param[in] text The string to print
+ */
+void json_print_string(FILE *out, const char *text);
+
+/**
+ * Prints the count, total, min, mean and max time of each operation in a
+ * trace, followed by how many deadlines were missed and how many failed
+ * transfers were retried
+ *
+ * @param[in] trace The trace to summarize
+ * @param[in] out The stream to print to
+ * @param[in] format The format to print in
+ * @param[in] device The device the trace belongs to, or NULL
+ */
+void trace_print(const struct trace *trace, FILE *out,
+        enum trace_format format, const char *device);
+
+/**
+ * Prints a one-line summary of the deadlines missed in a trace
+ *
+ * @param[in] trace The trace to summarize
+ * @param[in] out The stream to print to
+ */
+void trace_print_deadlines(const struct trace *trace, FILE *out);
+
+#endif
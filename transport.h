@@ -0,0 +1,46 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The operations used to exchange reports with a launcher. Each backend
+ * provides one of these, and a launcher holds a pointer to it along with the
+ * backend's handle for the open device.
+ */
+struct transport_ops
+{
+    const char *name;
+
+    /**
+     * Writes an output report, where the first byte is the report number
+     *
+     * @return Returns the number of bytes written, or -1 on failure
+     */
+    int (*write)(void *handle, const uint8_t *data, size_t length);
+
+    /**
+     * Reads an input report, waiting at most timeout_ms milliseconds for it
+     * to arrive, or indefinitely if timeout_ms is -1
+     *
+     * @return Returns the number of bytes read, zero if no report arrived in
+     *         time, or -1 on failure
+     */
+    int (*read)(void *handle, uint8_t *data, size_t length, int timeout_ms);
+
+    /**
+     * Closes the device and releases the handle
+     */
+    void (*close)(void *handle);
+
+    /**
+     * Gets a file descriptor that polls readable when an input report is
+     * waiting, for backends that have one. May be NULL.
+     *
+     * @return Returns the file descriptor, or -1 if there is none
+     */
+    int (*get_fd)(void *handle);
+};
+
+#endif
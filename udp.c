@@ -0,0 +1,447 @@
+#include "udp.h"
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <netdb.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+//
+// Longest host name accepted in a listen address
+//
+#define MAX_HOST_LENGTH     256
+
+//
+// Host listened on when a listen address gives only a port
+//
+#define DEFAULT_HOST        "127.0.0.1"
+
+//
+// All of the direction bits an opcode may carry
+//
+#define CMD_MOVE_MASK       (CMD_MOVE_DOWN | CMD_MOVE_UP | CMD_MOVE_LEFT | \
+                             CMD_MOVE_RIGHT)
+
+/**
+ * Converts one command from a datagram into an action
+ *
+ * @param[in] data The UDP_COMMAND_SIZE bytes of the command
+ * @param[out] action Gets populated with the action
+ *
+ * @return Returns zero on success or non-zero if the command is invalid
+ */
+static int parse_command(const uint8_t *data, struct action *action)
+{
+    int ret = 0;
+    uint8_t opcode = data[0];
+    uint16_t duration_ms;
+    uint8_t tilt = opcode & (CMD_MOVE_UP | CMD_MOVE_DOWN);
+    uint8_t pan = opcode & (CMD_MOVE_LEFT | CMD_MOVE_RIGHT);
+
+    memcpy(&duration_ms, &data[2], sizeof(duration_ms));
+    duration_ms = ntohs(duration_ms);
+
+    memset(action, 0, sizeof(*action));
+    action->duration = duration_ms * 1000;
+
+    if (duration_ms >= MAX_ACTION_DURATION_MS)
+    {
+        ret = -1;
+    }
+    else if (opcode != 0 && (opcode & ~CMD_MOVE_MASK) == 0)
+    {
+        // Opposing directions on the same axis make no sense
+        if (tilt == (CMD_MOVE_UP | CMD_MOVE_DOWN) ||
+                pan == (CMD_MOVE_LEFT | CMD_MOVE_RIGHT))
+        {
+            ret = -1;
+        }
+        else if (tilt != 0 && pan != 0)
+        {
+            action->type = ACTION_DIAGONAL;
+            action->movement = tilt == CMD_MOVE_UP ?
+                MOVEMENT_TILT_UP : MOVEMENT_TILT_DOWN;
+            action->pan_movement = pan == CMD_MOVE_LEFT ?
+                MOVEMENT_PAN_LEFT : MOVEMENT_PAN_RIGHT;
+            action->pan_duration = action->duration;
+        }
+        else
+        {
+            action->type = ACTION_MOVE;
+
+            switch (opcode)
+            {
+                case CMD_MOVE_UP:    action->movement = MOVEMENT_TILT_UP;    break;
+                case CMD_MOVE_DOWN:  action->movement = MOVEMENT_TILT_DOWN;  break;
+                case CMD_MOVE_LEFT:  action->movement = MOVEMENT_PAN_LEFT;   break;
+                case CMD_MOVE_RIGHT: action->movement = MOVEMENT_PAN_RIGHT;  break;
+            }
+        }
+    }
+    else if (opcode == CMD_FIRE)
+    {
+        action->type = ACTION_FIRE;
+        action->shots = data[1];
+    }
+    else if (opcode == CMD_STOP)
+    {
+        action->type = duration_ms != 0 ? ACTION_WAIT : ACTION_STOP;
+    }
+    else if (opcode == CMD_GET_STATUS)
+    {
+        action->type = ACTION_STATUS;
+    }
+    else
+    {
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/**
+ * Converts the commands in a datagram into a list of actions
+ *
+ * @param[in] packet The datagram
+ * @param[in] length The length of the datagram
+ * @param[out] list Gets populated with the actions
+ *
+ * @return Returns zero on success or non-zero if the datagram is malformed
+ */
+static int parse_packet(const uint8_t *packet, size_t length,
+        struct action_list *list)
+{
+    int ret = 0;
+    uint8_t count = packet[5];
+    uint8_t i;
+
+    if (packet[4] != UDP_PROTOCOL_VERSION || count > UDP_MAX_COMMANDS ||
+            length != UDP_HEADER_SIZE + (size_t)count * UDP_COMMAND_SIZE)
+    {
+        ret = -1;
+    }
+
+    for (i = 0; i < count && ret == 0; i++)
+    {
+        struct action action;
+
+        if (parse_command(&packet[UDP_HEADER_SIZE + i * UDP_COMMAND_SIZE],
+                    &action) != 0 ||
+                action_list_add(list, &action) != 0)
+        {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+#ifdef NUMERIC_ADDRESSES_ONLY
+/**
+ * A single resolved address along with the storage it points into
+ */
+struct numeric_address
+{
+    struct addrinfo info;       // First, so that the whole is freed with it
+    union
+    {
+        struct sockaddr_in in;
+        struct sockaddr_in6 in6;
+    } addr;
+};
+
+/**
+ * Resolves a listen address as getaddrinfo does, but only numeric hosts and
+ * ports, so that a static build needs none of the name service modules that
+ * getaddrinfo loads at run time
+ *
+ * @param[in] host The numeric IPv4 or IPv6 address
+ * @param[in] port The port number
+ * @param[in] hints The kind of socket wanted, of which only the socket type
+ *            is used
+ * @param[out] results Gets populated with the address, to be released with
+ *             release_address
+ *
+ * @return Returns zero on success or an EAI error code otherwise
+ */
+static int lookup_address(const char *host, const char *port,
+        const struct addrinfo *hints, struct addrinfo **results)
+{
+    int ret = 0;
+    struct numeric_address *numeric = calloc(1, sizeof(*numeric));
+    char *end;
+    unsigned long number = strtoul(port, &end, 10);
+
+    if (numeric == NULL)
+    {
+        ret = EAI_MEMORY;
+    }
+    else if (port[0] == '\0' || *end != '\0' || number > UINT16_MAX)
+    {
+        ret = EAI_SERVICE;
+    }
+    else if (inet_pton(AF_INET, host, &numeric->addr.in.sin_addr) == 1)
+    {
+        numeric->addr.in.sin_family = AF_INET;
+        numeric->addr.in.sin_port = htons(number);
+        numeric->info.ai_family = AF_INET;
+        numeric->info.ai_addrlen = sizeof(numeric->addr.in);
+    }
+    else if (inet_pton(AF_INET6, host, &numeric->addr.in6.sin6_addr) == 1)
+    {
+        numeric->addr.in6.sin6_family = AF_INET6;
+        numeric->addr.in6.sin6_port = htons(number);
+        numeric->info.ai_family = AF_INET6;
+        numeric->info.ai_addrlen = sizeof(numeric->addr.in6);
+    }
+    else
+    {
+        ret = EAI_NONAME;
+    }
+
+    if (ret == 0)
+    {
+        numeric->info.ai_socktype = hints->ai_socktype;
+        numeric->info.ai_addr = (struct sockaddr *)&numeric->addr;
+        *results = &numeric->info;
+    }
+    else
+    {
+        free(numeric);
+        *results = NULL;
+    }
+
+    return ret;
+}
+
+/**
+ * Releases an address resolved by lookup_address
+ *
+ * @param[in] results The address
+ */
+static void release_address(struct addrinfo *results)
+{
+    free(results);
+}
+#else
+/**
+ * Resolves a listen address, by name or number
+ *
+ * @param[in] host The host name or address
+ * @param[in] port The port name or number
+ * @param[in] hints The kind of socket wanted
+ * @param[out] results Gets populated with the addresses, to be released with
+ *             release_address
+ *
+ * @return Returns zero on success or an EAI error code otherwise
+ */
+static int lookup_address(const char *host, const char *port,
+        const struct addrinfo *hints, struct addrinfo **results)
+{
+    return getaddrinfo(host, port, hints, results);
+}
+
+/**
+ * Releases the addresses resolved by lookup_address
+ *
+ * @param[in] results The addresses
+ */
+static void release_address(struct addrinfo *results)
+{
+    freeaddrinfo(results);
+}
+#endif
+
+int inet_open(const char *address, int type)
+{
+    int fd = -1;
+    int reuse = 1;
+    char host[MAX_HOST_LENGTH];
+    const char *port = strrchr(address, ':');
+    struct addrinfo hints;
+    struct addrinfo *results = NULL;
+    struct addrinfo *result;
+    int error;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = type;
+
+    if (port == NULL)
+    {
+        port = address;
+        host[0] = '\0';
+    }
+    else if ((size_t)(port - address) >= sizeof(host))
+    {
+        fprintf(stderr, "Listen address too long: %s\n", address);
+        return -1;
+    }
+    else
+    {
+        // Allow IPv6 addresses to be bracketed, as in [::1]:7000
+        const char *start = address;
+        size_t length = port - address;
+
+        if (length >= 2 && address[0] == '[' && address[length - 1] == ']')
+        {
+            start++;
+            length -= 2;
+        }
+
+        memcpy(host, start, length);
+        host[length] = '\0';
+        port++;
+    }
+
+    // Stay off the network unless a host was asked for, since the daemon
+    // takes commands without authentication
+    error = lookup_address(host[0] ? host : DEFAULT_HOST, port, &hints,
+            &results);
+
+    if (error != 0)
+    {
+        fprintf(stderr, "Invalid listen address %s: %s\n", address,
+                gai_strerror(error));
+    }
+
+    for (result = results; result != NULL && fd < 0; result = result->ai_next)
+    {
+        fd = socket(result->ai_family, result->ai_socktype | SOCK_CLOEXEC,
+                result->ai_protocol);
+
+        // Let a restarted server take its port back straight away
+        if (fd >= 0 && type == SOCK_STREAM)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        }
+
+        if (fd >= 0 && bind(fd, result->ai_addr, result->ai_addrlen) != 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    if (error == 0 && fd < 0)
+    {
+        fprintf(stderr, "Failed to listen on %s: %s\n", address,
+                strerror(errno));
+    }
+
+    if (results != NULL)
+    {
+        release_address(results);
+    }
+
+    return fd;
+}
+
+int udp_open(const char *address)
+{
+    return inet_open(address, SOCK_DGRAM);
+}
+
+void udp_state_init(struct udp_state *state)
+{
+    memset(state, 0, sizeof(*state));
+}
+
+struct job *udp_receive(int fd, struct udp_state *state)
+{
+    uint8_t packet[UDP_HEADER_SIZE + UDP_MAX_COMMANDS * UDP_COMMAND_SIZE];
+    struct udp_request request;
+    struct job *job = NULL;
+    ssize_t len;
+
+    memset(&request, 0, sizeof(request));
+    request.peer_length = sizeof(request.peer);
+    len = recvfrom(fd, packet, sizeof(packet), MSG_DONTWAIT,
+            (struct sockaddr *)&request.peer, &request.peer_length);
+
+    // Without a whole header there's no sequence number to acknowledge
+    if (len < UDP_HEADER_SIZE)
+    {
+        return NULL;
+    }
+
+    memcpy(&request.sequence, packet, sizeof(request.sequence));
+
+    if (state->started && request.peer_length == state->peer_length &&
+            memcmp(&request.peer, &state->peer, request.peer_length) == 0 &&
+            request.sequence == state->sequence)
+    {
+        // A repeated request means the client missed the ack, so resend it,
+        // unless the original is still being carried out
+        if (state->answered)
+        {
+            sendto(fd, state->ack, sizeof(state->ack), MSG_DONTWAIT,
+                    (struct sockaddr *)&request.peer, request.peer_length);
+        }
+    }
+    else if ((job = job_create()) == NULL ||
+            (job->context = malloc(sizeof(request))) == NULL)
+    {
+        fprintf(stderr, "Failed to allocate memory\n");
+        job_free(job);
+        job = NULL;
+    }
+    else
+    {
+        if (parse_packet(packet, len, &job->actions) != 0)
+        {
+            request.malformed = true;
+            job->actions.count = 0;
+        }
+        else
+        {
+            action_list_plan(&job->actions);
+        }
+
+        // A request that starts by stopping the turret takes priority over
+        // anything else it is doing
+        if (!request.malformed && packet[5] != 0 &&
+                packet[UDP_HEADER_SIZE] == CMD_STOP)
+        {
+            job->priority = JOB_ABORT;
+        }
+
+        // The ack always carries a status, even when none was asked for
+        job->report_status = true;
+        memcpy(job->context, &request, sizeof(request));
+
+        state->started = true;
+        state->answered = false;
+        state->peer = request.peer;
+        state->peer_length = request.peer_length;
+        state->sequence = request.sequence;
+    }
+
+    return job;
+}
+
+void udp_answer(int fd, struct udp_state *state, const struct job *job)
+{
+    const struct udp_request *request = job->context;
+    uint8_t ack[UDP_ACK_SIZE];
+
+    memcpy(ack, &request->sequence, sizeof(request->sequence));
+    ack[4] = UDP_PROTOCOL_VERSION;
+    ack[5] = request->malformed ? UDP_RESULT_MALFORMED :
+        job->result != 0 ? UDP_RESULT_FAILED : UDP_RESULT_OK;
+    ack[6] = job->status_count ? job->statuses[job->status_count - 1] : 0;
+    ack[7] = 0;
+
+    // Only the latest request is remembered for resending
+    if (request->peer_length == state->peer_length &&
+            memcmp(&request->peer, &state->peer, request->peer_length) == 0 &&
+            request->sequence == state->sequence)
+    {
+        memcpy(state->ack, ack, sizeof(ack));
+        state->answered = true;
+    }
+
+    sendto(fd, ack, sizeof(ack), MSG_DONTWAIT,
+            (const struct sockaddr *)&request->peer, request->peer_length);
+}
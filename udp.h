@@ -0,0 +1,139 @@
+#ifndef UDP_H
+#define UDP_H
+
+#include "executor.h"
+#include <sys/socket.h>
+
+//
+// Version of the datagram protocol carried in every packet
+//
+#define UDP_PROTOCOL_VERSION    1
+
+//
+// Sizes of the parts of a datagram, in bytes
+//
+#define UDP_HEADER_SIZE         8
+#define UDP_COMMAND_SIZE        4
+#define UDP_ACK_SIZE            8
+
+//
+// Most commands accepted in a single datagram
+//
+#define UDP_MAX_COMMANDS        64
+
+//
+// Result codes carried in an ack
+//
+#define UDP_RESULT_OK           0
+#define UDP_RESULT_FAILED       1
+#define UDP_RESULT_MALFORMED    2
+
+/**
+ * State kept by the daemon between datagrams, so that a request resent by a
+ * client that missed its ack is acknowledged again rather than carried out
+ * twice
+ */
+struct udp_state
+{
+    bool started;                   // Whether a request has arrived yet
+    bool answered;                  // Whether its ack has been sent yet
+    struct sockaddr_storage peer;   // Who the latest request came from
+    socklen_t peer_length;
+    uint32_t sequence;              // The latest request
+    uint8_t ack[UDP_ACK_SIZE];      // The ack sent for it
+};
+
+/**
+ * Where a datagram came from, kept with its job until the ack is sent
+ */
+struct udp_request
+{
+    struct sockaddr_storage peer;
+    socklen_t peer_length;
+    uint32_t sequence;
+    bool malformed;                 // Answered without carrying anything out
+};
+
+/*
+ * The datagram protocol. Multi-byte fields are in network byte order.
+ *
+ * A request is a header followed by up to UDP_MAX_COMMANDS commands, which
+ * are carried out in order:
+ *
+ *     header:  uint32 sequence, uint8 version, uint8 command count,
+ *              uint16 reserved
+ *     command: uint8 opcode, uint8 count, uint16 duration in milliseconds
+ *
+ * The opcode is a CMD_* value. One or two direction bits move the turret
+ * for the duration, diagonally when a tilt and a pan bit are combined.
+ * CMD_FIRE fires count missiles (one if count is zero), CMD_STOP pauses for
+ * the duration, or stops the turret if the duration is zero, and
+ * CMD_GET_STATUS reads the status. A request whose first command is
+ * CMD_STOP is an abort: it cuts short whatever the daemon is doing, cancels
+ * every request still waiting, and is carried out next.
+ *
+ * Every request is answered with an ack once its commands are complete:
+ *
+ *     ack:     uint32 sequence, uint8 version, uint8 result, uint8 status,
+ *              uint8 reserved
+ *
+ * The status is the one read by the last CMD_GET_STATUS in the request, or
+ * the latest known status if there was none.
+ */
+
+/**
+ * Opens a socket bound to a network address, for the daemon to listen on
+ *
+ * @param[in] address The port to listen on, optionally preceded by a host
+ *            name or address and a colon (such as 192.168.1.10:7000).
+ *            Without a host the socket listens on 127.0.0.1 only, so
+ *            taking commands from other machines needs an explicit address
+ *            such as 0.0.0.0 or [::]. Builds with NUMERIC_ADDRESSES_ONLY
+ *            defined, as the static one is, take only numeric hosts and
+ *            ports.
+ * @param[in] type The kind of socket, SOCK_DGRAM or SOCK_STREAM
+ *
+ * @return Returns the socket on success or -1 otherwise
+ */
+int inet_open(const char *address, int type);
+
+/**
+ * Opens the daemon's datagram socket
+ *
+ * @param[in] address The port to listen on, optionally preceded by a host
+ *            name or address and a colon, as accepted by inet_open
+ *
+ * @return Returns the socket on success or -1 otherwise
+ */
+int udp_open(const char *address);
+
+/**
+ * Prepares the state kept between datagrams
+ *
+ * @param[out] state The state to initialize
+ */
+void udp_state_init(struct udp_state *state);
+
+/**
+ * Receives one datagram and turns its commands into a job. A repeat of a
+ * request that has been answered gets its ack again instead, and a repeat
+ * of one still being carried out is dropped.
+ *
+ * @param[in] fd The datagram socket
+ * @param[in,out] state The state kept between datagrams
+ *
+ * @return Returns the job, whose context is a udp_request, or NULL if there
+ *         is nothing to carry out
+ */
+struct job *udp_receive(int fd, struct udp_state *state);
+
+/**
+ * Sends the ack for a job made by udp_receive once it has been carried out
+ *
+ * @param[in] fd The datagram socket
+ * @param[in,out] state The state kept between datagrams
+ * @param[in] job The finished job
+ */
+void udp_answer(int fd, struct udp_state *state, const struct job *job);
+
+#endif
@@ -0,0 +1,160 @@
+#include "usb.h"
+#include "launcher.h"
+#include <hidapi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+//
+// Longest serial number read back from an open launcher, in characters
+//
+#define MAX_SERIAL_LENGTH   128
+
+//
+// Whether hidapi can report what an open device is, which it can from 0.13
+//
+#ifdef HID_API_MAKE_VERSION
+#if HID_API_VERSION >= HID_API_MAKE_VERSION(0, 13, 0)
+#define HAVE_HID_DEVICE_INFO
+#endif
+#endif
+
+/**
+ * Writes an output report through hidapi
+ */
+static int hidapi_write(void *handle, const uint8_t *data, size_t length)
+{
+    return hid_write(handle, data, length);
+}
+
+/**
+ * Reads an input report through hidapi
+ */
+static int hidapi_read(void *handle, uint8_t *data, size_t length,
+        int timeout_ms)
+{
+    return hid_read_timeout(handle, data, length, timeout_ms);
+}
+
+/**
+ * Closes a device opened through hidapi
+ */
+static void hidapi_close(void *handle)
+{
+    hid_close(handle);
+}
+
+const struct transport_ops usb_transport =
+{
+    .name = "hidapi",
+    .write = hidapi_write,
+    .read = hidapi_read,
+    .close = hidapi_close,
+    .get_fd = NULL,
+};
+
+/**
+ * Converts one of hidapi's wide strings into a newly allocated multibyte
+ * string
+ *
+ * @param[in] text The wide string, or NULL
+ *
+ * @return Returns the converted string, which is empty if the original was
+ *         NULL or unconvertible, or NULL if out of memory
+ */
+static char *narrow_string(const wchar_t *text)
+{
+    char *narrow = NULL;
+    size_t length = text != NULL ? wcstombs(NULL, text, 0) : (size_t)-1;
+
+    if (length == (size_t)-1)
+    {
+        narrow = strdup("");
+    }
+    else if ((narrow = malloc(length + 1)) != NULL)
+    {
+        wcstombs(narrow, text, length + 1);
+    }
+
+    return narrow;
+}
+
+struct usb_device_info *usb_enumerate(void)
+{
+    struct hid_device_info *devices = hid_enumerate(LAUNCHER_VID,
+            LAUNCHER_PID);
+    struct hid_device_info *info;
+    struct usb_device_info *head = NULL;
+    struct usb_device_info **tail = &head;
+
+    for (info = devices; info != NULL; info = info->next)
+    {
+        struct usb_device_info *entry = calloc(1, sizeof(*entry));
+
+        if (entry != NULL)
+        {
+            entry->path = strdup(info->path);
+            entry->serial = narrow_string(info->serial_number);
+            entry->product = narrow_string(info->product_string);
+
+            if (entry->path == NULL || entry->serial == NULL ||
+                    entry->product == NULL)
+            {
+                usb_free_enumeration(entry);
+                entry = NULL;
+            }
+        }
+
+        if (entry != NULL)
+        {
+            *tail = entry;
+            tail = &entry->next;
+        }
+    }
+
+    hid_free_enumeration(devices);
+
+    return head;
+}
+
+void usb_free_enumeration(struct usb_device_info *devices)
+{
+    while (devices != NULL)
+    {
+        struct usb_device_info *next = devices->next;
+
+        free(devices->path);
+        free(devices->serial);
+        free(devices->product);
+        free(devices);
+        devices = next;
+    }
+}
+
+void *usb_open_path(const char *path)
+{
+    return hid_open_path(path);
+}
+
+char *usb_get_serial(void *handle)
+{
+    wchar_t serial[MAX_SERIAL_LENGTH];
+    bool launcher = true;
+
+#ifdef HAVE_HID_DEVICE_INFO
+    struct hid_device_info *info = hid_get_device_info(handle);
+
+    launcher = info != NULL && info->vendor_id == LAUNCHER_VID &&
+        info->product_id == LAUNCHER_PID;
+#endif
+
+    // Older hidapi can't tell what it opened, so any device is taken at its
+    // word. Launchers without a serial number simply report an empty one.
+    if (launcher && hid_get_serial_number_string(handle, serial,
+                MAX_SERIAL_LENGTH) != 0)
+    {
+        serial[0] = L'\0';
+    }
+
+    return launcher ? narrow_string(serial) : NULL;
+}
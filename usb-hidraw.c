@@ -0,0 +1,300 @@
+#include "usb.h"
+#include "launcher.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+//
+// Where the kernel lists hidraw devices
+//
+#define HIDRAW_CLASS_DIR    "/sys/class/hidraw"
+#define HIDRAW_DEV_DIR      "/dev"
+
+//
+// Where the kernel lists character devices by number
+//
+#define CHAR_DEV_DIR        "/sys/dev/char"
+
+//
+// Longest line accepted from a device's uevent file
+//
+#define MAX_UEVENT_LINE     256
+
+/**
+ * A launcher opened through its hidraw node
+ */
+struct hidraw_device
+{
+    int fd;
+};
+
+/**
+ * Writes an output report to the hidraw node. The kernel expects the report
+ * number first, and strips it for devices that don't number their reports.
+ */
+static int hidraw_write(void *handle, const uint8_t *data, size_t length)
+{
+    struct hidraw_device *device = handle;
+    ssize_t len;
+
+    do
+    {
+        len = write(device->fd, data, length);
+    }
+    while (len < 0 && errno == EINTR);
+
+    return len < 0 ? -1 : (int)len;
+}
+
+/**
+ * Reads an input report from the hidraw node, waiting for one to arrive
+ */
+static int hidraw_read(void *handle, uint8_t *data, size_t length,
+        int timeout_ms)
+{
+    struct hidraw_device *device = handle;
+    struct pollfd poll_fd = { .fd = device->fd, .events = POLLIN };
+    ssize_t len = 0;
+    int ready;
+
+    do
+    {
+        ready = poll(&poll_fd, 1, timeout_ms);
+    }
+    while (ready < 0 && errno == EINTR);
+
+    if (ready < 0 || (ready > 0 && !(poll_fd.revents & POLLIN)))
+    {
+        // Either poll failed or the device has gone away
+        len = -1;
+    }
+    else if (ready > 0)
+    {
+        do
+        {
+            len = read(device->fd, data, length);
+        }
+        while (len < 0 && errno == EINTR);
+    }
+
+    return len < 0 ? -1 : (int)len;
+}
+
+/**
+ * Closes a launcher opened through its hidraw node
+ */
+static void hidraw_close(void *handle)
+{
+    struct hidraw_device *device = handle;
+
+    close(device->fd);
+    free(device);
+}
+
+/**
+ * Gets the hidraw node's file descriptor
+ */
+static int hidraw_get_fd(void *handle)
+{
+    struct hidraw_device *device = handle;
+
+    return device->fd;
+}
+
+const struct transport_ops usb_transport =
+{
+    .name = "hidraw",
+    .write = hidraw_write,
+    .read = hidraw_read,
+    .close = hidraw_close,
+    .get_fd = hidraw_get_fd,
+};
+
+/**
+ * Reads the identity of a hidraw device from its uevent file in sysfs
+ *
+ * @param[in] dir The hidraw node's directory in sysfs, such as
+ *            /sys/class/hidraw/hidraw0
+ * @param[out] entry Gets populated with the serial number and product name
+ *
+ * @return Returns zero if the device is a launcher or non-zero otherwise
+ */
+static int read_uevent(const char *dir, struct usb_device_info *entry)
+{
+    int ret = -1;
+    char path[MAX_UEVENT_LINE];
+    char line[MAX_UEVENT_LINE];
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s/device/uevent", dir);
+    file = fopen(path, "r");
+
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL)
+    {
+        unsigned int bus;
+        unsigned int vendor;
+        unsigned int product;
+
+        line[strcspn(line, "\n")] = '\0';
+
+        if (sscanf(line, "HID_ID=%x:%x:%x", &bus, &vendor, &product) == 3)
+        {
+            ret = (vendor == LAUNCHER_VID && product == LAUNCHER_PID) ? 0 : -1;
+        }
+        else if (strncmp(line, "HID_NAME=", 9) == 0)
+        {
+            free(entry->product);
+            entry->product = strdup(line + 9);
+        }
+        else if (strncmp(line, "HID_UNIQ=", 9) == 0)
+        {
+            free(entry->serial);
+            entry->serial = strdup(line + 9);
+        }
+    }
+
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+
+    return ret;
+}
+
+struct usb_device_info *usb_enumerate(void)
+{
+    DIR *dir = opendir(HIDRAW_CLASS_DIR);
+    struct dirent *dirent;
+    struct usb_device_info *head = NULL;
+    struct usb_device_info **tail = &head;
+
+    while (dir != NULL && (dirent = readdir(dir)) != NULL)
+    {
+        struct usb_device_info *entry;
+        char node[sizeof(HIDRAW_CLASS_DIR "/") + sizeof(dirent->d_name)];
+
+        if (dirent->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        entry = calloc(1, sizeof(*entry));
+        snprintf(node, sizeof(node), HIDRAW_CLASS_DIR "/%s", dirent->d_name);
+
+        if (entry != NULL && read_uevent(node, entry) == 0)
+        {
+            size_t length = strlen(HIDRAW_DEV_DIR "/") +
+                strlen(dirent->d_name) + 1;
+
+            entry->path = malloc(length);
+
+            if (entry->path != NULL)
+            {
+                snprintf(entry->path, length, HIDRAW_DEV_DIR "/%s",
+                        dirent->d_name);
+            }
+
+            if (entry->serial == NULL)
+            {
+                entry->serial = strdup("");
+            }
+
+            if (entry->product == NULL)
+            {
+                entry->product = strdup("");
+            }
+        }
+        else
+        {
+            usb_free_enumeration(entry);
+            entry = NULL;
+        }
+
+        if (entry != NULL && (entry->path == NULL || entry->serial == NULL ||
+                    entry->product == NULL))
+        {
+            usb_free_enumeration(entry);
+            entry = NULL;
+        }
+
+        if (entry != NULL)
+        {
+            *tail = entry;
+            tail = &entry->next;
+        }
+    }
+
+    if (dir != NULL)
+    {
+        closedir(dir);
+    }
+
+    return head;
+}
+
+void usb_free_enumeration(struct usb_device_info *devices)
+{
+    while (devices != NULL)
+    {
+        struct usb_device_info *next = devices->next;
+
+        free(devices->path);
+        free(devices->serial);
+        free(devices->product);
+        free(devices);
+        devices = next;
+    }
+}
+
+void *usb_open_path(const char *path)
+{
+    struct hidraw_device *device = malloc(sizeof(*device));
+
+    if (device != NULL)
+    {
+        device->fd = open(path, O_RDWR | O_CLOEXEC);
+
+        if (device->fd < 0)
+        {
+            free(device);
+            device = NULL;
+        }
+    }
+
+    return device;
+}
+
+char *usb_get_serial(void *handle)
+{
+    struct hidraw_device *device = handle;
+    struct usb_device_info entry = { NULL, NULL, NULL, NULL };
+    char node[MAX_UEVENT_LINE];
+    char *serial = NULL;
+    struct stat info;
+
+    // The node's number leads back to its entry in sysfs, wherever it is
+    if (fstat(device->fd, &info) == 0 && S_ISCHR(info.st_mode))
+    {
+        snprintf(node, sizeof(node), CHAR_DEV_DIR "/%u:%u",
+                major(info.st_rdev), minor(info.st_rdev));
+
+        if (read_uevent(node, &entry) == 0)
+        {
+            serial = entry.serial != NULL ? entry.serial : strdup("");
+            entry.serial = NULL;
+        }
+    }
+
+    free(entry.serial);
+    free(entry.product);
+
+    return serial;
+}
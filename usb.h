@@ -0,0 +1,60 @@
+#ifndef USB_H
+#define USB_H
+
+#include "transport.h"
+
+/**
+ * An attached launcher found by usb_enumerate
+ */
+struct usb_device_info
+{
+    char *path;                     // Passed to usb_open_path
+    char *serial;                   // Empty if the launcher reports none
+    char *product;                  // Empty if the launcher reports none
+    struct usb_device_info *next;
+};
+
+/**
+ * Transport that reaches real launchers. Which USB stack it sits on is
+ * chosen when building, through HIDAPI_PROVIDER.
+ */
+extern const struct transport_ops usb_transport;
+
+/**
+ * Finds every attached launcher
+ *
+ * @return Returns a list of launchers to be released with
+ *         usb_free_enumeration, or NULL if none were found
+ */
+struct usb_device_info *usb_enumerate(void);
+
+/**
+ * Releases a list returned by usb_enumerate
+ *
+ * @param[in] devices The list to release
+ */
+void usb_free_enumeration(struct usb_device_info *devices);
+
+/**
+ * Opens the launcher at a device path
+ *
+ * @param[in] path The device path, as reported by usb_enumerate
+ *
+ * @return Returns a handle for use with usb_transport on success or NULL
+ *         otherwise
+ */
+void *usb_open_path(const char *path);
+
+/**
+ * Gets the serial number of an open device, which also shows whether it is
+ * a launcher at all where the USB stack can tell
+ *
+ * @param[in] handle The handle returned by usb_open_path
+ *
+ * @return Returns the serial number, which is empty if the launcher reports
+ *         none and which the caller must free, or NULL if the device is not
+ *         a launcher or can't be identified
+ */
+char *usb_get_serial(void *handle);
+
+#endif